@@ -0,0 +1,334 @@
+/// Check the lookup of a disc without a drive or the internet. First, the TOC
+/// of the *Storm Boy* disc is read through a TocSource from the `cd-discid`
+/// line in `bench/fixtures`, and it and a synthetic disc are checked against
+/// their known disc IDs. Then CddbClient, and the parsing of its responses by
+/// Cddb, are checked against a stand-in CDDB server on localhost that answers
+/// from the fixtures. The server answers a query for the *Storm Boy* disc with
+/// `storm_boy.query` (code 210, several exact matches), queries for two
+/// discs made up from it by lengthening the disc with a single exact match
+/// (200) and with inexact matches (211), and every read with `storm_boy.xmcd`.
+///
+/// All of the requests are sent through one client, so they must all go over
+/// one kept-alive connection. Nothing is timed; the program fails, and says
+/// which check failed, if the client or the parsing is broken.
+///
+/// Usage: `cddb_client_check [fixtures]`
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>		// POSIX only, for the sockets
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "cddb.h"
+#include "cddb_client.h"
+#include "toc.h"
+
+/// Read a fixture.
+/// @param dir The fixtures directory.
+/// @param name The file name of the fixture.
+/// @return Returns the content of the file.
+static std::string fixture(const std::string & dir, const std::string & name)
+{
+	std::ifstream in(dir + "/" + name);
+	if(not in) {
+		std::cerr << "Unable to read the fixture " << dir << "/" << name << "." << std::endl;
+		std::exit(1);
+	}
+	std::stringstream content;
+	content << in.rdbuf();
+	return content.str();
+}
+
+/// A CDDB server on an ephemeral port of localhost, which answers queries
+/// from a table of disc IDs, and reads with one entry. Just enough HTTP/1.1
+/// is spoken for a CddbClient, as by MirrorServer, and the connections and
+/// requests are counted.
+class FixtureServer
+{
+  public:
+
+	/// Start listening, and accepting connections.
+	/// @param queries The response to a query, by disc ID.
+	/// @param entry The response to every read.
+	/// @throws std::runtime_error If a socket can't be listened on.
+	FixtureServer(const std::map<std::string, std::string> & queries, const std::string & entry)
+	  : _queries(queries), _entry(entry)
+	{
+		sockaddr_in addr {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = 0;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t length = sizeof(addr);
+		_listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(_listener < 0
+		   or ::bind(_listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+		   or ::listen(_listener, SOMAXCONN) != 0
+		   or ::getsockname(_listener, reinterpret_cast<sockaddr *>(&addr), &length) != 0) {
+			throw std::runtime_error(std::string("Unable to listen on localhost: ")
+									 + std::strerror(errno));
+		}
+		_port = ntohs(addr.sin_port);
+		_acceptor = std::thread(&FixtureServer::accept, this);
+	}
+
+	/// Stop accepting connections, and wait for the open ones to be closed
+	/// by their clients.
+	~FixtureServer()
+	{
+		::shutdown(_listener, SHUT_RDWR);
+		_acceptor.join();
+		for(auto & connection : _connections) {
+			connection.join();
+		}
+		::close(_listener);
+	}
+
+	FixtureServer(const FixtureServer &) = delete;
+	FixtureServer & operator=(const FixtureServer &) = delete;
+
+	/// The URL of the server's `cddb.cgi`.
+	std::string url() const
+	{
+		return "http://127.0.0.1:" + std::to_string(_port) + "/~cddb/cddb.cgi";
+	}
+
+	/// The connections accepted so far.
+	int connections() const { return _accepted; }
+
+	/// The requests answered so far.
+	int requests() const { return _requests; }
+
+  private:
+
+	/// Accept connections until the listener is shut down.
+	void accept()
+	{
+		while(true) {
+			int fd = ::accept4(_listener, nullptr, nullptr, SOCK_CLOEXEC);
+			if(fd < 0) {
+				if(errno == EINTR or errno == ECONNABORTED) {
+					continue;
+				}
+				return;
+			}
+			++_accepted;
+			_connections.emplace_back(&FixtureServer::serve, this, fd);
+		}
+	}
+
+	/// Answer the requests of one connection until the client closes it.
+	/// @param fd The connection.
+	void serve(int fd)
+	{
+		std::string buffer;
+		char chunk[4096];
+		while(true) {
+			size_t end;
+			while((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+				ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+				if(n <= 0) {
+					::close(fd);
+					return;
+				}
+				buffer.append(chunk, n);
+			}
+			std::istringstream request(buffer.substr(0, end));
+			buffer.erase(0, end + 4);
+			std::string method;
+			std::string target;
+			request >> method >> target;
+			++_requests;
+
+			std::string body = respond(target);
+			std::string response = "HTTP/1.1 200 OK\r\n"
+								   "Content-Type: text/plain; charset=UTF-8\r\n"
+								   "Content-Length: " + std::to_string(body.size()) + "\r\n"
+								   "Connection: keep-alive\r\n"
+								   "\r\n" + body;
+			if(::send(fd, response.data(), response.size(), MSG_NOSIGNAL)
+			   != static_cast<ssize_t>(response.size())) {
+				::close(fd);
+				return;
+			}
+		}
+	}
+
+	/// Answer the request for a URL.
+	/// @param target The path and query string of the request.
+	/// @return Returns the body of the response.
+	std::string respond(const std::string & target) const
+	{
+		// The command is the cmd parameter, with its words joined by a '+'
+		size_t start = target.find("cmd=");
+		std::string cmd = target.substr(start == std::string::npos ? target.size() : start + 4);
+		cmd = cmd.substr(0, cmd.find('&'));
+		for(auto & c : cmd) {
+			c = c == '+' ? ' ' : c;
+		}
+
+		std::istringstream words(cmd);
+		std::string command;
+		std::string sub;
+		std::string discId;
+		words >> command >> sub >> discId;
+		if(command == "cddb" and sub == "query") {
+			auto found = _queries.find(discId);
+			return found == _queries.end() ? "202 No match found.\r\n" : found->second;
+		} else if(command == "cddb" and sub == "read") {
+			return _entry;
+		}
+		return "500 Unrecognized command.\r\n";
+	}
+
+	const std::map<std::string, std::string> _queries;	///< The response to a query, by disc ID.
+	const std::string _entry;					///< The response to every read.
+	int _listener { -1 };						///< The listening socket.
+	int _port { 0 };							///< The port listened on.
+	std::thread _acceptor;						///< Accepts the connections.
+	std::vector<std::thread> _connections;		///< Serve the connections, one each.
+	std::atomic<int> _accepted { 0 };			///< The connections accepted.
+	std::atomic<int> _requests { 0 };			///< The requests answered.
+};
+
+/// The checks that have failed.
+static int failures = 0;
+
+/// Print the outcome of a check.
+/// @param ok True if the check passed.
+/// @param what What was checked.
+static void check(bool ok, const std::string & what)
+{
+	std::cout << (ok ? "ok      " : "FAILED  ") << what << std::endl;
+	if(not ok) {
+		++failures;
+	}
+}
+
+/// Check the TOC that is read from a `cd-discid` line through a TocSource,
+/// and the disc IDs that are computed in-process.
+/// @param dir The fixtures directory.
+static void checkToc(const std::string & dir)
+{
+	const std::string path = dir + "/storm_boy.discid";
+	std::istringstream line(fixture(dir, "storm_boy.discid"));
+	std::string discId;
+	int tracks = 0;
+	line >> discId >> tracks;
+	std::vector<int> offsets(tracks);
+	for(auto & offset : offsets) {
+		line >> offset;
+	}
+	int seconds = 0;
+	line >> seconds;
+
+	Toc toc = TocSource::open(path)->read();
+	check(toc.offsets == offsets and toc.length() == seconds,
+		  "the TOC is read from a file standing in for the drive");
+	check(toc.discIdString() == discId, "the disc ID is " + discId);
+
+	// A full disc of 30 second tracks, whose digit sums come to 1179, which
+	// is more than the checksum byte holds
+	Toc full;
+	for(int i=0;i<99;++i) {
+		full.offsets.push_back(150 + i * 30 * Cddb::CD_FRAME);
+	}
+	full.leadOut = 2972 * Cddb::CD_FRAME;
+	check(full.discIdString() == "9f0b9a63", "the checksum of a 99 track disc wraps");
+	check(Toc::parse(full.toString()).offsets == full.offsets,
+		  "a 99 track TOC is formatted and parsed again");
+}
+
+/// Make up a disc from another by making it longer, which changes its disc ID.
+/// @param toc The disc.
+/// @param seconds How much longer the disc is.
+/// @return Returns the made-up disc.
+static Toc lengthened(Toc toc, int seconds)
+{
+	toc.leadOut += seconds * Cddb::CD_FRAME;
+	return toc;
+}
+
+int main(int argc, char * argv[])
+{
+	const std::string dir = argc > 1 ? argv[1] : BENCH_FIXTURES_DIR;
+	const Toc stormBoy = Toc::parse(fixture(dir, "storm_boy.discid"));
+	const Toc exact = lengthened(stormBoy, 2);
+	const Toc inexact = lengthened(stormBoy, 4);
+	const std::string match = "data a70d5289 Xavier Rudd / Storm Boy";
+
+	// The client identifies itself with the user's name
+	setenv("USER", "cddb_client_check", 0);
+
+	std::map<std::string, std::string> queries {
+		{ stormBoy.discIdString(), fixture(dir, "storm_boy.query") },
+		{ exact.discIdString(), "200 " + match + "\r\n" },
+		{ inexact.discIdString(),
+		  "211 Found inexact matches, list follows (until terminating `.')\r\n"
+		  + match + "\r\n"
+		  "rock a60d5288 Xavier Rudd / Storm Boy\r\n"
+		  ".\r\n" }
+	};
+	if(queries.size() != 3) {
+		std::cerr << "The made-up discs have the same disc ID as the fixture." << std::endl;
+		return 1;
+	}
+
+	try {
+		checkToc(dir);
+
+		FixtureServer server(queries, fixture(dir, "storm_boy.xmcd"));
+		{
+			// Neither cached nor mirrored, so that every command reaches the server
+			auto client = std::make_shared<CddbClient>(server.url(), nullptr, nullptr);
+
+			Cddb multiple(client);
+			multiple.loadToc(stormBoy);
+			multiple.cddbQuery();
+			check(multiple.isMultiple() and not multiple.isInexact()
+				  and multiple.possibleMatches().size() == 2
+				  and multiple.possibleMatches()[0] == match,
+				  "210 gives the exact matches");
+
+			multiple.fetchTracks(0);
+			check(multiple.artist() == "Xavier Rudd" and multiple.title() == "Storm Boy"
+				  and multiple.year() == 2018 and multiple.tracks().size() == 13,
+				  "the entry of a match is read and parsed");
+
+			Cddb single(client);
+			single.loadToc(exact);
+			single.cddbQuery();
+			check(not single.isMultiple() and not single.isInexact()
+				  and single.possibleMatches().size() == 1
+				  and single.possibleMatches()[0] == match,
+				  "200 gives the one exact match");
+
+			Cddb near(client);
+			near.loadToc(inexact);
+			near.cddbQuery();
+			check(near.isInexact() and near.possibleMatches().size() == 2
+				  and near.possibleMatches()[0] == match,
+				  "211 gives the inexact matches");
+		}
+		// The client has closed its connection, so the server's threads are done
+		check(server.requests() == 4, "every command reached the server");
+		check(server.connections() == 1, "the connection was kept alive and reused");
+	} catch(const std::exception & e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return failures == 0 ? 0 : 1;
+}
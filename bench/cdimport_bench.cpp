@@ -0,0 +1,183 @@
+/// Microbenchmarks of the parsing and formatting hot paths of a lookup, i.e.,
+/// parsing the table of contents and computing the disc ID, splitting and
+/// decoding the responses of the CDDB server, parsing an xmcd entry into a
+/// Cddb, ranking inexact matches by TOC, formatting track lengths, and the
+/// checksums of ripped tracks. Nothing is sent to the server.
+///
+/// The inputs are the fixtures in `bench/fixtures`: the *Storm Boy* disc used
+/// as the example in Cddb, and a synthetic disc with the maximum of 99 tracks
+/// and long, continued fields.
+///
+/// Usage: `cdimport_bench [--filter TEXT] [--min-time SECONDS] [fixtures]`
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "harness.h"
+
+#include "cddb.h"
+#include "checksums.h"
+#include "toc.h"
+#include "toc_matcher.h"
+#include "utility.h"
+#include "xmcd.h"
+
+/// The number of TOCs that are ranked, about the size of a freedb dump.
+static const uint32_t TOC_RANK_COUNT = 1 << 21;
+
+/// The length of the audio that is checksummed, in seconds, about a track.
+static const int CHECKSUM_SECONDS = 60;
+
+/// Read a fixture.
+/// @param dir The fixtures directory.
+/// @param name The file name of the fixture.
+/// @return Returns the content of the file.
+static std::string fixture(const std::string & dir, const std::string & name)
+{
+	std::ifstream in(dir + "/" + name);
+	if(not in) {
+		std::cerr << "Unable to read the fixture " << dir << "/" << name << "." << std::endl;
+		std::exit(1);
+	}
+	std::stringstream content;
+	content << in.rdbuf();
+	return content.str();
+}
+
+int main(int argc, char * argv[])
+{
+	Harness harness(argc, argv);
+	const std::string dir = harness.args().empty() ? BENCH_FIXTURES_DIR : harness.args()[0];
+
+	const std::string discs[] = { "storm_boy", "large" };
+	for(const auto & disc : discs) {
+		const std::string discId = fixture(dir, disc + ".discid");
+		const std::string xmcd = fixture(dir, disc + ".xmcd");
+		const Toc toc = Toc::parse(discId);
+
+		harness.run("toc_parse/" + disc, [&] {
+			keep(Toc::parse(discId));
+		});
+		harness.run("toc_disc_id/" + disc, [&] {
+			keep(toc.discIdString());
+		});
+		harness.run("toc_to_string/" + disc, [&] {
+			keep(toc.toString());
+		});
+		harness.run("load_toc/" + disc, [&] {
+			Cddb cd;
+			cd.loadToc(toc);
+			keep(cd);
+		});
+		harness.run("separate_raw/" + disc, [&] {
+			keep(Cddb::separateRawCddbData(xmcd));
+		});
+		harness.run("xmcd_parse/" + disc, [&] {
+			XmcdEntry entry;
+			XmcdParser::parse(xmcd, entry);
+			keep(entry);
+		});
+
+		// As done for the result that is read, after the disc has been queried
+		Cddb cd;
+		cd.loadToc(toc);
+		harness.run("parse_entry/" + disc, [&] {
+			cd.parseEntry(xmcd);
+			keep(cd);
+		});
+	}
+
+	const std::string query = fixture(dir, "storm_boy.query");
+	harness.run("separate_raw/query", [&] {
+		keep(Cddb::separateRawCddbData(query));
+	});
+	const std::string status = Cddb::separateRawCddbData(query)[0];
+	harness.run("cddb_code/query", [&] {
+		keep(Cddb::getCddbCode(status));
+	});
+
+	// Rank a mirror's worth of TOCs, which are the Storm Boy disc with every
+	// offset moved by up to a few seconds
+	const Toc stormBoy = Toc::parse(fixture(dir, "storm_boy.discid"));
+	TocMatcher matcher;
+	uint32_t seed = 1;
+	for(uint32_t i=0;i<TOC_RANK_COUNT;++i) {
+		Toc toc = stormBoy;
+		for(auto & offset : toc.offsets) {
+			seed = seed * 1664525 + 1013904223;
+			offset += static_cast<int>(seed >> 24) - 128;
+		}
+		toc.leadOut += 75 * static_cast<int>(i % 7);
+		matcher.add(toc, i);
+	}
+	// The kernel for this processor must rank alike with the scalar reference,
+	// for the disc and for a few more discs like the ones that were added
+	std::vector<Toc> queries { stormBoy };
+	for(int i=0;i<4;++i) {
+		Toc toc = stormBoy;
+		for(auto & offset : toc.offsets) {
+			seed = seed * 1664525 + 1013904223;
+			offset += static_cast<int>(seed >> 24) - 128;
+		}
+		queries.push_back(toc);
+	}
+	for(const auto & toc : queries) {
+		auto matches = matcher.rank(toc, 100);
+		auto reference = matcher.scalarRank(toc, 100);
+		bool agree = not matches.empty() and matches.size() == reference.size();
+		for(size_t i=0;agree and i<matches.size();++i) {
+			agree = matches[i].tag == reference[i].tag and matches[i].distance == reference[i].distance;
+		}
+		if(not agree) {
+			std::cerr << "The TOC ranking kernel doesn't agree with the scalar reference." << std::endl;
+			return 1;
+		}
+	}
+	harness.run(std::string("toc_rank/") + (TocMatcher::isVectorized() ? "avx2" : "scalar"), [&] {
+		keep(matcher.rank(stormBoy));
+	});
+
+	// Checksum a track of noise, with the scalar reference and with the
+	// kernels for this processor, which must agree
+	std::vector<char> audio(CHECKSUM_SECONDS * 75 * 2352);
+	for(auto & byte : audio) {
+		seed = seed * 1664525 + 1013904223;
+		byte = static_cast<char>(seed >> 24);
+	}
+	uint32_t v1, v2, referenceV1, referenceV2;
+	Checksums::accurateRip(audio.data(), audio.size(), true, true, v1, v2);
+	Checksums::scalarAccurateRip(audio.data(), audio.size(), true, true, referenceV1, referenceV2);
+	if(v1 != referenceV1 or v2 != referenceV2
+	   or Checksums::crc32(audio.data(), audio.size()) != Checksums::scalarCrc32(audio.data(), audio.size())) {
+		std::cerr << "The checksum kernels don't agree with the scalar reference." << std::endl;
+		return 1;
+	}
+	const std::string kernel = Checksums::isVectorized() ? "simd" : "scalar";
+	harness.run("crc32/reference", [&] {
+		keep(Checksums::scalarCrc32(audio.data(), audio.size()));
+	});
+	harness.run("crc32/" + kernel, [&] {
+		keep(Checksums::crc32(audio.data(), audio.size()));
+	});
+	harness.run("accuraterip/reference", [&] {
+		Checksums::scalarAccurateRip(audio.data(), audio.size(), true, true, v1, v2);
+		keep(v2);
+	});
+	harness.run("accuraterip/" + kernel, [&] {
+		Checksums::accurateRip(audio.data(), audio.size(), true, true, v1, v2);
+		keep(v2);
+	});
+
+	// Cover the minutes-only and the hours formats
+	int length = 0;
+	harness.run("readable_length", [&] {
+		keep(Utility::readableLength(length));
+		length = (length + 97) % 10800;
+	});
+
+	harness.report(std::cout, CDIMPORT_VERSION);
+	return 0;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// A small harness for microbenchmarks. Each benchmark is a function that does
+/// one operation. The function is called in batches, the size of which is
+/// calibrated so that a batch takes a measurable time, and the batch is timed
+/// a number of times. The median time per operation is reported, along with
+/// the fastest and slowest batches.
+///
+/// Progress is printed as a table to the standard error, and the results are
+/// written as JSON to the standard output, so that they can be saved and
+/// compared between versions, e.g.
+///
+/// `% cdimport_bench > results-0.1.json`
+class Harness
+{
+  public:
+
+	/// The number of timed batches of each benchmark.
+	static const int SAMPLES = 7;
+
+	/// Parse the command line arguments of a benchmark program, which are
+	/// `--filter TEXT`, to only run the benchmarks whose names contain the
+	/// text, and `--min-time SECONDS`, the least time spent timing each
+	/// benchmark.
+	/// @param argc The number of arguments.
+	/// @param argv The arguments, including the program name.
+	Harness(int argc, char * argv[])
+	{
+		for(int i=1;i<argc;++i) {
+			std::string arg = argv[i];
+			if(arg == "--filter" and i + 1 < argc) {
+				_filter = argv[++i];
+			} else if(arg == "--min-time" and i + 1 < argc) {
+				_minTime = std::max(0.001, std::atof(argv[++i]));
+			} else {
+				_args.push_back(arg);
+			}
+		}
+	}
+
+	/// The arguments that weren't recognized by the harness.
+	/// @return Returns the remaining arguments, in order.
+	inline const std::vector<std::string> & args() const { return _args; }
+
+	/// Time a benchmark, unless it is filtered out.
+	/// @param name The name of the benchmark, e.g. `toc_parse/storm_boy`.
+	/// @param op One operation.
+	void run(const std::string & name, const std::function<void()> & op)
+	{
+		if(name.find(_filter) == std::string::npos) {
+			return;
+		}
+
+		// Grow the batch until it takes long enough to be timed reliably
+		long batch = 1;
+		while(time(op, batch) < _minTime / SAMPLES and batch < (1L << 40)) {
+			batch *= 2;
+		}
+
+		std::vector<double> ns;
+		for(int i=0;i<SAMPLES;++i) {
+			ns.push_back(time(op, batch) * 1e9 / batch);
+		}
+		std::sort(ns.begin(), ns.end());
+		Result result { name, batch * SAMPLES, ns[SAMPLES / 2], ns.front(), ns.back() };
+		_results.push_back(result);
+
+		std::cerr << std::left << std::setw(32) << name << std::right << std::fixed
+				  << std::setprecision(1)
+				  << std::setw(12) << result.median << " ns/op"
+				  << "  (min " << result.min << ", max " << result.max << ")" << std::endl;
+	}
+
+	/// Write the results as JSON.
+	/// @param os Where to write the results.
+	/// @param version The version of the program being measured.
+	void report(std::ostream & os, const std::string & version) const
+	{
+		os << "{" << std::endl
+		   << "  \"version\": \"" << version << "\"," << std::endl
+		   << "  \"benchmarks\": [";
+		for(size_t i=0;i<_results.size();++i) {
+			const Result & r = _results[i];
+			os << (i == 0 ? "" : ",") << std::endl << std::fixed << std::setprecision(3)
+			   << "    { \"name\": \"" << r.name << "\""
+			   << ", \"iterations\": " << r.iterations
+			   << ", \"ns_per_op\": " << r.median
+			   << ", \"min_ns_per_op\": " << r.min
+			   << ", \"max_ns_per_op\": " << r.max << " }";
+		}
+		os << std::endl << "  ]" << std::endl << "}" << std::endl;
+	}
+
+  private:
+
+	/// The timing of one benchmark.
+	struct Result
+	{
+		std::string name;		///< The name of the benchmark.
+		long iterations;		///< The number of timed operations.
+		double median;			///< The median time per operation, in nanoseconds.
+		double min;				///< The fastest batch, per operation.
+		double max;				///< The slowest batch, per operation.
+	};
+
+	/// Time a batch of operations.
+	/// @param op One operation.
+	/// @param batch The number of operations.
+	/// @return Returns the elapsed time in seconds.
+	static double time(const std::function<void()> & op, long batch)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for(long i=0;i<batch;++i) {
+			op();
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+
+	std::string _filter;				///< Only run the benchmarks containing this.
+	double _minTime { 0.5 };			///< The least time spent timing a benchmark, in seconds.
+	std::vector<std::string> _args;		///< The arguments not used by the harness.
+	std::vector<Result> _results;		///< The results so far.
+};
+
+/// Keep the compiler from optimizing away a value that is computed but unused.
+/// @param value The value.
+template <typename T>
+inline void keep(const T & value)
+{
+	asm volatile("" : : "g"(&value) : "memory");
+}
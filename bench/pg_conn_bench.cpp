@@ -0,0 +1,111 @@
+/// Compare the per-disc database latency of opening a new connection for every
+/// call, which is what PgConn used to do, against borrowing pooled connections,
+/// and against probing the AlbumIndex first.
+/// A "disc" is the pair of duplicate checks made after every lookup, namely
+/// PgConn::queryCdDiscId followed by PgConn::queryArtistTitle. Nothing is
+/// written to the database.
+///
+/// Usage: `pg_conn_bench [discs]`
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "pg_conn.h"
+#include "pg_statements.h"
+
+using Clock = std::chrono::steady_clock;
+
+/// Time a number of discs, and print a summary of the latencies.
+/// @param name The name of the variant being timed.
+/// @param discs How many discs to time.
+/// @param disc The work done for one disc.
+static void run(const std::string & name, int discs, const std::function<void(int)> & disc)
+{
+	std::vector<double> ms;
+	for(int i=0;i<discs;++i) {
+		auto start = Clock::now();
+		disc(i);
+		std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+		ms.push_back(elapsed.count());
+	}
+	std::sort(ms.begin(), ms.end());
+	double total = 0.0;
+	for(auto m : ms) {
+		total += m;
+	}
+	std::cout << std::left << std::setw(12) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << " mean " << std::setw(8) << total / ms.size() << " ms"
+			  << "  median " << std::setw(8) << ms[ms.size() / 2] << " ms"
+			  << "  p95 " << std::setw(8) << ms[ms.size() * 95 / 100] << " ms"
+			  << std::endl;
+}
+
+/// The disc ID used for the given disc. These are unlikely to be in the
+/// database, which is the common case for a new disc.
+static std::string discId(int i)
+{
+	char buf[9];
+	std::snprintf(buf, sizeof(buf), "%08x", 0xb0000000 + i);
+	return buf;
+}
+
+int main(int argc, char * argv[])
+{
+	int discs = argc > 1 ? std::atoi(argv[1]) : 50;
+	if(discs < 1) {
+		std::cerr << "Usage: " << argv[0] << " [discs]" << std::endl;
+		return 1;
+	}
+
+	// The old way, a new connection for every statement. The statements are
+	// the same as those of the pool, so that only the connections differ
+	run("per-call", discs, [](int i) {
+		{
+			pqxx::connection conn(PgConn::DB_CONNECTION_STRING);
+			pqxx::work w(conn);
+			w.exec_params(PgStatements::sql(PgStatements::QueryCdDiscId), discId(i));
+			w.commit();
+		}
+		{
+			pqxx::connection conn(PgConn::DB_CONNECTION_STRING);
+			pqxx::work w(conn);
+			w.exec_params(PgStatements::sql(PgStatements::QueryArtistTitle),
+						  "No Such Artist", "No Such Title", PgConn::SEARCH_LIMIT);
+			w.commit();
+		}
+	});
+
+	// The new way, warm the pool and then borrow connections
+	auto start = Clock::now();
+	PgConn::warmUp();
+	std::chrono::duration<double, std::milli> warm = Clock::now() - start;
+	std::cout << "Warming the pool took " << warm.count() << " ms." << std::endl;
+
+	run("pooled", discs, [](int i) {
+		PgConn::queryCdDiscId(discId(i));
+		PgConn::queryArtistTitle("No Such Artist", "No Such Title");
+	});
+
+	// With the index loaded, the disc ID check of a new disc doesn't reach the
+	// database
+	start = Clock::now();
+	PgConn::loadAlbumIndex();
+	std::chrono::duration<double, std::milli> load = Clock::now() - start;
+	std::cout << "Loading the album index took " << load.count() << " ms." << std::endl;
+
+	run("indexed", discs, [](int i) {
+		PgConn::queryCdDiscId(discId(i));
+		PgConn::queryArtistTitle("No Such Artist", "No Such Title");
+	});
+	PgStatements::report(std::cout);
+	AlbumIndex::shared().report(std::cout);
+
+	return 0;
+}
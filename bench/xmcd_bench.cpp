@@ -0,0 +1,218 @@
+/// Compare the time taken to parse xmcd entries with the regular expressions
+/// that Cddb::parseEntry used to use, against the single-pass XmcdParser. The
+/// corpus is read from a directory of xmcd files, e.g. an unpacked freedb
+/// dump, or, if no directory is given, made up of synthetic entries.
+///
+/// Before timing, it checks that the parser skips track fields numbered
+/// outside the tracks of a disc, and lines without a key, and fails if it
+/// doesn't.
+///
+/// Usage: `xmcd_bench [directory] [passes]`
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "xmcd.h"
+
+using Clock = std::chrono::steady_clock;
+
+/// Parse an entry the way Cddb::parseEntry used to, i.e., split it into lines,
+/// match every line against regular expressions, and collect the fields in a
+/// map. The results are kept in an XmcdEntry, so that the work done by the two
+/// parsers is comparable.
+static void regexParse(const std::string & raw, XmcdEntry & entry)
+{
+	std::vector<std::string> lines;
+	std::stringstream ss(raw);
+	std::string line;
+	while(getline(ss, line)) {
+		if(not line.empty() and line.back() == '\r') {
+			line.pop_back();
+		}
+		if(line == ".") {
+			break;
+		}
+		lines.push_back(line);
+	}
+
+	std::map<std::string, std::string> response;
+	std::regex kvp_regex("^([A-Z0-9]+)=(.*)");
+	std::regex cat_regex("^[0-9]+ ([a-z]+) .*");
+	for(auto line : lines) {
+		std::smatch match;
+		if(std::regex_search(line, match, kvp_regex)) {
+			response[match[1]] = match[2];
+		} else if(std::regex_search(line, match, cat_regex)) {
+			response["CATEGORY"] = match[1];
+		}
+	}
+	entry.category = response["CATEGORY"];
+	entry.genre = response["DGENRE"];
+	entry.year = response["DYEAR"].empty() ? 0 : std::stoi(response["DYEAR"]);
+	entry.extraInfo = response["EXTD"];
+
+	std::regex artist_regex("^([^/]+) / (.*)");
+	std::smatch match;
+	if(std::regex_search(response["DTITLE"], match, artist_regex)) {
+		entry.artist = match[1];
+		entry.title = match[2];
+	} else {
+		entry.artist = entry.title = response["DTITLE"];
+	}
+
+	for(int i=0;;++i) {
+		std::stringstream hashKey;
+		hashKey << "TTITLE" << i;
+		auto found = response.find(hashKey.str());
+		if(found == response.end()) {
+			break;
+		}
+		entry.trackTitles.push_back(found->second);
+		hashKey.clear();
+		hashKey.str("");
+		hashKey << "EXTT" << i;
+		entry.trackExtras.push_back(response[hashKey.str()]);
+	}
+}
+
+/// Make up an entry with the given number of tracks.
+static std::string syntheticEntry(int n)
+{
+	int tracks = 1 + n % 24;
+	std::stringstream ss;
+	ss << "210 rock " << std::hex << std::setw(8) << std::setfill('0') << 0xa0000000 + n
+	   << std::dec << " CD database entry follows (until terminating `.')\r\n"
+	   << "# xmcd\r\n#\r\n# Track frame offsets:\r\n";
+	for(int i=0;i<tracks;++i) {
+		ss << "#\t" << 150 + i * 17000 << "\r\n";
+	}
+	ss << "#\r\n# Disc length: " << (150 + tracks * 17000) / 75 << " seconds\r\n#\r\n"
+	   << "# Revision: 0\r\n# Submitted via: xmcd_bench\r\n#\r\n"
+	   << "DISCID=" << std::hex << 0xa0000000 + n << std::dec << "\r\n"
+	   << "DTITLE=Artist " << n << " / Album " << n << "\r\n"
+	   << "DYEAR=" << 1970 + n % 50 << "\r\n"
+	   << "DGENRE=Rock\r\n";
+	for(int i=0;i<tracks;++i) {
+		ss << "TTITLE" << i << "=Track " << i + 1 << " of album " << n << "\r\n";
+	}
+	ss << "EXTD=\r\n";
+	for(int i=0;i<tracks;++i) {
+		ss << "EXTT" << i << "=\r\n";
+	}
+	ss << "PLAYORDER=\r\n.\r\n";
+	return ss.str();
+}
+
+/// Check that fields numbered outside the tracks of a disc are skipped,
+/// rather than written out of bounds or grown into a huge list, as are lines
+/// without a key.
+/// @return Returns false, and prints why, if the parser kept any of them.
+static bool checkTrackNumbers()
+{
+	const std::string raw = "DTITLE=Artist / Album\n"
+							"TTITLE0=First\n"
+							"TTITLE-1=Negative\n"
+							"TTITLE99=Past the last track\n"
+							"TTITLE4294967295=Overflow\n"
+							"TTITLE99999999999999999999=Too long\n"
+							"EXTT-1=Negative\n"
+							"EXTT2147483647=Huge\n"
+							"=No key\n"
+							"TTITLE98=Last\n"
+							".\n";
+	XmcdEntry entry;
+	XmcdParser::parse(raw, entry);
+	if(entry.trackTitles.size() != XmcdParser::MAX_TRACKS or entry.trackTitles[0] != "First"
+	   or entry.trackTitles[98] != "Last" or not entry.trackExtras.empty()) {
+		std::cerr << "The parser kept a track field outside the tracks of a disc." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/// Read every regular file under a directory.
+static std::vector<std::string> readCorpus(const std::string & path)
+{
+	namespace fs = std::filesystem;
+	std::vector<std::string> corpus;
+	for(const auto & file : fs::recursive_directory_iterator(path)) {
+		if(file.is_regular_file()) {
+			std::ifstream in(file.path());
+			std::stringstream content;
+			content << in.rdbuf();
+			corpus.push_back(content.str());
+		}
+	}
+	return corpus;
+}
+
+/// Parse the corpus a number of times, and print the throughput.
+/// @param name The name of the parser being timed.
+/// @param corpus The entries.
+/// @param passes How many times to parse the corpus.
+/// @param parse The parser.
+/// @return Returns the elapsed time in seconds.
+template <typename Parse>
+static double run(const std::string & name, const std::vector<std::string> & corpus,
+				  int passes, Parse parse)
+{
+	size_t tracks = 0;
+	auto start = Clock::now();
+	for(int pass=0;pass<passes;++pass) {
+		for(const auto & raw : corpus) {
+			XmcdEntry entry;
+			parse(raw, entry);
+			tracks += entry.trackTitles.size();
+		}
+	}
+	std::chrono::duration<double> elapsed = Clock::now() - start;
+	double seconds = elapsed.count();
+	std::cout << std::left << std::setw(8) << name << std::right << std::fixed
+			  << std::setprecision(3)
+			  << " " << std::setw(8) << seconds << " s  "
+			  << std::setw(12) << std::setprecision(0) << corpus.size() * passes / seconds
+			  << " entries/s  (" << tracks << " tracks)" << std::endl;
+	return seconds;
+}
+
+int main(int argc, char * argv[])
+{
+	if(not checkTrackNumbers()) {
+		return 1;
+	}
+	std::vector<std::string> corpus;
+	if(argc > 1) {
+		corpus = readCorpus(argv[1]);
+	} else {
+		for(int i=0;i<10000;++i) {
+			corpus.push_back(syntheticEntry(i));
+		}
+	}
+	int passes = argc > 2 ? std::max(1, std::atoi(argv[2])) : 1;
+	if(corpus.empty()) {
+		std::cerr << "No xmcd files were found." << std::endl;
+		return 1;
+	}
+
+	size_t bytes = 0;
+	for(const auto & raw : corpus) {
+		bytes += raw.size();
+	}
+	std::cout << "Parsing " << corpus.size() << " entries (" << bytes / 1024 << " KiB), "
+			  << passes << " pass(es)." << std::endl;
+
+	double before = run("regex", corpus, passes, regexParse);
+	double after = run("xmcd", corpus, passes, [](const std::string & raw, XmcdEntry & entry) {
+		XmcdParser::parse(raw, entry);
+	});
+	std::cout << std::setprecision(1) << "Speed-up: " << before / after << "x" << std::endl;
+	return 0;
+}
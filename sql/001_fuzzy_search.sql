@@ -0,0 +1,41 @@
+-- Fuzzy search of the albums by artist and title, for the duplicate check
+-- made after every lookup (see PgConn::queryArtistTitle).
+--
+-- Both are compared by their normalized keys, with trigram similarity, and
+-- GIN trigram indexes on the keys keep the search fast as the catalogue grows.
+--
+-- Run once against the albums database:
+--
+--     psql -d albums -f sql/001_fuzzy_search.sql
+
+BEGIN;
+
+CREATE EXTENSION IF NOT EXISTS pg_trgm;
+
+-- Normalize an artist or title, so that spellings that differ only in case,
+-- punctuation, "&" for "and", or a leading or trailing "The", e.g.
+-- "The Beatles" and "Beatles, The", have the same key.
+CREATE OR REPLACE FUNCTION album_key(value text)
+	RETURNS text
+	LANGUAGE sql
+	IMMUTABLE STRICT PARALLEL SAFE
+AS $$
+	SELECT btrim(
+		regexp_replace(
+			regexp_replace(
+				regexp_replace(
+					replace(lower(value), '&', ' and '),
+					',\s*the\s*$', ''),
+				'^\s*the\s+', ''),
+			'[^[:alnum:]]+', ' ', 'g'));
+$$;
+
+CREATE INDEX IF NOT EXISTS albums_artist_key_trgm
+	ON albums USING gin (album_key(artist) gin_trgm_ops);
+
+CREATE INDEX IF NOT EXISTS albums_title_key_trgm
+	ON albums USING gin (album_key(title) gin_trgm_ops);
+
+ANALYZE albums;
+
+COMMIT;
@@ -0,0 +1,28 @@
+-- Checksums of the audio of each track, stored when a disc is ripped as it is
+-- saved (see Ripper and PgConn::insertCd), so that a later rip of the same disc
+-- can be verified against the catalogue, without AccurateRip being online.
+--
+-- The CRC32 is of the whole track, as EAC's "Copy CRC", and the AccurateRip
+-- checksums are versions 1 and 2 (see Checksums). They are unsigned 32-bit
+-- values, so they are kept as bigint. Tracks that weren't ripped have none.
+--
+-- Run once against the albums database:
+--
+--     psql -d albums -f sql/002_track_checksums.sql
+
+BEGIN;
+
+ALTER TABLE tracks
+	ADD COLUMN IF NOT EXISTS crc32 bigint
+		CHECK (crc32 BETWEEN 0 AND 4294967295),
+	ADD COLUMN IF NOT EXISTS accuraterip_v1 bigint
+		CHECK (accuraterip_v1 BETWEEN 0 AND 4294967295),
+	ADD COLUMN IF NOT EXISTS accuraterip_v2 bigint
+		CHECK (accuraterip_v2 BETWEEN 0 AND 4294967295);
+
+-- Find the catalogued track that a rip matches, whichever disc it came from
+CREATE INDEX IF NOT EXISTS tracks_accuraterip_v2
+	ON tracks (accuraterip_v2)
+	WHERE accuraterip_v2 IS NOT NULL;
+
+COMMIT;
@@ -0,0 +1,19 @@
+-- How far each load of a freedb or gnudb dump has got (see DumpLoader), i.e.,
+-- the number of files of the archive that have been loaded. The row is
+-- updated in the same transaction as the chunk of albums and tracks that it
+-- counts, so a load that is stopped, however it is stopped, carries on after
+-- the last chunk that was committed, without loading any of it twice.
+--
+-- Run once against the albums database:
+--
+--     psql -d albums -f sql/003_load_progress.sql
+
+BEGIN;
+
+CREATE TABLE IF NOT EXISTS load_progress (
+	name text PRIMARY KEY,
+	files bigint NOT NULL CHECK (files >= 0),
+	updated timestamptz NOT NULL DEFAULT now()
+);
+
+COMMIT;
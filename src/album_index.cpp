@@ -0,0 +1,66 @@
+#include <mutex>
+
+#include "album_index.h"
+
+AlbumIndex & AlbumIndex::shared()
+{
+	static AlbumIndex index;
+	return index;
+}
+
+AlbumIndex::AlbumIndex()
+{
+}
+
+void AlbumIndex::add(std::string_view discId)
+{
+	uint64_t discIdHash = hash(discId);
+	std::unique_lock<std::shared_mutex> lock(_mutex);
+	_discIds.insert(discIdHash);
+	++_albums;
+}
+
+void AlbumIndex::setLoaded(bool loaded)
+{
+	_loaded = loaded;
+}
+
+bool AlbumIndex::mayHaveDiscId(const std::string & discId) const
+{
+	if(not _loaded) {
+		return true;
+	}
+	++_probes;
+	uint64_t discIdHash = hash(discId);
+	std::shared_lock<std::shared_mutex> lock(_mutex);
+	if(_discIds.count(discIdHash) == 0) {
+		++_misses;
+		return false;
+	}
+	return true;
+}
+
+size_t AlbumIndex::size() const
+{
+	std::shared_lock<std::shared_mutex> lock(_mutex);
+	return _albums;
+}
+
+void AlbumIndex::report(std::ostream & out) const
+{
+	if(not _loaded) {
+		return;
+	}
+	out << "Album index: " << size() << " albums, " << _misses << " of " << _probes
+		<< " duplicate checks answered without the database" << std::endl;
+}
+
+uint64_t AlbumIndex::hash(std::string_view s)
+{
+	uint64_t h = 14695981039346656037ull;
+	for(unsigned char c : s) {
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
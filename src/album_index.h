@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+/// An in-memory index of the albums in the database, so that checking whether
+/// a disc has already been catalogued doesn't need a round trip to the
+/// database. The database is only queried, for the details, when the index
+/// has a match.
+///
+/// The index holds a 64-bit hash of the disc ID of every album. Near misses by
+/// artist and title are left to the trigram search of
+/// PgConn::queryArtistTitle(), which no exact key could stand in for. The
+/// index is loaded once, by PgConn::loadAlbumIndex(), and kept up to date by
+/// PgConn as albums are inserted. Albums that other stations insert while this
+/// one is running aren't seen until the next start.
+///
+/// The index can only give false positives (hash collisions), which cost a
+/// query, never false negatives. Until it has been loaded, every probe is a
+/// match, so callers fall back to the database.
+///
+/// The index is safe to use from several threads.
+class AlbumIndex
+{
+  public:
+
+	/// The index used by the application, created on first use.
+	/// @return Returns the shared index.
+	static AlbumIndex & shared();
+
+	/// Construct an empty index, that hasn't been loaded.
+	AlbumIndex();
+
+	AlbumIndex(const AlbumIndex &) = delete;
+	AlbumIndex & operator=(const AlbumIndex &) = delete;
+
+	/// Add an album.
+	/// @param discId The disc ID of the album.
+	void add(std::string_view discId);
+
+	/// Mark the index as holding every album in the database, so that probes
+	/// that miss are trusted.
+	/// @param loaded True once the albums have all been added.
+	void setLoaded(bool loaded);
+
+	/// Check if the index holds every album in the database.
+	inline bool isLoaded() const { return _loaded; }
+
+	/// Check if an album with a disc ID may be in the database.
+	/// @param discId The disc ID.
+	/// @return Returns false only if there is certainly no such album.
+	bool mayHaveDiscId(const std::string & discId) const;
+
+	/// The number of albums that have been added.
+	size_t size() const;
+
+	/// Print the number of albums, and how many probes were answered without
+	/// the database.
+	/// @param out Where to print the report.
+	void report(std::ostream & out) const;
+
+  private:
+
+	/// Hash a string with FNV-1a.
+	/// @param s The string.
+	/// @return Returns the 64-bit hash.
+	static uint64_t hash(std::string_view s);
+
+	mutable std::shared_mutex _mutex;			///< Guards the set.
+	std::unordered_set<uint64_t> _discIds;		///< The hashes of the disc IDs.
+	size_t _albums { 0 };						///< The number of albums added.
+	std::atomic<bool> _loaded { false };		///< Are all of the albums in the index?
+	mutable std::atomic<uint64_t> _probes { 0 };	///< The number of probes.
+	mutable std::atomic<uint64_t> _misses { 0 };	///< The probes answered without the database.
+};
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <thread>
+
+#include "batch_import.h"
+
+#include "cd_import.h"
+#include "exceptions.h"
+
+const std::string BatchImport::DEFAULT_REVIEW_FILE { "review.txt" };
+
+/// Build the table of contents from the comments at the top of an xmcd file,
+/// i.e., the "Track frame offsets" and the "Disc length".
+/// @param entry The parsed xmcd file.
+/// @return Returns the table of contents.
+/// @throws CddbError If the comments are missing.
+static Toc xmcdToc(const XmcdEntry & entry)
+{
+	if(entry.offsets.empty() or entry.discLength <= 0) {
+		throw CddbError("The xmcd file has no track frame offsets or disc length.");
+	}
+	Toc toc;
+	toc.offsets = entry.offsets;
+	toc.leadOut = entry.discLength * Cddb::CD_FRAME;
+	return toc;
+}
+
+/// Insert discs, reporting rather than throwing any failure.
+/// @param cds The discs.
+/// @return Returns true if all of the discs were inserted.
+static bool insertCds(const PgConn::CdList & cds)
+{
+	try {
+		return PgConn::insertCds(cds);
+	} catch(const std::exception & e) {
+		std::cerr << "Failed to insert " << cds.size() << " disc(s): " << e.what() << std::endl;
+		return false;
+	}
+}
+
+int BatchImport::main(int argc, char * argv[])
+{
+	int jobs = DEFAULT_JOBS;
+	std::string review = DEFAULT_REVIEW_FILE;
+	std::vector<std::string> inputs;
+	for(int i=0;i<argc;++i) {
+		std::string arg = argv[i];
+		if(arg == "--jobs" and i + 1 < argc) {
+			jobs = std::max(1, std::atoi(argv[++i]));
+		} else if(arg == "--review" and i + 1 < argc) {
+			review = argv[++i];
+		} else {
+			inputs.push_back(arg);
+		}
+	}
+	if(inputs.empty()) {
+		std::cerr << "Usage: cdimport --batch [--jobs N] [--review FILE] INPUT..." << std::endl;
+		return 1;
+	}
+
+	BatchImport batch(jobs, review);
+	for(const auto & input : inputs) {
+		if(not batch.addInput(input)) {
+			std::cerr << "Unable to read " << input << "." << std::endl;
+			return 1;
+		}
+	}
+	return batch.run() ? 0 : 1;
+}
+
+Cd::CdAlbumData BatchImport::albumData(const Cddb & cd)
+{
+	auto found = std::find(&Cddb::VALID_CATEGORIES[0],
+						   Cddb::VALID_CATEGORIES + Cddb::NUM_VALID_CATEGORIES,
+						   cd.category());
+	if(found == Cddb::VALID_CATEGORIES + Cddb::NUM_VALID_CATEGORIES) {
+		--found;	// misc
+	}
+	int categoryId = (found - Cddb::VALID_CATEGORIES) + 1;
+
+	int numTracks = cd.tracks().size();
+	int typeId = numTracks <= 4 ? 1 : (numTracks <= 7 ? 2 : 3);	// single, EP or LP
+
+	static const std::regex various_regex("various", std::regex_constants::icase);
+	bool isCompilation = std::regex_search(cd.artist(), various_regex);
+
+	return std::make_tuple(
+		CdImport::CD_MEDIUM_ID,
+		typeId,
+		categoryId,
+		isCompilation,
+		cd.selectedResult(),
+		cd.cdDiscId(),
+		cd.title(),
+		cd.artist(),
+		cd.genre(),
+		cd.length(),
+		cd.extraInfo(),
+		cd.year(),
+		numTracks
+	);
+}
+
+BatchImport::BatchImport(int jobs, const std::string & reviewPath)
+  : _jobs(jobs), _review(reviewPath, std::ios::app)
+{
+}
+
+bool BatchImport::addInput(const std::string & path)
+{
+	namespace fs = std::filesystem;
+	std::error_code ec;
+	if(not fs::is_directory(path, ec)) {
+		return addFile(path, "");
+	}
+
+	// A directory of xmcd files, laid out like the freedb dumps, i.e., category/discid.
+	// Anything else in it, e.g. a README, is skipped rather than read as disc IDs.
+	bool readable = true;
+	for(const auto & entry : fs::recursive_directory_iterator(path, ec)) {
+		if(entry.is_regular_file()
+		   and not addFile(entry.path().string(), entry.path().parent_path().filename().string(), true)) {
+			std::cerr << "Unable to read " << entry.path().string() << "." << std::endl;
+			readable = false;
+		}
+	}
+	return readable and not ec;
+}
+
+bool BatchImport::addFile(const std::string & path, const std::string & category, bool xmcdOnly)
+{
+	std::ifstream in(path);
+	if(not in) {
+		return false;
+	}
+	std::stringstream content;
+	content << in.rdbuf();
+	std::string text = content.str();
+
+	if(text.compare(0, 6, "# xmcd") == 0) {
+		_items.push_back({ true, text, category, path });
+		return true;
+	}
+	if(xmcdOnly) {
+#ifdef DEBUG
+		std::cout << "Skipping " << path << ", it isn't an xmcd file." << std::endl;
+#endif
+		return true;
+	}
+
+	// Otherwise, a list of saved disc ID lines
+	std::istringstream lines(text);
+	std::string line;
+	int number = 0;
+	while(std::getline(lines, line)) {
+		++number;
+		if(line.empty() or line[0] == '#') {
+			continue;
+		}
+		_items.push_back({ false, line, "", path + ":" + std::to_string(number) });
+	}
+	return true;
+}
+
+bool BatchImport::run()
+{
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	int numWorkers = std::min<size_t>(_jobs, std::max<size_t>(_items.size(), 1));
+	for(int i=0;i<numWorkers;++i) {
+		workers.emplace_back(&BatchImport::worker, this);
+	}
+	for(auto & worker : workers) {
+		worker.join();
+	}
+	flush();
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	double seconds = std::max(elapsed.count(), 1e-9);
+	std::cout << std::fixed << std::setprecision(2)
+			  << "Imported " << _items.size() << " disc(s) in " << seconds << " s, "
+			  << _items.size() / seconds << " discs/s." << std::endl
+			  << "  inserted:           " << _inserted << std::endl
+			  << "  queued for review:  " << _queued << std::endl
+			  << "  already catalogued: " << _duplicates << std::endl
+			  << "  no match:           " << _noMatch << std::endl
+			  << "  errors:             " << _errors << std::endl;
+	return _errors == 0;
+}
+
+void BatchImport::worker()
+{
+	// Each worker keeps its own connection to the CDDB server
+	auto client = std::make_shared<CddbClient>();
+	for(size_t i = _next++; i < _items.size(); i = _next++) {
+		try {
+			process(client, _items[i]);
+		} catch(const std::exception & e) {
+			std::cerr << _items[i].source << ": " << e.what() << std::endl;
+			++_errors;
+		}
+	}
+}
+
+void BatchImport::process(const std::shared_ptr<CddbClient> & client, const Item & item)
+{
+	Cddb cd(client);
+	if(item.isXmcd) {
+		XmcdEntry entry;
+		if(not XmcdParser::parse(item.text, entry)) {
+			throw CddbError("The xmcd file has no DTITLE.");
+		}
+		cd.loadToc(xmcdToc(entry));
+		cd.setEntry(entry);
+		if(cd.category().empty()) {
+			cd.setCategory(item.category);
+		}
+	} else {
+		cd.loadToc(Toc::parse(item.text));
+	}
+
+	if(not claim(cd.cdDiscId())) {
+		++_duplicates;
+		return;
+	}
+	if(PgConn::queryCdDiscId(cd.cdDiscId()).size() > 0) {
+		++_duplicates;
+		return;
+	}
+
+	if(not item.isXmcd) {
+		cd.cddbQuery();
+		if(cd.noResults()) {
+			++_noMatch;
+			return;
+		} else if(cd.isMultiple() or cd.isInexact()) {
+			queueForReview(cd);
+			return;
+		}
+		cd.fetchTracks(0);
+	}
+	accept(cd);
+}
+
+bool BatchImport::claim(const std::string & discId)
+{
+	std::lock_guard<std::mutex> lock(_pendingMutex);
+	return _claimed.insert(discId).second;
+}
+
+void BatchImport::accept(const Cddb & cd)
+{
+	std::unique_lock<std::mutex> lock(_pendingMutex);
+	_pending.emplace_back(albumData(cd), cd.tracks());
+	if(_pending.size() >= INSERT_BATCH) {
+		lock.unlock();
+		flush();
+	}
+}
+
+void BatchImport::flush()
+{
+	PgConn::CdList batch;
+	{
+		std::lock_guard<std::mutex> lock(_pendingMutex);
+		batch.swap(_pending);
+	}
+	if(batch.empty()) {
+		return;
+	}
+	if(insertCds(batch)) {
+		_inserted += batch.size();
+		return;
+	}
+
+	// The batch is one transaction, so a single bad disc fails all of them
+	if(batch.size() > 1) {
+		std::cerr << "Failed to insert a batch of " << batch.size() << " disc(s), "
+				  << "inserting them one at a time." << std::endl;
+	}
+	for(const auto & cd : batch) {
+		if(batch.size() > 1 and insertCds({ cd })) {
+			++_inserted;
+		} else {
+			std::cerr << "Failed to insert " << std::get<Cd::DiscId>(cd.first) << "." << std::endl;
+			++_errors;
+		}
+	}
+}
+
+void BatchImport::queueForReview(const Cddb & cd)
+{
+	std::lock_guard<std::mutex> lock(_reviewMutex);
+	_review << cd.rawDiscId() << std::endl;
+	for(const auto & match : cd.possibleMatches()) {
+		_review << "#\t" << match << std::endl;
+	}
+	++_queued;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "cddb.h"
+#include "pg_conn.h"
+
+/// Import discs without the user interface, from disc IDs or xmcd files that
+/// were saved elsewhere. This is run with
+///
+/// `% cdimport --batch [--jobs N] [--review FILE] INPUT...`
+///
+/// Each input is either a file of saved `cd-discid` lines, one disc per line,
+/// an xmcd file, or a directory that is searched for xmcd files. Disc IDs are
+/// looked up by up to `N` workers at a time. A single exact match (code 200)
+/// is accepted without asking, while discs with multiple or inexact matches
+/// are written to the review file, along with their candidates, so that they
+/// can be looked at later. Xmcd files already hold the whole entry, so they
+/// are always accepted. Discs that are already in the database, or that come
+/// up more than once in the inputs, are skipped.
+///
+/// Accepted discs are inserted with PgConn::insertCds in batches, and the
+/// throughput is reported at the end. If a batch fails, its discs are
+/// inserted one at a time, so that one bad disc doesn't fail the others.
+class BatchImport
+{
+  public:
+
+	/// The default number of discs looked up at the same time.
+	static const int DEFAULT_JOBS = 4;
+
+	/// The number of accepted discs inserted in one transaction.
+	static const size_t INSERT_BATCH = 50;
+
+	/// The default file that ambiguous discs are written to.
+	static const std::string DEFAULT_REVIEW_FILE;
+
+	/// Parse the command line arguments that follow `--batch`, and run the
+	/// import.
+	/// @param argc The number of arguments.
+	/// @param argv The arguments, not including the program name or `--batch`.
+	/// @return Returns the exit status of the program.
+	static int main(int argc, char * argv[]);
+
+	/// Convert a looked-up disc into a row for the albums table, choosing the
+	/// same defaults as the CdImport dialog does.
+	/// @param cd A disc whose entry has been read.
+	/// @return Returns the album data.
+	static Cd::CdAlbumData albumData(const Cddb & cd);
+
+	/// Construct an import with no inputs.
+	/// @param jobs The number of discs looked up at the same time.
+	/// @param reviewPath The file that ambiguous discs are written to.
+	BatchImport(int jobs, const std::string & reviewPath);
+
+	/// Add the discs from a file or directory to the import.
+	/// @param path The path of a disc ID file, an xmcd file, or a directory.
+	/// Only the xmcd files in a directory are added.
+	/// @return Returns false if the path, or a file in the directory, can't be
+	/// read.
+	bool addInput(const std::string & path);
+
+	/// Look up, and insert, all of the discs.
+	/// @return Returns true if every disc was handled without an error.
+	bool run();
+
+  private:
+
+	/// One disc to import.
+	struct Item
+	{
+		bool isXmcd;			///< True for an xmcd file, false for a disc ID.
+		std::string text;		///< The disc ID line, or the content of the xmcd file.
+		std::string category;	///< For xmcd files, the category from the directory name.
+		std::string source;		///< Where the disc came from, for error messages.
+	};
+
+	/// Add a single file to the import.
+	/// @param path The path of a disc ID file or an xmcd file.
+	/// @param category The category of an xmcd file, from the directory name.
+	/// @param xmcdOnly True to skip a file that isn't an xmcd file, rather than
+	/// read it as disc IDs.
+	/// @return Returns false if the file can't be read.
+	bool addFile(const std::string & path, const std::string & category, bool xmcdOnly = false);
+
+	/// Take discs and import them until there are none left.
+	void worker();
+
+	/// Import one disc.
+	/// @param client The client of the calling worker.
+	/// @param item The disc.
+	void process(const std::shared_ptr<CddbClient> & client, const Item & item);
+
+	/// Take a disc ID for the calling worker, so that a disc that is in the
+	/// inputs more than once is only imported once.
+	/// @param discId The disc ID.
+	/// @return Returns false if the disc ID has already been taken.
+	bool claim(const std::string & discId);
+
+	/// Accept a disc, and insert the pending discs if there are enough of them.
+	/// @param cd A disc whose entry has been read.
+	void accept(const Cddb & cd);
+
+	/// Insert the pending discs. Failures are counted as errors, rather than
+	/// thrown.
+	void flush();
+
+	/// Write a disc with more than one candidate to the review file.
+	/// @param cd A disc that has been queried.
+	void queueForReview(const Cddb & cd);
+
+	const int _jobs;						///< The number of workers.
+	std::vector<Item> _items;				///< The discs to import.
+	std::atomic<size_t> _next { 0 };		///< The next disc to be taken by a worker.
+
+	PgConn::CdList _pending;				///< Accepted discs waiting to be inserted.
+	std::unordered_set<std::string> _claimed;	///< The disc IDs taken by the workers.
+	std::mutex _pendingMutex;				///< Guards the pending discs and disc IDs.
+
+	std::ofstream _review;					///< Where ambiguous discs are written.
+	std::mutex _reviewMutex;				///< Guards the review file.
+
+	std::atomic<int> _inserted { 0 };		///< Discs inserted into the database.
+	std::atomic<int> _queued { 0 };			///< Discs written to the review file.
+	std::atomic<int> _duplicates { 0 };		///< Discs that were already in the database.
+	std::atomic<int> _noMatch { 0 };		///< Discs that the CDDB doesn't know.
+	std::atomic<int> _errors { 0 };			///< Discs that failed.
+};
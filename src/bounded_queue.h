@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/// A first-in, first-out queue between threads, that holds at most a fixed
+/// number of items. A producer that gets ahead of its consumers blocks in
+/// push() until there is room, so a fast stage of a pipeline can't fill up the
+/// memory with work that a slower stage hasn't got to yet.
+///
+/// When the producers are done, they close() the queue. The consumers then
+/// drain what is left, after which pop() returns false.
+template <typename T>
+class BoundedQueue
+{
+  public:
+
+	/// Construct an empty queue.
+	/// @param capacity The most items held at one time.
+	explicit BoundedQueue(size_t capacity)
+	  : _capacity(capacity)
+	{}
+
+	BoundedQueue(const BoundedQueue &) = delete;
+	BoundedQueue & operator=(const BoundedQueue &) = delete;
+
+	/// Add an item, waiting until there is room for it.
+	/// @param item The item.
+	/// @return Returns false if the queue was closed, in which case the item
+	///         is dropped.
+	bool push(T item)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_notFull.wait(lock, [this] { return _closed or _items.size() < _capacity; });
+		if(_closed) {
+			return false;
+		}
+		_items.push_back(std::move(item));
+		_notEmpty.notify_one();
+		return true;
+	}
+
+	/// Take the oldest item, waiting until there is one.
+	/// @param item Set to the item.
+	/// @return Returns false if the queue is closed and empty.
+	bool pop(T & item)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_notEmpty.wait(lock, [this] { return _closed or not _items.empty(); });
+		if(_items.empty()) {
+			return false;
+		}
+		item = std::move(_items.front());
+		_items.pop_front();
+		_notFull.notify_one();
+		return true;
+	}
+
+	/// Close the queue. Items that are already in the queue can still be
+	/// taken, but no more can be added, and waiting threads are woken.
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_closed = true;
+		_notEmpty.notify_all();
+		_notFull.notify_all();
+	}
+
+  private:
+	const size_t _capacity;				///< The most items held at one time.
+	std::deque<T> _items;				///< The items, oldest first.
+	bool _closed { false };				///< True once close() has been called.
+	std::mutex _mutex;					///< Guards the items and the closed flag.
+	std::condition_variable _notEmpty;	///< Signalled when an item is added.
+	std::condition_variable _notFull;	///< Signalled when an item is taken.
+};
@@ -0,0 +1,53 @@
+#include <QHeaderView>
+#include <QMessageBox>
+
+#include "catalogue_browser.h"
+
+#include "macros.h"
+
+CatalogueBrowser::CatalogueBrowser(QWidget * parent)
+  : QDialog(parent)
+{
+	_ui.setupUi(this);
+	_ui.albums->setModel(&_model);
+	_ui.albums->sortByColumn(CatalogueModel::Artist, Qt::AscendingOrder);
+	// Every row is one line high, so the view needn't measure them
+	_ui.albums->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+
+	_filterTimer.setSingleShot(true);
+	_filterTimer.setInterval(FILTER_DELAY);
+	QObject::connect(_ui.filter, &QLineEdit::textChanged,
+					 &_filterTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+	QObject::connect(&_filterTimer, &QTimer::timeout,
+					 this, &CatalogueBrowser::onFilterChanged);
+	QObject::connect(_ui.refresh, &QPushButton::clicked,
+					 this, &CatalogueBrowser::onRefreshClicked);
+}
+
+bool CatalogueBrowser::load()
+{
+	_model.open();
+	return checkError();
+}
+
+void CatalogueBrowser::onRefreshClicked()
+{
+	_model.refresh();
+	checkError();
+}
+
+void CatalogueBrowser::onFilterChanged()
+{
+	_model.setFilter(_ui.filter->text());
+	checkError();
+}
+
+bool CatalogueBrowser::checkError()
+{
+	if(_model.error().empty()) {
+		return true;
+	}
+	QMessageBox::warning(this, "Catalogue", "The albums could not be read:\n\n"
+						 + QStr(_model.error()));
+	return false;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QTimer>
+
+#include "designer/ui_catalogue_browser.h"
+
+#include "catalogue_model.h"
+
+/// A window onto the albums already in the database, which can be sorted by
+/// clicking on a column header, and filtered by artist or title. The albums
+/// are read a page at a time by a CatalogueModel as the table is scrolled.
+class CatalogueBrowser : public QDialog
+{
+	Q_OBJECT
+
+  public:
+
+	/// How long typing has to pause before the filter is applied, in
+	/// milliseconds, so that the cursor isn't declared again for every key.
+	static const int FILTER_DELAY = 300;
+
+	/// Set up the dialog box. Nothing is read until load() is called.
+	/// @param parent The parent widget.
+	explicit CatalogueBrowser(QWidget * parent = nullptr);
+
+	/// Read the first albums. If the database can't be reached, then the user
+	/// is told, and can try again with the *Refresh* button.
+	/// @return Returns false if the albums couldn't be read.
+	bool load();
+
+  public slots:
+
+	/// Qt slot triggered when the *Refresh* button is clicked in the UI. The
+	/// albums are read again, including any saved since they were last read.
+	void onRefreshClicked();
+
+	/// Apply the filter once typing has paused.
+	void onFilterChanged();
+
+  private:
+
+	/// Tell the user if the last read of the albums failed.
+	/// @return Returns false if it failed.
+	bool checkError();
+
+	Ui::CatalogueBrowser _ui;	///< The actual user interface generated via designer.
+	CatalogueModel _model;		///< The albums.
+	QTimer _filterTimer;		///< Delays the filter until typing pauses.
+};
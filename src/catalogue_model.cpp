@@ -0,0 +1,261 @@
+#include <iostream>
+
+#include "catalogue_model.h"
+
+#include "pg_conn.h"
+#include "pg_statements.h"
+#include "utility.h"
+
+/// The column of the query that each column of the model is sorted by.
+static const char * const SORT_COLUMNS[CatalogueModel::NUM_COLUMNS] = {
+	"albums.artist",
+	"albums.title",
+	"albums.year",
+	"categories.category",
+	"albums.genre",
+	"albums.num_tracks",
+	"albums.length"
+};
+
+/// Convert a view of a field to a QString.
+/// @param s The text of the field, which is UTF-8.
+/// @return Returns a copy of the text.
+static QString toQString(std::string_view s)
+{
+	return QString::fromUtf8(s.data(), static_cast<int>(s.size()));
+}
+
+CatalogueModel::CatalogueModel(QObject * parent)
+  : QAbstractTableModel(parent)
+{
+}
+
+CatalogueModel::~CatalogueModel()
+{
+	// The cursor has to go before its transaction, and that before the
+	// connection
+	_cursor.reset();
+	_tx.reset();
+	_conn.reset();
+}
+
+bool CatalogueModel::open()
+{
+	beginResetModel();
+	bool ok = restart();
+	endResetModel();
+	return ok;
+}
+
+void CatalogueModel::refresh()
+{
+	open();
+}
+
+void CatalogueModel::setFilter(const QString & text)
+{
+	std::string filter = text.trimmed().toStdString();
+	if(filter == _filter) {
+		return;
+	}
+	_filter = filter;
+	open();
+}
+
+int CatalogueModel::rowCount(const QModelIndex & parent) const
+{
+	return parent.isValid() ? 0 : _rows;
+}
+
+int CatalogueModel::columnCount(const QModelIndex & parent) const
+{
+	return parent.isValid() ? 0 : NUM_COLUMNS;
+}
+
+QVariant CatalogueModel::data(const QModelIndex & index, int role) const
+{
+	if(not index.isValid()) {
+		return QVariant();
+	}
+	if(role == Qt::TextAlignmentRole) {
+		switch(index.column()) {
+			case Year:
+			case Tracks:
+			case Length:
+				return QVariant(Qt::AlignRight | Qt::AlignVCenter);
+		}
+		return QVariant();
+	}
+	if(role != Qt::DisplayRole) {
+		return QVariant();
+	}
+
+	auto rows = page(index.row() / PAGE_SIZE);
+	size_t i = index.row() % PAGE_SIZE;
+	if(rows == nullptr or i >= rows->size()) {
+		return QVariant();
+	}
+	CatalogueRow album = (*rows)[i];
+	switch(index.column()) {
+		case Artist:
+			return QVariant(toQString(album.artist));
+		case Title:
+			return QVariant(toQString(album.title));
+		case Year:
+			return album.year > 0 ? QVariant(album.year) : QVariant();
+		case Category:
+			return QVariant(toQString(album.category));
+		case Genre:
+			return QVariant(toQString(album.genre));
+		case Tracks:
+			return QVariant(album.numTracks);
+		case Length:
+			return QVariant(QString::fromStdString(Utility::readableLength(album.length)));
+	}
+	return QVariant();
+}
+
+QVariant CatalogueModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if(role != Qt::DisplayRole) {
+		return QVariant();
+	}
+	if(orientation == Qt::Vertical) {
+		return QVariant(section + 1);
+	}
+	switch(section) {
+		case Artist:
+			return QVariant("Artist");
+		case Title:
+			return QVariant("Title");
+		case Year:
+			return QVariant("Year");
+		case Category:
+			return QVariant("Category");
+		case Genre:
+			return QVariant("Genre");
+		case Tracks:
+			return QVariant("Tracks");
+		case Length:
+			return QVariant("Length");
+	}
+	return QVariant();
+}
+
+bool CatalogueModel::canFetchMore(const QModelIndex & parent) const
+{
+	return not parent.isValid() and not _atEnd;
+}
+
+void CatalogueModel::fetchMore(const QModelIndex & parent)
+{
+	if(parent.isValid() or _atEnd) {
+		return;
+	}
+	auto rows = page(_rows / PAGE_SIZE);
+	int n = rows == nullptr ? 0 : static_cast<int>(rows->size());
+	if(n < PAGE_SIZE) {
+		_atEnd = true;
+	}
+	if(n > 0) {
+		beginInsertRows(QModelIndex(), _rows, _rows + n - 1);
+		_rows += n;
+		endInsertRows();
+	}
+}
+
+void CatalogueModel::sort(int column, Qt::SortOrder order)
+{
+	if(column < 0 or column >= NUM_COLUMNS
+	   or (column == _sortColumn and order == _sortOrder)) {
+		return;
+	}
+	_sortColumn = column;
+	_sortOrder = order;
+	open();
+}
+
+std::string CatalogueModel::query() const
+{
+	const char * direction = _sortOrder == Qt::AscendingOrder ? " ASC" : " DESC";
+	std::string sql =
+		"SELECT albums.album_id, albums.artist, albums.title, albums.year, "
+			"categories.category, albums.genre, albums.num_tracks, albums.length "
+		"FROM albums "
+		"INNER JOIN categories "
+		"ON albums.category_id = categories.category_id ";
+	if(not _filter.empty()) {
+		// album_key() leaves only letters, digits and spaces, so the filter
+		// can't bring any wildcards of its own into the patterns
+		std::string key = "'%' || album_key(" + _conn->quote(_filter) + ") || '%'";
+		sql += "WHERE album_key(albums.artist) LIKE " + key
+			+ " OR album_key(albums.title) LIKE " + key + " ";
+	}
+	sql += std::string("ORDER BY ") + SORT_COLUMNS[_sortColumn] + direction
+		+ ", albums.album_id" + direction;
+	return sql;
+}
+
+bool CatalogueModel::restart()
+{
+	_pages.clear();
+	_recent.clear();
+	_rows = 0;
+	_atEnd = true;
+	_error.clear();
+	_cursor.reset();
+	_tx.reset();
+	try {
+		if(not _conn or not _conn->is_open()) {
+			_conn = std::make_unique<pqxx::connection>(PgConn::DB_CONNECTION_STRING);
+		}
+		_tx = std::make_unique<pqxx::read_transaction>(*_conn);
+		std::string sql = query();
+#ifdef DEBUG
+		std::cout << "Declaring the catalogue cursor for: " << sql << std::endl;
+#endif
+		_cursor = std::make_unique<Cursor>(*_tx, sql, "catalogue", false);
+	} catch(const pqxx::failure & e) {
+		_cursor.reset();
+		_tx.reset();
+		fail(e);
+		return false;
+	}
+	_atEnd = false;
+	return true;
+}
+
+const Rows<CatalogueRow> * CatalogueModel::page(int which) const
+{
+	auto found = _pages.find(which);
+	if(found != _pages.end()) {
+		_recent.splice(_recent.begin(), _recent, found->second.recent);
+		return &found->second.rows;
+	}
+	// Once a read has failed, the transaction is no good until restart()
+	if(not _cursor or not _error.empty()) {
+		return nullptr;
+	}
+
+	Rows<CatalogueRow> rows;
+	try {
+		PgStatements::Timer timer(PgStatements::QueryCatalogue);
+		rows = Rows<CatalogueRow>(_cursor->retrieve(which * PAGE_SIZE, (which + 1) * PAGE_SIZE));
+	} catch(const pqxx::failure & e) {
+		fail(e);
+		return nullptr;
+	}
+	if(_pages.size() >= MAX_PAGES) {
+		_pages.erase(_recent.back());
+		_recent.pop_back();
+	}
+	_recent.push_front(which);
+	auto inserted = _pages.emplace(which, Page { rows, _recent.begin() });
+	return &inserted.first->second.rows;
+}
+
+void CatalogueModel::fail(const pqxx::failure & e) const
+{
+	_error = e.what();
+	std::cerr << "Failed to read the catalogue: " << _error << std::endl;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <QAbstractTableModel>
+
+#include <pqxx/pqxx>
+
+#include "pg_rows.h"
+
+/// The underlying model for a table view of the albums already in the
+/// database, see CatalogueBrowser.
+///
+/// The albums are read through a server-side cursor, a page at a time, as the
+/// view scrolls down to them (see canFetchMore() and fetchMore()). Only the
+/// most recently used #MAX_PAGES pages are kept in memory, so memory use does
+/// not grow with the catalogue. Pages that have been dropped are read again
+/// from the cursor, which can be moved to any row, if the view scrolls back
+/// up to them.
+///
+/// Sorting and filtering are done by the server, by declaring a new cursor.
+/// The cursor lives in a read-only transaction on a connection of its own,
+/// rather than one from the pool of PgConn, since it is held open for as long
+/// as the model is, and lookups shouldn't have to wait for it. The model sees
+/// the albums as they were when the cursor was declared, until refresh() is
+/// called.
+class CatalogueModel : public QAbstractTableModel
+{
+	Q_OBJECT
+
+  public:
+
+	/// The columns of the model.
+	enum Column
+	{
+		Artist = 0,
+		Title,
+		Year,
+		Category,
+		Genre,
+		Tracks,
+		Length,
+		NUM_COLUMNS
+	};
+
+	/// The number of albums read from the cursor at a time.
+	static const int PAGE_SIZE = 200;
+
+	/// The most pages kept in memory.
+	static const size_t MAX_PAGES = 16;
+
+	/// Construct an empty model. Nothing is read until open() is called.
+	/// @param parent The parent object.
+	explicit CatalogueModel(QObject * parent = nullptr);
+
+	/// Close the cursor and the connection.
+	~CatalogueModel();
+
+	/// Connect to the database, and declare the cursor.
+	/// @return Returns false if the database couldn't be reached, in which
+	///         case the model is empty, and error() says why.
+	bool open();
+
+	/// Why the last read from the database failed.
+	/// @return Returns the error message, or empty if there was no error.
+	inline const std::string & error() const { return _error; }
+
+	/// Declare the cursor again, so that albums saved since it was declared
+	/// are seen. The view is reset.
+	void refresh();
+
+	/// Only show albums whose artist or title contain some text. Both are
+	/// compared by their normalized keys, as by PgConn::queryArtistTitle, so
+	/// the trigram indexes of `sql/001_fuzzy_search.sql` are used. The view
+	/// is reset.
+	/// @param text The text, or empty to show every album.
+	void setFilter(const QString & text);
+
+	/// The number of albums read so far. Required.
+	/// @param parent The parent object.
+	/// @return Returns zero for any valid parent, since this is a table.
+	virtual int rowCount(const QModelIndex & parent = QModelIndex()) const override;
+
+	/// Returns #NUM_COLUMNS. Required.
+	/// @param parent The parent object.
+	/// @return Returns #NUM_COLUMNS.
+	virtual int columnCount(const QModelIndex & parent = QModelIndex()) const override;
+
+	/// Provide the view access to an album. If its page isn't in memory, then
+	/// it is read from the cursor. Required.
+	/// @param index The index into the model, zero-based.
+	/// @param role The display and alignment roles are handled.
+	/// @return Returns a string, or an alignment for the numeric columns.
+	virtual QVariant data(const QModelIndex & index, int role = Qt::DisplayRole) const override;
+
+	/// Returns the column header names. Not-required.
+	/// @param section The column number.
+	/// @param orientation Either column header (horizontal) or row header (vertical).
+	/// @param role I only handle the displayed role.
+	/// @return Returns the names of the columns, and the row numbers.
+	virtual QVariant headerData(
+		int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+	/// Check if the cursor has more albums to read.
+	/// @param parent The parent object.
+	/// @return Returns true until a page comes back short.
+	virtual bool canFetchMore(const QModelIndex & parent) const override;
+
+	/// Read the next page of albums from the cursor, and add them.
+	/// @param parent The parent object.
+	virtual void fetchMore(const QModelIndex & parent) override;
+
+	/// Sort the albums by a column, by declaring the cursor again. The view is
+	/// reset. Ties are broken by album ID, so that the order of the pages is
+	/// stable.
+	/// @param column The column to sort by.
+	/// @param order The order to sort in.
+	virtual void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+  private:
+
+	/// A cursor that can be moved to any row.
+	typedef pqxx::stateless_cursor<pqxx::cursor_base::read_only, pqxx::cursor_base::owned> Cursor;
+
+	/// A page of albums, and its place in the list of recently used pages.
+	struct Page
+	{
+		Rows<CatalogueRow> rows;			///< The albums.
+		std::list<int>::iterator recent;	///< Its entry in _recent.
+	};
+
+	/// Build the query that the cursor is declared for, from the sort order
+	/// and the filter.
+	/// @return Returns the SQL.
+	std::string query() const;
+
+	/// Start a new transaction and declare the cursor in it. The caller resets
+	/// the model around this.
+	/// @return Returns false if the cursor couldn't be declared.
+	bool restart();
+
+	/// Get a page of albums, reading it from the cursor if it isn't in
+	/// memory. The least recently used page is dropped if there are too many.
+	/// @param which The index of the page.
+	/// @return Returns the page, or nullptr if it couldn't be read.
+	const Rows<CatalogueRow> * page(int which) const;
+
+	/// Report a failed read, and stop reading until the cursor is declared
+	/// again.
+	/// @param e The reason.
+	void fail(const pqxx::failure & e) const;
+
+	std::unique_ptr<pqxx::connection> _conn;		///< The connection of the cursor.
+	std::unique_ptr<pqxx::read_transaction> _tx;	///< The transaction of the cursor.
+	std::unique_ptr<Cursor> _cursor;				///< The albums, sorted and filtered.
+	int _rows { 0 };								///< The number of albums read so far.
+	bool _atEnd { true };							///< Has the last page been read?
+	int _sortColumn { Artist };						///< The column sorted by.
+	Qt::SortOrder _sortOrder { Qt::AscendingOrder };	///< The order sorted in.
+	std::string _filter;							///< The filter text, or empty.
+	mutable std::string _error;						///< Why the last read failed.
+	mutable std::unordered_map<int, Page> _pages;	///< The pages in memory, by index.
+	mutable std::list<int> _recent;					///< The pages in memory, most recent first.
+};
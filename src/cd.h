@@ -3,6 +3,7 @@
 
 #include <string>
 #include <tuple>
+#include <vector>
 
 /// Encapsulate CD data into a struct to separate it from track information.
 /// \TODO Is a namespace a better option?
@@ -14,7 +15,7 @@ struct Cd
 	/// - Type ID: Single, EP, or LP.
 	/// - Category ID: One of the (very) limited CDDB categories.
 	/// - Is Compilation: True or false, duh.
-	/// - Result ID: The raw cddb-tool output.
+	/// - Result ID: The raw `cddb query` result.
 	/// - Disc ID: The computed ID from the cd-discid tool.
 	/// - Title: The album title, which may be hand edited.
 	/// - Artist: The album artist, which may be hand edited.
@@ -28,7 +29,7 @@ struct Cd
 		int,				// type ID
 		int,				// category ID
 		bool,				// is a compilation
-		std::string,		// cddb-tool result ID
+		std::string,		// cddb query result ID
 		std::string,		// cd-discid
 		std::string,		// title
 		std::string,		// artist
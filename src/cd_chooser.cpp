@@ -21,6 +21,7 @@ void CdChooser::setSelected()
 			break;
 		}
 	}
+	showDetails();
 }
 
 void CdChooser::addRadioButtons(const std::vector<std::string> & buttonTexts)
@@ -37,5 +38,23 @@ void CdChooser::addRadioButtons(const std::vector<std::string> & buttonTexts)
 						 this, &CdChooser::setSelected);
 		_ui.choicesBox->setLayout(vbox);
 	}
+	_listings.resize(_radioButtons.size());
+}
+
+void CdChooser::setDetails(int which, const std::string & summary, const std::string & listing)
+{
+	if(which < 0 or which >= _radioButtons.size()) {
+		return;
+	}
+	_radioButtons[which]->setText(_radioButtons[which]->text() + " - " + QStr(summary));
+	_listings[which] = QStr(listing);
+	if(which == _selected) {
+		showDetails();
+	}
+}
+
+void CdChooser::showDetails()
+{
+	_ui.details->setPlainText(_selected < _listings.size() ? _listings[_selected] : QString());
 }
 
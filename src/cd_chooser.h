@@ -37,10 +37,22 @@ class CdChooser : public QDialog
 	/// button options.
 	void addRadioButtons(const std::vector<std::string> & buttonTexts);
 
+	/// Show what is known about one of the options, once its entry has been
+	/// read. The summary is added to the text of the radio button, and the
+	/// listing is shown below the options while it is selected.
+	/// @param which The index of the radio button.
+	/// @param summary A few words, e.g. the year and the number of tracks.
+	/// @param listing The track listing.
+	void setDetails(int which, const std::string & summary, const std::string & listing);
+
   private:
 
+	/// Show the listing of the selected option.
+	void showDetails();
+
 	int _selected { 0 };						///< The selected radio button.
 	Ui::CdChooser _ui;							///< The actual user interface generated via designer.
 	std::vector<QRadioButton*> _radioButtons;	///< Dynamically-created radio buttons.
+	std::vector<QString> _listings;				///< The track listing of each option, if known.
 };
 
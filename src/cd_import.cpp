@@ -1,10 +1,14 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdio>
 #include <cstdlib>
 #include <iostream>
 #include <memory>
 #include <regex>
+#include <sstream>
+
+#include <sys/stat.h>		// POSIX only, for stat()
 
 #include <QMessageBox>
 
@@ -17,14 +21,91 @@
 #include "exceptions.h"
 #include "macros.h"
 #include "pg_conn.h"
+#include "ripper.h"
 #include "utility.h"
 
 const int CdImport::CD_MEDIUM_ID { 1 };
 
-CdImport::CdImport(QWidget * parent)
-  : QDialog(parent), _cdOpen(false)
+CdImport::CdImport(QWidget * parent, const std::string & device)
+  : QDialog(parent), _device(device), _status("Empty"), _lookup(new CddbLookup(device)),
+	_monitor(nullptr), _cdOpen(false)
 {
 	_ui.setupUi(this);
+	Trace::nameThread("gui");
+
+	// Ripping is only offered once there is somewhere to put the files
+	_ui.rip->setVisible(Ripper::enabled());
+	_ui.rip->setChecked(Ripper::enabled());
+
+	// The lookup worker lives on its own thread, and is deleted with it
+	CddbLookup::registerMetaTypes();
+	_lookup->moveToThread(&_lookupThread);
+	QObject::connect(&_lookupThread, &QThread::finished,
+					 _lookup, &QObject::deleteLater);
+	QObject::connect(this, &CdImport::lookupRequested,
+					 _lookup, &CddbLookup::discover);
+	QObject::connect(this, &CdImport::readRequested,
+					 _lookup, &CddbLookup::read);
+	QObject::connect(this, &CdImport::saveRequested,
+					 _lookup, &CddbLookup::save);
+	QObject::connect(_lookup, &CddbLookup::saved,
+					 this, &CdImport::onSaved);
+	QObject::connect(_lookup, &CddbLookup::ripProgress, this, [this](int track, int tracks) {
+		// Once the disc has been read, the save waits for the encoders
+		setStatus(track < tracks ? QString("Ripped %1 of %2 tracks").arg(track).arg(tracks)
+								 : QString("Encoding"));
+	});
+	QObject::connect(_lookup, &CddbLookup::ripFailed,
+					 this, &CdImport::onRipFailed);
+
+	// The results go through deliver(), so that those of a speculative lookup
+	// can be held back
+	QObject::connect(_lookup, &CddbLookup::discovered, this, [this](const Cddb & cd) {
+		deliver([this, cd] { onDiscovered(cd); }, "Querying " + QStr(cd.cdDiscId()));
+	});
+	QObject::connect(_lookup, &CddbLookup::noDisc, this, [this] {
+		deliver([this] { onNoDisc(); }, "Empty", true);
+	});
+	QObject::connect(_lookup, &CddbLookup::candidatesFound, this, [this](const Cddb & cd) {
+		// The worker waits for the user to choose from several candidates
+		bool waits = not cd.noResults() and (cd.isMultiple() or cd.isInexact());
+		QString status = waits ? QString("%1 matches to choose from").arg(cd.possibleMatches().size())
+					   : cd.noResults() ? "No match" : "Reading";
+		deliver([this, cd] { onCandidatesFound(cd); }, status, waits);
+	});
+	QObject::connect(_lookup, &CddbLookup::candidateRead, this, [this](const Cddb & cd, int which) {
+		// Straight to the chooser, which may be open while the held back
+		// results are being shown
+		if(_discarding == 0) {
+			onCandidateRead(cd, which);
+		}
+	});
+	QObject::connect(_lookup, &CddbLookup::tracksRead, this, [this](const Cddb & cd) {
+		deliver([this, cd] { onTracksRead(cd); }, QStr(cd.artist() + " / " + cd.title()));
+	});
+	QObject::connect(_lookup, &CddbLookup::duplicatesFound, this, [this](const AlbumMatches & result) {
+		deliver([this, result] { onDuplicatesFound(result); }, "Already catalogued");
+	});
+	QObject::connect(_lookup, &CddbLookup::finished, this, [this] {
+		deliver([this] { onLookupFinished(); }, QString(), true);
+	});
+	QObject::connect(_lookup, &CddbLookup::failed, this, [this](const QString & message) {
+		deliver([this, message] { onLookupFailed(message); }, "Lookup failed", true);
+	});
+	_lookupThread.start();
+
+	// Likewise the drive monitor
+	_monitor = new DriveMonitor(device);
+	_monitor->moveToThread(&_monitorThread);
+	QObject::connect(&_monitorThread, &QThread::started,
+					 _monitor, &DriveMonitor::start);
+	QObject::connect(&_monitorThread, &QThread::finished,
+					 _monitor, &QObject::deleteLater);
+	QObject::connect(_monitor, &DriveMonitor::discInserted,
+					 this, &CdImport::onDiscInserted);
+	QObject::connect(_monitor, &DriveMonitor::discRemoved,
+					 this, &CdImport::onDiscRemoved);
+	_monitorThread.start();
 
 	// Connect up the signals and slots
 	QObject::connect(_ui.eject, &QPushButton::clicked,
@@ -35,10 +116,28 @@ CdImport::CdImport(QWidget * parent)
 					 this, &CdImport::onEditTracksClicked);
 	QObject::connect(_ui.save, &QPushButton::clicked,
 					 this, &CdImport::onSaveClicked);
+	QObject::connect(_ui.browse, &QPushButton::clicked,
+					 this, &CdImport::onBrowseClicked);
 	QObject::connect(_ui.tracks, &QTableView::doubleClicked,
 					 this, &CdImport::trackDoubleClicked);
 }
 
+CdImport::~CdImport()
+{
+	_monitorThread.quit();
+	_monitorThread.wait();
+	_lookupThread.quit();
+	_lookupThread.wait();
+	endTrace();
+}
+
+void CdImport::reject()
+{
+	if(isWindow()) {
+		QDialog::reject();
+	}
+}
+
 // -----------------------------  Qt Slots  ------------------------------------
 
 void CdImport::onEjectClicked()
@@ -48,144 +147,223 @@ void CdImport::onEjectClicked()
 
 void CdImport::onQueryClicked()
 {
-#ifdef DEBUG
-	using std::cout, std::endl, std::flush;
-#endif
-
 	// Clear the UI from old data, in the case of a re-query
 	clear();
 
+	// Only one lookup at a time
+	_ui.query->setEnabled(false);
+
+	if(_speculating) {
+		// The lookup started when the disc went in, so show what it has found
+		// so far, and let the rest through as it comes. Results that arrive
+		// while a dialog of an earlier one is open wait their turn.
+		if(_trace) {
+			_trace->instant("query_clicked");
+		}
+		_speculating = false;
+		_replaying = true;
+		while(not _stash.empty()) {
+			auto slot = std::move(_stash.front());
+			_stash.pop_front();
+			slot();
+		}
+		_replaying = false;
+		return;
+	}
+
 	// The user could have left the CD tray open or manually closed the
 	// tray, so set the state as closed.
+	beginTrace("query_clicked");
 	setCdTrayState(false);
+	setStatus("Looking up");
+	startLookup();
+}
+
+void CdImport::onDiscInserted()
+{
+	// The tray must have been closed to get the disc in
+	_ui.eject->setText("&Eject");
+	_cdOpen = false;
 
-	try {
-		int which = 0;
-		bool foundResults = false;
-		Cddb cd;
-		if(not cd.discFound()) {
-			QMessageBox::critical(this, "No Disc", "No disc was found in the CDROM drive.");
-			return;
-		} else if(cd.isMultiple() or cd.isInexact()) {
+	// Leave a lookup that the user started, or a choice of candidates, alone
+	if(_lookups > _discarding or not _ui.query->isEnabled() or _speculating) {
+		return;
+	}
 #ifdef DEBUG
-			cout << (cd.isMultiple() ? "Multiple" : "")
-				 << (cd.isMultiple() and cd.isInexact()? " and " : "")
-				 << (cd.isInexact() ? "Inexact" : "")
-				 << " matches for the CD were found. " << flush;
+	std::cout << "Starting a speculative lookup." << std::endl;
 #endif
+	_speculating = true;
+	beginTrace("disc_inserted");
+	setStatus("Disc inserted");
+	startLookup();
+}
+
+void CdImport::onDiscRemoved()
+{
+	dropSpeculation();
+	endTrace();
+	setStatus("Empty");
+}
 
-			CdChooser chooser(this, cd.isInexact());
-			chooser.addRadioButtons(cd.possibleMatches());
-			auto result = chooser.exec();
+void CdImport::onDiscovered(const Cddb & cd)
+{
+	// These data come from the physical CD
+	_ui.discId->setText(QStr(cd.cdDiscId()));
+	_ui.length->setText(QStr(Utility::readableLength(cd.length())));
 
-#ifdef DEBUG
-			cout << "Option #" << chooser.selected() << " was selected." << endl;
-#endif
+	// Store the total runtime in seconds in a member variable since the UI
+	// contains a pretty-printed string
+	_cdLength = cd.length();
+
+	int numTracks = cd.tracks().size();
+	_ui.numberOfTracks->setText(QString::number(numTracks));
+	_ui.tracks->setModel(createTrackDataModel(cd.tracks()));
+	_ui.tracks->resizeColumnsToContents();
 
-			if(result == QDialog::Accepted) {
-				which = chooser.selected();
+	// Choose a reasonable default for LP/EP/Single
+	if(numTracks <= 4) {
+		_ui.type->setCurrentIndex(0);	// single
+	} else if(numTracks <= 7) {
+		_ui.type->setCurrentIndex(1);	// EP
+	} else {
+		_ui.type->setCurrentIndex(2);	// LP
+	}
+}
+
+void CdImport::onNoDisc()
+{
+	{
+		Trace::Span span(_trace, "no_disc_dialog");
+		QMessageBox::critical(this, "No Disc", "No disc was found in the CDROM drive.");
+	}
+	onLookupFinished();
+}
+
+void CdImport::onCandidatesFound(const Cddb & cd)
+{
 #ifdef DEBUG
-				cout << "CdChooer dialog accepted. The user selected option "
-					 << which << "." << endl;
+	using std::cout, std::endl, std::flush;
 #endif
-				foundResults = true;
-
-				if(cd.isInexact()) {
-					// Get the disc id from the inexact match
-					std::regex regex("^[a-z]+ ([a-z0-9]+) .*$");
-					std::smatch match;
-					if(std::regex_search(cd.possibleMatches()[which], match, regex)) {
-						// the matched string should be in location 1, 0 is the whole input string
-						assert(match.size() == 2);
-						cd.setCdDiscId(match[1]);
-					} else {
-						std::cerr << "ERROR: Regex didn't match when setting selected disc ID."
-								  << std::endl;
-						return;
-					}
-				}
-			} else {
-				// User rejected choices.  Cancel out.
-				return;
-			}
-		} else if(cd.noResults()) {
-			QMessageBox::warning(this, "No Match Found",
-								 "No track information found for inserted disc.");
-		} else {
-			foundResults = true;
-		}
-
+	if(cd.isMultiple() or cd.isInexact()) {
 #ifdef DEBUG
-		cout << "Yay! Found a match!" << endl;
+		cout << (cd.isMultiple() ? "Multiple" : "")
+			 << (cd.isMultiple() and cd.isInexact()? " and " : "")
+			 << (cd.isInexact() ? "Inexact" : "")
+			 << " matches for the CD were found. " << flush;
 #endif
 
-		if(foundResults) {
-			cd.fetchTracks(which);
-
-			// Populate the UI with the results of searching for the CD
-			_ui.result->setText(QStr(cd.selectedResult()));
-			_ui.title->setText(QStr(cd.title()));
-			_ui.artist->setText(QStr(cd.artist()));
-			setCategoryByName(cd.category());
-			_ui.genre->setText(QStr(cd.genre()));
-			_ui.extraInfo->setText(QStr(cd.extraInfo()));
-			_ui.year->setText(QString::number(cd.year()));
-
-			// If "Various" appears in the artist field, then this is a compilation
-			std::regex various_regex("various", std::regex_constants::icase);
-			if(std::regex_search(cd.artist(), various_regex)) {
-				_ui.compilation->setChecked(true);
+		// Show how far the TOC of each inexact match is from the disc's
+		std::vector<std::string> texts = cd.possibleMatches();
+		const auto & distances = cd.matchDistances();
+		for(int i=0;i<texts.size() and i<distances.size();++i) {
+			if(distances[i] >= 0) {
+				char label[32];
+				std::snprintf(label, sizeof(label), " (~%.1f s off)", distances[i]);
+				texts[i] += label;
 			}
 		}
 
-		// These data come from the physical CD
-		_ui.discId->setText(QStr(cd.cdDiscId()));
-		_ui.length->setText(QStr(Utility::readableLength(cd.length())));
+		CdChooser chooser(this, cd.isInexact());
+		chooser.addRadioButtons(texts);
 
-		// Store the total runtime in seconds in a member variable since the UI
-		// contains a pretty-printed string
-		_cdLength = cd.length();
+		// Some of the candidates may have been read already, and the rest are
+		// shown as they come in
+		bool current = _candidates.rawDiscId() == cd.rawDiscId()
+					   and _candidates.possibleMatches() == cd.possibleMatches();
+		for(int i=0;i<texts.size();++i) {
+			showCandidate(chooser, current ? _candidates : cd, i);
+		}
+		_chooser = &chooser;
+		int result;
+		{
+			Trace::Span span(_trace, "chooser");
+			span.arg("candidates", std::to_string(texts.size()));
+			result = chooser.exec();
+		}
+		_chooser = nullptr;
 
-		_ui.numberOfTracks->setText(QString::number(cd.numberOfTracks()));
-		_ui.tracks->setModel(createTrackDataModel(cd.tracks()));
-		_ui.tracks->resizeColumnsToContents();
+#ifdef DEBUG
+		cout << "Option #" << chooser.selected() << " was selected." << endl;
+#endif
 
-		// Choose a reasonable default for LP/EP/Single
-		int numTracks = cd.numberOfTracks();
-		if(numTracks <= 4) {
-			_ui.type->setCurrentIndex(0);	// single
-		} else if(numTracks <= 7) {
-			_ui.type->setCurrentIndex(1);	// EP
+		if(result == QDialog::Accepted) {
+#ifdef DEBUG
+			cout << "CdChooer dialog accepted. The user selected option "
+				 << chooser.selected() << "." << endl;
+#endif
+			++_lookups;
+			emit readRequested(chooser.selected());
 		} else {
-			_ui.type->setCurrentIndex(2);	// LP
+			// User rejected choices.  Cancel out.
+			onLookupFinished();
 		}
+	} else if(cd.noResults()) {
+		Trace::Span span(_trace, "no_match_dialog");
+		QMessageBox::warning(this, "No Match Found",
+							 "No track information found for inserted disc.");
+	}
+	// A single exact match is read by the worker without asking
+}
 
-		if(foundResults) {
-			// Enable the Save and Edit Tracks buttons
-			_ui.save->setEnabled(true);
-			_ui.editTracks->setEnabled(true);
-
-			// Look if this CD exists
-			auto result = PgConn::queryCdDiscId(_ui.discId->text().toStdString());
-			if(std::size(result) > 0) {
-				showExistsDialog(result);
-			} else if(cd.isInexact()) {
-				// If this was an inexact match, we should also search by album/artist
-				auto inexactResults = PgConn::queryArtistTitle(cd.artist(), cd.title());
-				if(inexactResults.size() > 0) {
-					showExistsDialog(inexactResults);
-				}
+void CdImport::onCandidateRead(const Cddb & cd, int which)
+{
+	_candidates = cd;
+	if(_chooser != nullptr) {
+		showCandidate(*_chooser, cd, which);
+	}
+}
+
+void CdImport::onTracksRead(const Cddb & cd)
+{
 #ifdef DEBUG
-			} else {
-				cout << "CD Does not exist in DB." << endl;
+	std::cout << "Yay! Found a match!" << std::endl;
 #endif
-			}
-		}
-	} catch(const CddbError & e) {
 
-		std::string message = std::string("Something went wrong querying CDDB: ") + e.what();
-		QMessageBox::critical(this, "Error Querrying Music Database", QStr(message));
+	// Populate the UI with the results of searching for the CD
+	_ui.result->setText(QStr(cd.selectedResult()));
+	_ui.discId->setText(QStr(cd.cdDiscId()));
+	_ui.title->setText(QStr(cd.title()));
+	_ui.artist->setText(QStr(cd.artist()));
+	setCategoryByName(cd.category());
+	_ui.genre->setText(QStr(cd.genre()));
+	_ui.extraInfo->setText(QStr(cd.extraInfo()));
+	_ui.year->setText(QString::number(cd.year()));
+
+	// If "Various" appears in the artist field, then this is a compilation
+	std::regex various_regex("various", std::regex_constants::icase);
+	if(std::regex_search(cd.artist(), various_regex)) {
+		_ui.compilation->setChecked(true);
 	}
+
+	// Replace the track lengths with the full track information
+	_ui.tracks->setModel(nullptr);
+	delete(_trackDataModel);
+	_trackDataModel = nullptr;
+	_ui.tracks->setModel(createTrackDataModel(cd.tracks()));
+	_ui.tracks->resizeColumnsToContents();
+
+	// Enable the Save and Edit Tracks buttons
+	_ui.save->setEnabled(true);
+	_ui.editTracks->setEnabled(true);
+}
+
+void CdImport::onDuplicatesFound(const AlbumMatches & result)
+{
+	showExistsDialog(result);
+}
+
+void CdImport::onLookupFinished()
+{
+	_ui.query->setEnabled(true);
+}
+
+void CdImport::onLookupFailed(const QString & message)
+{
+	{
+		Trace::Span span(_trace, "lookup_failed_dialog");
+		QMessageBox::critical(this, "Error Querrying Music Database", message);
+	}
+	onLookupFinished();
 }
 
 void CdImport::onEditTracksClicked()
@@ -194,15 +372,27 @@ void CdImport::onEditTracksClicked()
 	assert(_trackDataModel != nullptr);
 	auto trackEditor = EditTrack(this, *_trackDataModel);
 
-	// Connect up the signal to update the main UI when values have changed.
-	QObject::connect(&trackEditor, &EditTrack::trackUpdated,
-					 this, &CdImport::updateTrack);
-	trackEditor.exec();
+	// The model tells the view about the tracks that are changed
+	{
+		Trace::Span span(_trace, "edit_tracks");
+		trackEditor.exec();
+	}
 
 	// Update the table size, if necessary
 	_ui.tracks->resizeColumnsToContents();
 }
 
+void CdImport::onBrowseClicked()
+{
+	if(_browser == nullptr) {
+		_browser = new CatalogueBrowser(this);
+		_browser->load();
+	}
+	_browser->show();
+	_browser->raise();
+	_browser->activateWindow();
+}
+
 void CdImport::onSaveClicked()
 {
 	assert(_trackDataModel != nullptr);
@@ -229,19 +419,37 @@ void CdImport::onSaveClicked()
 				  << std::get<Track::ExtraInfo>(tl2) << ")" << std::endl;
 	}
 #endif
-	if(not PgConn::insertCd(cd, _trackDataModel->tracks())) {
+	// Only one insert at a time
+	if(_trace) {
+		_trace->instant("save_clicked");
+	}
+	_ui.save->setEnabled(false);
+	bool rip = _ui.rip->isChecked() and Ripper::enabled();
+	setStatus(rip ? "Ripping" : "Saving");
+	emit saveRequested(cd, _trackDataModel->tracks(), rip);
+}
+
+void CdImport::onSaved(bool ok)
+{
+	if(not ok) {
+		setStatus("Save failed");
+		_ui.save->setEnabled(true);
+		Trace::Span span(_trace, "save_failed_dialog");
 		QMessageBox::critical(this, "Error Inserting Record",
 			"There was an error inserting the CD record into the database.");
 	} else {
 		// Success! Auto-eject the CD for the user
+		setStatus("Saved " + _ui.title->text());
 		onEjectClicked();
 	}
 }
 
-void CdImport::updateTrack(int, const QString &, const QString &)
+void CdImport::onRipFailed(const QString & message)
 {
-	// Update all the values, there aren't too many
-	_ui.tracks->reset();
+	setStatus("Rip failed");
+	_ui.save->setEnabled(true);
+	Trace::Span span(_trace, "rip_failed_dialog");
+	QMessageBox::critical(this, "Error Ripping Disc", message);
 }
 
 void CdImport::trackDoubleClicked(const QModelIndex & index)
@@ -257,10 +465,12 @@ void CdImport::trackDoubleClicked(const QModelIndex & index)
 	bool nameHasFocus = index.column() != 2;	// Any column except extra info
 	auto trackEditor = EditTrack(this, tdm, track, nameHasFocus);
 
-	// Connect up the signal to update the main UI when values have changed.
-	QObject::connect(&trackEditor, &EditTrack::trackUpdated,
-					 this, &CdImport::updateTrack);
-	trackEditor.exec();
+	// The model tells the view about the tracks that are changed
+	{
+		Trace::Span span(_trace, "edit_tracks");
+		span.arg("track", std::to_string(track));
+		trackEditor.exec();
+	}
 
 	// Update the table size, if necessary
 	_ui.tracks->resizeColumnsToContents();
@@ -271,15 +481,28 @@ void CdImport::trackDoubleClicked(const QModelIndex & index)
 void CdImport::setCdTrayState(bool state)
 {
 	using std::system;
+
+	// A file that stands in for the drive has no tray
+	struct stat st;
+	bool fake = ::stat(_device.c_str(), &st) == 0 and S_ISREG(st.st_mode);
 	if(state) {
+		dropSpeculation();
 		clear();
 		_ui.eject->setText("R&eject");
 		// Open the tray, ignore the return value.
-		auto retVal = system("eject");
+		if(not fake) {
+			Trace::Span span(_trace, "eject");
+			auto retVal = system(("eject " + Utility::shellQuote(_device)).c_str());
+		}
+		// The disc is done with once it is out
+		endTrace();
 	} else {
 		_ui.eject->setText("&Eject");
 		// Close the tray, ignore the return value.
-		auto retVal = system("eject -t");
+		if(not fake) {
+			Trace::Span span(_trace, "tray_close");
+			auto retVal = system(("eject -t " + Utility::shellQuote(_device)).c_str());
+		}
 	}
 	_cdOpen = state;
 }
@@ -313,6 +536,98 @@ void CdImport::clear()
 	}
 }
 
+void CdImport::showCandidate(CdChooser & chooser, const Cddb & cd, int which)
+{
+	XmcdEntry entry;
+	if(not cd.matchEntry(which, entry)) {
+		return;
+	}
+	std::ostringstream summary;
+	if(entry.year > 0) {
+		summary << entry.year << ", ";
+	}
+	summary << entry.trackTitles.size() << " tracks";
+
+	// The lengths of the tracks come from the offsets in the entry
+	std::ostringstream listing;
+	listing << entry.artist << " / " << entry.title << "\n";
+	for(int i=0;i<entry.trackTitles.size();++i) {
+		listing << (i + 1) << ". " << entry.trackTitles[i];
+		if(i < entry.offsets.size()) {
+			int end = i + 1 < entry.offsets.size() ? entry.offsets[i + 1] : entry.discLength * Cddb::CD_FRAME;
+			listing << " (" << Utility::readableLength((end - entry.offsets[i]) / Cddb::CD_FRAME) << ")";
+		}
+		listing << "\n";
+	}
+	chooser.setDetails(which, summary.str(), listing.str());
+}
+
+void CdImport::startLookup()
+{
+	++_lookups;
+	emit lookupRequested(_trace);
+}
+
+void CdImport::deliver(const std::function<void()> & slot, const QString & status, bool ends)
+{
+	if(ends) {
+		--_lookups;
+	}
+	if(_discarding > 0) {
+		if(ends) {
+			--_discarding;
+		}
+		return;
+	}
+	// The status shows how far a speculative lookup has got, too
+	if(not status.isEmpty()) {
+		setStatus(status);
+	}
+	if(_speculating or _replaying) {
+		_stash.push_back(slot);
+	} else {
+		slot();
+	}
+}
+
+void CdImport::setStatus(const QString & status)
+{
+	_status = status;
+	emit statusChanged(status);
+}
+
+void CdImport::dropSpeculation()
+{
+	if(not _speculating) {
+		return;
+	}
+#ifdef DEBUG
+	std::cout << "Dropping the speculative lookup." << std::endl;
+#endif
+	_speculating = false;
+	_stash.clear();
+	// Everything on the worker is the speculative lookup, since it is only
+	// started when the worker is idle
+	_discarding = _lookups;
+}
+
+void CdImport::beginTrace(const char * event)
+{
+	endTrace();
+	_trace = Trace::start(_device);
+	if(_trace) {
+		_trace->instant(event);
+	}
+}
+
+void CdImport::endTrace()
+{
+	if(_trace) {
+		_trace->finish();
+		_trace = nullptr;
+	}
+}
+
 TrackDataModel * CdImport::createTrackDataModel(const Track::TrackList & tracks)
 {
 #ifdef DEBUG
@@ -338,20 +653,26 @@ void CdImport::setCategoryByName(const std::string & category)
 	_ui.category->setCurrentIndex(index);
 }
 
-void CdImport::showExistsDialog(const pqxx::result & result)
+void CdImport::showExistsDialog(const AlbumMatches & result)
 {
-	std::stringstream existing;
-	existing << "It looks like this CD already exists in the database.\n\n";
+	std::string existing = "It looks like this CD already exists in the database.\n\n";
+	// Near misses from the fuzzy search show how alike they are
+	auto describe = [&existing](const AlbumMatch & album) {
+		existing.append(album.category).append(": ")
+				.append(album.artist).append(" / ").append(album.title);
+		if(album.score < 1.0) {
+			existing += " (" + std::to_string(static_cast<int>(album.score * 100)) + "% alike)";
+		}
+	};
 	if(result.size() == 1) {
-		pqxx::row row = result[0];
-		existing << row["category"] << ": " << row["artist"] << " / " << row["title"];
+		describe(result[0]);
 	} else if(result.size() > 1) {
 		for(int i=0; i<result.size(); ++i) {
-			auto row = result[i];
-			existing << (i+1) << "." << row["category"] << ": "
-					 << row["artist"] << " / " << row["title"] << std::endl;
+			existing += std::to_string(i+1) + ".";
+			describe(result[i]);
+			existing += "\n";
 		}
 	}
-	QMessageBox::information(this, "CD Exists", QStr(existing.str()));
+	QMessageBox::information(this, "CD Exists", QStr(existing));
 }
 
@@ -1,12 +1,35 @@
 #pragma once
 
-#include <pqxx/pqxx>
+#include <deque>
+#include <functional>
+#include <string>
+
+#include <QThread>
 
 #include "designer/ui_cd_import.h"
 
+#include "catalogue_browser.h"
+#include "cd_chooser.h"
+#include "cddb_lookup.h"
+#include "drive_monitor.h"
+#include "pg_rows.h"
+#include "trace.h"
 #include "track_data_model.h"
 
 /// The principle dialog box of the application.
+///
+/// A DriveMonitor watches the drive, and as soon as a disc goes in, a
+/// speculative lookup is started in the background. The results of its stages
+/// are held back, without touching the user interface, until *Query* is
+/// clicked, when they are shown all at once, and the lookup carries on from
+/// wherever it has got to. If the disc comes out first, then the speculative
+/// lookup is thrown away.
+///
+/// Each instance drives one CD drive, with its own lookup worker, so several
+/// of them can run side by side, see MultiDriveImport.
+///
+/// If tracing is turned on, each disc gets a Trace, from the tray closing or
+/// the disc going in to the eject, which the lookup worker records into too.
 class CdImport : public QDialog
 {
 	Q_OBJECT
@@ -18,7 +41,43 @@ class CdImport : public QDialog
 	/// Explicitly construct the dialog box with an optional parent.
 	/// @param parent Specify an optional parent object. The default value is
 	/// nullptr.
-	explicit CdImport(QWidget * parent = nullptr);
+	/// @param device The device name of the drive, or a file that stands in
+	///        for it.
+	explicit CdImport(QWidget * parent = nullptr, const std::string & device = Cddb::CD_DEVICE);
+
+	/// Stop the lookup and drive monitor threads, waiting for a lookup in
+	/// progress to finish.
+	~CdImport();
+
+	/// The device name of the drive.
+	inline const std::string & device() const { return _device; }
+
+	/// A short description of what the drive is doing, for a status panel.
+	inline const QString & status() const { return _status; }
+
+	/// Close the dialog, e.g. when Escape is pressed, unless it is embedded
+	/// in another window, such as a tab of MultiDriveImport.
+	void reject() override;
+
+  signals:
+
+	/// Ask the CddbLookup worker to start looking up the disc in the drive.
+	/// @param trace The trace of the disc, or nullptr.
+	void lookupRequested(const Trace::Ptr & trace);
+
+	/// Ask the CddbLookup worker to read the candidate chosen by the user.
+	/// @param which The index of the chosen candidate.
+	void readRequested(int which);
+
+	/// Ask the CddbLookup worker to insert an album into the database.
+	/// @param album The album.
+	/// @param tracks The tracks of the album.
+	/// @param rip True to rip the disc on the way.
+	void saveRequested(const Cd::CdAlbumData & album, const Track::TrackList & tracks, bool rip);
+
+	/// What the drive is doing has changed.
+	/// @param status The new status().
+	void statusChanged(const QString & status);
 
   public slots:
 
@@ -28,23 +87,75 @@ class CdImport : public QDialog
 	/// the same.
 	void onEjectClicked();
 
-	/// Qt slot triggered when the *Query* button is clicked in the UI. The CD
-	/// tray is closed (if open), the CDDB Disc ID is looked up, and a list of
-	/// matching CDs is presented to the user. The used chooses the matching CD
-	/// and the rest of the UI is populated with the results.
+	/// Qt slot triggered when the *Query* button is clicked in the UI. If a
+	/// speculative lookup was started when the disc went in, then its results
+	/// so far are shown. Otherwise, the CD tray is closed (if open), and a
+	/// lookup is started on the worker thread. The UI is populated by the
+	/// slots below as the stages of the lookup complete.
 	void onQueryClicked();
 
+	/// Start a speculative lookup of a disc that has just gone in, unless a
+	/// lookup is already under way.
+	void onDiscInserted();
+
+	/// Throw away any speculative lookup, since its disc has come out.
+	void onDiscRemoved();
+
+	/// Populate the values that come from the physical CD.
+	/// @param cd The lookup after the discover stage.
+	void onDiscovered(const Cddb & cd);
+
+	/// Tell the user that there is no disc in the drive.
+	void onNoDisc();
+
+	/// Present the list of matching CDs to the user, if there is a choice to
+	/// be made. The user chooses the matching CD, and the lookup continues.
+	/// @param cd The lookup after the query stage.
+	void onCandidatesFound(const Cddb & cd);
+
+	/// Show the year and tracks of a candidate in the chooser, if it is open.
+	/// @param cd The lookup, with the entries of the candidates read so far.
+	/// @param which The index of the candidate that has just been read.
+	void onCandidateRead(const Cddb & cd, int which);
+
+	/// Populate the rest of the UI with the album and track information.
+	/// @param cd The lookup after the read stage.
+	void onTracksRead(const Cddb & cd);
+
+	/// Show the user that the CD was already catalogued.
+	/// @param result The matching rows from the database.
+	void onDuplicatesFound(const AlbumMatches & result);
+
+	/// Re-enable querying once a lookup is over.
+	void onLookupFinished();
+
+	/// Show the user why a lookup failed.
+	/// @param message The error message.
+	void onLookupFailed(const QString & message);
+
 	/// Qt slot triggered when the edit tracks button is clicked in the UI. The
 	/// user is given the option to edit the tracks, one-by-one, rather than
 	/// directly in the table.
 	void onEditTracksClicked();
 
-	/// Qt slot triggered when the save button is clicked in the UI.
+	/// Qt slot triggered when the browse button is clicked in the UI. The
+	/// catalogue browser is opened, or raised if it is already open.
+	void onBrowseClicked();
+
+	/// Qt slot triggered when the save button is clicked in the UI. The album
+	/// is inserted by the lookup worker, which first rips the disc if *Rip* is
+	/// checked.
 	void onSaveClicked();
 
-	/// Slot to update this dialog once a change has been made to the
-	/// TrackDataModel via the EditTrack dialog box.
-	void updateTrack(int, const QString &, const QString &);
+	/// Eject the disc once its album has been inserted, or tell the user
+	/// that it wasn't.
+	/// @param ok False if the insert failed.
+	void onSaved(bool ok);
+
+	/// Tell the user why the disc couldn't be ripped, and let them save it
+	/// again, with or without ripping.
+	/// @param message The error message.
+	void onRipFailed(const QString & message);
 
 	/// Handle double-clicking on t the table view.
 	/// @index The row and column of the element that was double-clicked.
@@ -68,7 +179,41 @@ class CdImport : public QDialog
 	/// Show a message to the user, indicating that the CD already exists in the
 	/// database.
 	/// @param result The results of the `cd-discid` command.
-	void showExistsDialog(const pqxx::result & result);
+	void showExistsDialog(const AlbumMatches & result);
+
+	/// Show the year and tracks of a candidate in a chooser.
+	/// @param chooser The chooser.
+	/// @param cd The lookup, with the entries of the candidates read so far.
+	/// @param which The index of the candidate, which is skipped if its entry
+	///        hasn't been read.
+	void showCandidate(CdChooser & chooser, const Cddb & cd, int which);
+
+	/// Queue a new lookup on the worker thread.
+	void startLookup();
+
+	/// Pass on a result of the lookup worker to its slot, or hold it back if
+	/// the lookup is speculative, or discard it if the lookup was thrown away.
+	/// @param slot Calls the slot with the result.
+	/// @param status The status of the drive after this result, or empty to
+	///        leave it as it is.
+	/// @param ends True if the lookup is over, or waiting for the user, after
+	///        this result.
+	void deliver(const std::function<void()> & slot, const QString & status = QString(),
+				 bool ends = false);
+
+	/// Set status(), and tell any status panel.
+	/// @param status What the drive is doing.
+	void setStatus(const QString & status);
+
+	/// Throw away the speculative lookup, if there is one.
+	void dropSpeculation();
+
+	/// Begin a trace of the disc in the drive, finishing any earlier one.
+	/// @param event The moment that the trace starts with, e.g. "disc_inserted".
+	void beginTrace(const char * event);
+
+	/// Write the trace of the disc, if there is one, and let it go.
+	void endTrace();
 
 	/// Initialize a data model for the tracks view.
 	/// @param tracks Provide the data to populate the model.
@@ -78,6 +223,21 @@ class CdImport : public QDialog
   private:
 
 	Ui::CdImport _ui;	///< The actual user interface instance.
+	std::string _device;	///< The drive.
+	QString _status;		///< What the drive is doing.
+	QThread _lookupThread;	///< The worker thread for CDDB lookups.
+	CddbLookup * _lookup;	///< The worker, owned by the lookup thread.
+	QThread _monitorThread;	///< The thread that polls the drive.
+	DriveMonitor * _monitor;	///< Watches the drive, owned by the monitor thread.
+	int _lookups { 0 };		///< The number of lookups queued or running on the worker.
+	int _discarding { 0 };	///< The number of those whose results are thrown away.
+	bool _speculating { false };	///< Are the results of the lookup being held back?
+	bool _replaying { false };		///< Are the held back results being shown?
+	std::deque<std::function<void()>> _stash;	///< The held back results.
+	Cddb _candidates;			///< The lookup with the most candidate entries read so far.
+	CdChooser * _chooser { nullptr };	///< The chooser while it is open.
+	CatalogueBrowser * _browser { nullptr };	///< The catalogue browser, once opened.
+	Trace::Ptr _trace;			///< The trace of the disc, or nullptr.
 	bool _cdOpen;		///< Is the CDROM tray open? The default value is false.
 	int _cdLength;		///< Keep the total runtime of the CD in seconds in a variable.
 
@@ -1,16 +1,21 @@
 
-#include <array>
-#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <climits>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
-#include <regex>
 #include <sstream>
-#include <unistd.h>		// Linux only, needed for gethostname()
+#include <thread>
 
 #include "cddb.h"
 
+#include "bounded_queue.h"
+#include "metrics.h"
+#include "trace.h"
+#include "toc_matcher.h"
+
 const std::string Cddb::VALID_CATEGORIES[] = {
 	"blues",
 	"classical",
@@ -29,35 +34,23 @@ const std::string Cddb::SERVER = std::string {"https://gnudb.gnudb.org/~cddb/cdd
 
 const std::string Cddb::CD_DEVICE = std::string {"/dev/cdrom"};
 
-Cddb::Cddb()
+Cddb::Cddb(std::shared_ptr<CddbClient> client)
+  : _client(client)
 {
+}
+
+void Cddb::readDisc(const std::string & device)
+{
+	Metrics::Timer timer(Metrics::ReadDisc);
+	Trace::Span span("read_disc");
+	span.arg("device", device);
 	try {
-		// Execute the cd-discid command to figure out the "ID" of this disc
-		static const std::string cmd("cd-discid " + CD_DEVICE + " 2>&1");
-		const std::string & result = execCommand(cmd);
-		processDiscId(result);
+		// Read the TOC to figure out the "ID" of this disc
+		processToc(TocSource::open(device)->read());
 		_discFound = true;
-
-		// Get the list of possible matches using the cddb-tool query command
-		cddbToolQuery();
-
 	} catch(const NoCdFound & e) {
 		_discFound = false;
-	} catch(CddbError & e) {
-		std::cerr <<  "Error: " << e.what() << std::endl;
-		_discFound = false;
-	}
-}
-
-Cddb::~Cddb()
-{
-	if(_user != nullptr) {
-		free(_user);
-		_user = nullptr;
-	}
-	if(_host != nullptr) {
-		free(_host);
-		_host = nullptr;
+		timer.setOutcome(Metrics::NoResult);
 	}
 }
 
@@ -72,105 +65,62 @@ void Cddb::fetchTracks(int which)
 	using std::cout, std::endl;
 	cout << "Pulling data for selected item " << which << "." << endl;
 #endif
-	auto user = getUser();
-	auto host = getHost();
-
-	std::stringstream commandSs;
-	commandSs << "cddb-tool read "
-			  << SERVER << " "
-			  << PROTO_LEVEL << " "
-			  << user << " "
-			  << host << " "
-			  << _results[which];
-
-	std::string escapedCommand = commandSs.str();
-	if((escapedCommand.find("'") != std::string::npos) or
-		(escapedCommand.find("(") != std::string::npos) or
-		(escapedCommand.find(")") != std::string::npos))
-	{
-#ifdef DEBUG
-		cout << "Need to escape the raw cddb-tool command: '" << escapedCommand
-			 << "', or the query will fail." << endl;
-#endif
-		std::regex escapeRegex("['()]");
-		escapedCommand = std::regex_replace(commandSs.str(), escapeRegex, "\\$&");
+	// The selected result starts with the category and the disc ID of the entry
+	std::istringstream iss(_results[which]);
+	std::string category;
+	std::string discId;
+	if(not (iss >> category >> discId)) {
+		throw CddbError("Malformed CDDB result: " + _results[which]);
 	}
 #ifdef DEBUG
 	cout << "Pulling data for: " << _results[which] << endl;
-	cout << "Executing command:" << endl << escapedCommand << endl;
 #endif
 
-	_rawData = execCommand(escapedCommand);
-	_data = separateRawCddbData(_rawData);
-#ifdef DEBUG
-	cout << "Got " << _data.size() << " lines of data out of the command." << endl;
-	cout << _rawData << endl;
-#endif
+	// The entry may have been read while the user was choosing
+	if(which < _entries.size() and not _entries[which].empty()) {
+		parseEntry(_entries[which]);
+	} else {
+		Metrics::Timer timer(Metrics::CddbRead);
+		Trace::Span span("cddb_read");
+		span.arg("entry", category + " " + discId);
+		parseEntry(client().read(category, discId));
+	}
+}
 
-	// swallow the whole response into a map
-	std::map<std::string, std::string> response;
-	std::regex kvp_regex("^([A-Z0-9]+)=(.*)");
-	std::regex cat_regex("^[0-9]+ ([a-z]+) .*");
-	for(auto line : _data) {
-
-		// Pull out the key=value pairs from each relevant line
-		std::smatch match;
-		if(std::regex_search(line, match, kvp_regex)) {
-			assert(match.size() == 3);
-			std::string key = match[1];
-			std::string value = match[2];
-			response[key] = value;
+void Cddb::parseEntry(const std::string & raw)
+{
+	_rawData = raw;
 #ifdef DEBUG
-			cout << "Adding \"" << key << "/" << value << "\" to repsonse map." << endl;
+	std::cout << _rawData << std::endl;
 #endif
-		} else if(std::regex_search(line, match, cat_regex)) {
-			assert(match.size() == 2);
-			std::string value = match[1];
-			response["CATEGORY"] = value;
+	XmcdEntry entry;
+	if(not XmcdParser::parse(_rawData, entry)) {
+		throw CddbError("The CDDB entry has no DTITLE.");
+	}
+	setEntry(entry);
+}
+
+void Cddb::setEntry(const XmcdEntry & entry)
+{
 #ifdef DEBUG
-			cout << "Adding \"CATEGORY/" << value << "\" to repsonse map." << endl;
-		} else {
-			cout << "Ignoring line: " << line << endl;
+	using std::cout, std::endl;
 #endif
-		}
-	}
-	_category = response["CATEGORY"];
-	_genre = response["DGENRE"];
-	if(not response["DYEAR"].empty()) {
-		_year = std::stoi(response["DYEAR"]);
-	} else {
-		_year = 0;
-	}
-	_extraInfo = response["EXTD"];
-
-	std::regex artist_regex("^([^/]+) / (.*)");
-	std::smatch match;
-	if(std::regex_search(response["DTITLE"], match, artist_regex)) {
-		assert(match.size() == 3);
-		_artist = match[1];
-		_title = match[2];
-	} else {
-		// A self-titled album may not have a title part
-		_artist = _title = response["DTITLE"];
-	}
+	_category = entry.category;
+	_genre = entry.genre;
+	_year = entry.year;
+	_extraInfo = entry.extraInfo;
+	_artist = entry.artist;
+	_title = entry.title;
 #ifdef DEBUG
 	cout << "Set artist to '" << _artist << "' and title to '" << _title << "'." << endl;
 #endif
 
 	for(int i=0;i<_tracks.size(); ++i) {
-		std::stringstream hashKey;
-		hashKey << "TTITLE" << i;
+		std::get<Track::Title>(_tracks[i]) = i < entry.trackTitles.size() ? entry.trackTitles[i] : "";
+		std::get<Track::ExtraInfo>(_tracks[i]) = i < entry.trackExtras.size() ? entry.trackExtras[i] : "";
 #ifdef DEBUG
-		cout << "Setting track " << i << "'s title to '" << response[hashKey.str()]
-			 << "' " << std::flush;
-#endif
-		std::get<Track::Title>(_tracks[i]) = response[hashKey.str()];
-		hashKey.clear();
-		hashKey.str("");			// reset hashKey string stream
-		hashKey << "EXTT" << i;
-		std::get<Track::ExtraInfo>(_tracks[i]) = response[hashKey.str()];
-#ifdef DEBUG
-		cout << "and extra info to '" << response[hashKey.str()] << "'." << endl;
+		cout << "Set track " << i << "'s title to '" << std::get<Track::Title>(_tracks[i])
+			 << "' and extra info to '" << std::get<Track::ExtraInfo>(_tracks[i]) << "'." << endl;
 #endif
 	}
 #ifdef DEBUG
@@ -178,38 +128,30 @@ void Cddb::fetchTracks(int which)
 #endif
 }
 
-void Cddb::cddbToolQuery()
+void Cddb::cddbQuery()
 {
 #ifdef DEBUG
 	using std::cout, std::endl;
 #endif
-	// Build up the command to execute
-	std::stringstream commandStream;
-	commandStream
-		<< "cddb-tool query "
-		<< SERVER << " "
-		<< PROTO_LEVEL << " "
-		<< getUser() << " "
-		<< getHost() << " "
-		<< _rawDiscId;
-
-#ifdef DEBUG
-	cout << commandStream.str() << endl;
-#endif
-
-	auto rawResults = execCommand(commandStream.str());
+	Metrics::Timer timer(Metrics::CddbQuery);
+	Trace::Span span("cddb_query");
+	span.arg("disc_id", _cdDiscId);
+	auto rawResults = client().query(_rawDiscId);
 #ifdef DEBUG
 	cout << "Raw CD Results:" << endl << rawResults << endl;
 #endif
 	auto lines = separateRawCddbData(rawResults);
+	if(lines.empty()) {
+		throw CddbError("Empty response from the CDDB server.");
+	}
 	auto resultCode = getCddbCode(lines[0]);
 
 	if(resultCode == 200) {
+		// The match is on the status line, after the code
 #ifdef DEBUG
-		cout << "One exact match: " << lines[1] << endl;
+		cout << "One exact match: " << lines[0] << endl;
 #endif
-		//_results << fetch_results[0].scan(/^200 (.*)/).first.last
-		_results.push_back(lines[1]);
+		_results.push_back(lines[0].substr(lines[0].find(' ') + 1));
 	} else if(resultCode == 211) {
 		// This code means that inexact matches were found.
 		_results = std::vector<std::string>(lines.begin() +1, lines.end());
@@ -221,7 +163,7 @@ void Cddb::cddbToolQuery()
 		// Multiple results, drop the result code and the terminating "." line.
 		_results = std::vector<std::string>(lines.begin() +1, lines.end());
 	} else {
-		std::string err = std::string("Unhandled return code from FreeDB Query: ");// + resultCode;
+		std::string err = "Unhandled return code from FreeDB Query: " + std::to_string(resultCode);
 		throw CddbError(err);
 	}
 #ifdef DEBUG
@@ -229,21 +171,125 @@ void Cddb::cddbToolQuery()
 		 << (_results.size() == 1 ? " match was" : " matches were")
 		 << " added to the results list." << endl;
 #endif
+	if(_results.empty()) {
+		timer.setOutcome(Metrics::NoResult);
+	}
 }
 
-const std::string Cddb::execCommand(const std::string & command)
+void Cddb::rankMatches()
 {
-	std::array<char, 128> buffer;
-	std::stringstream result;
+	if(not _inexact or _results.empty()) {
+		return;
+	}
+	TRACE_SPAN("rank_matches");
+
+	// The TOCs of the entries are only as precise as the disc length in
+	// seconds, so the disc's lead-out is rounded the same way
+	Toc disc = _toc;
+	disc.leadOut = disc.length() * CD_FRAME;
+
+	prefetchMatches();
+	TocMatcher matcher;
+	for(size_t i=0;i<_results.size();++i) {
+		XmcdEntry entry;
+		if(matchEntry(i, entry)) {
+			Toc toc;
+			toc.offsets = entry.offsets;
+			toc.leadOut = entry.discLength * CD_FRAME;
+			matcher.add(toc, i);
+		}
+	}
+
+	std::vector<std::string> ranked;
+	std::vector<std::string> entries;
+	std::vector<double> distances;
+	std::vector<bool> used(_results.size(), false);
+	for(const auto & match : matcher.rank(disc, _results.size(), INT_MAX)) {
+		ranked.push_back(_results[match.tag]);
+		entries.push_back(_entries[match.tag]);
+		distances.push_back(match.distance / CD_FRAME);
+		used[match.tag] = true;
+	}
+	for(size_t i=0;i<_results.size();++i) {
+		if(not used[i]) {
+			ranked.push_back(_results[i]);
+			entries.push_back(_entries[i]);
+			distances.push_back(-1);
+		}
+	}
+	_results = ranked;
+	_entries = entries;
+	_distances = distances;
+}
 
-	std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(command.c_str(), "r"), pclose);
-	if(not pipe) {
-		throw CddbError("Error executing shell command.");
+void Cddb::prefetchMatches(const std::function<void(int)> & onRead)
+{
+	_entries.resize(_results.size());
+	std::vector<int> pending;
+	for(int i=0;i<_results.size();++i) {
+		if(_entries[i].empty()) {
+			pending.push_back(i);
+		}
+	}
+	if(pending.empty()) {
+		return;
+	}
+
+	// Each thread reads over its own connection, and hands the entries back
+	// to this one as they arrive
+	std::atomic<size_t> next { 0 };
+	BoundedQueue<std::pair<int, std::string>> done(pending.size());
+	std::vector<std::thread> threads;
+	Trace::Ptr trace = Trace::current();
+	for(size_t j=0;j<std::min(pending.size(), PREFETCH_JOBS);++j) {
+		threads.emplace_back([this, &next, &pending, &done, trace, j] {
+			Trace::Attach attach(trace);
+			Trace::nameThread("prefetch " + std::to_string(j));
+			std::unique_ptr<CddbClient> client;
+			for(size_t k; (k = next++) < pending.size();) {
+				int which = pending[k];
+				std::istringstream iss(_results[which]);
+				std::string category;
+				std::string discId;
+				std::string raw;
+				try {
+					if(iss >> category >> discId) {
+						if(not client) {
+							client = std::make_unique<CddbClient>();
+						}
+						Metrics::Timer timer(Metrics::CddbRead);
+						Trace::Span span("cddb_read");
+						span.arg("entry", category + " " + discId);
+						raw = client->read(category, discId);
+					}
+				} catch(const CddbError & e) {
+#ifdef DEBUG
+					std::cout << "Unable to read " << _results[which] << ": " << e.what() << std::endl;
+#endif
+				}
+				done.push({ which, raw });
+			}
+		});
+	}
+	for(size_t k=0;k<pending.size();++k) {
+		std::pair<int, std::string> item;
+		done.pop(item);
+		_entries[item.first] = std::move(item.second);
+		if(onRead and not _entries[item.first].empty()) {
+			onRead(item.first);
+		}
+	}
+	for(auto & thread : threads) {
+		thread.join();
 	}
-	while (std::fgets(buffer.data(), static_cast<int>(buffer.size()), pipe.get()) != nullptr) {
-		result << buffer.data();
+}
+
+bool Cddb::matchEntry(int which, XmcdEntry & entry) const
+{
+	if(which < 0 or which >= _entries.size() or _entries[which].empty()) {
+		return false;
 	}
-	return result.str();
+	return XmcdParser::parse(_entries[which], entry);
 }
 
 const std::vector<std::string> Cddb::separateRawCddbData(const std::string & raw)
@@ -252,6 +298,9 @@ const std::vector<std::string> Cddb::separateRawCddbData(const std::string & raw
 	std::stringstream ss(raw);
 	std::string line;
 	while(getline(ss, line)) {
+		if(not line.empty() and line.back() == '\r') {
+			line.pop_back();
+		}
 		if(line == ".") {
 			// We are done here. The raw output of CDDB contains only a '.' on the last line
 			break;
@@ -269,35 +318,29 @@ int Cddb::getCddbCode(const std::string & line)
 	return code;
 }
 
-void Cddb::processDiscId(const std::string & discId)
+void Cddb::loadToc(const Toc & toc)
 {
-	// First, verify that a disc was found in the drive
-	if (discId.find("No medium found") != std::string::npos) {
-		throw NoCdFound();
-	} else {
-		_rawDiscId = discId;
-	}
+	processToc(toc);
+	_discFound = true;
+}
+
+void Cddb::processToc(const Toc & toc)
+{
+	_toc = toc;
+	_rawDiscId = toc.toString();
+	_cdDiscId = toc.discIdString();
+	_length = toc.length();
 
 #ifdef DEBUG
-	std::cout << "cd-discid result: " << discId << std::endl;
+	std::cout << "Disc ID: " << _rawDiscId << std::endl;
 #endif
 
-	// Process the disc ID as a stream
-	std::istringstream iss(discId);
-	iss >> _cdDiscId;
-	int numTracks;
-	iss >> numTracks;
-
-	// Read the values for the track data
-	std::vector<int> offsets(numTracks);
-	for(int i=0;i<numTracks;++i) {
-		iss >> offsets[i];
-	}
-	iss >> _length;
-	// Add the total length to the end for computing differences
-	offsets.push_back(_length * CD_FRAME);
+	// Add the lead-out to the end for computing differences
+	std::vector<int> offsets(toc.offsets);
+	offsets.push_back(toc.leadOut);
 
 	// Convert the values to seconds and store them in the correct data structure
+	int numTracks = toc.offsets.size();
 	for(int i=0;i<numTracks;++i) {
 		Track::TrackRecord tr;
 		float diff = static_cast<float>(offsets[i+1]-offsets[i]);
@@ -317,27 +360,10 @@ void Cddb::processDiscId(const std::string & discId)
 #endif
 }
 
-const std::string & Cddb::getUser()
+CddbClient & Cddb::client()
 {
-	if(_user == nullptr) {
-		const char * user = std::getenv("USER");
-		assert(user);
-		_user = new std::string(user);
+	if(not _client) {
+		_client = std::make_shared<CddbClient>();
 	}
-	return *_user;
+	return *_client;
 }
-
-const std::string & Cddb::getHost()
-{
-	if(_host == nullptr) {
-		char host[1024] = "unknown";
-		if(gethostname(host, sizeof(host)) != 0) {
-			std::cerr << "Error getting hostname of computer. "
-					  << "Using something dumb instead." << std::endl;
-		}
-		_host = new std::string(host);
-	}
-	return *_host;
-}
-
-
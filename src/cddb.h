@@ -1,13 +1,16 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "cd.h"
+#include "cddb_client.h"
 #include "exceptions.h"
-#include "track_data_model.h"
+#include "toc.h"
+#include "xmcd.h"
 
 /// This class encapsulates the data and results of a CDDB entry.
 ///
@@ -136,8 +139,16 @@
 /// \.
 /// </pre>
 ///
-/// The fields are fairly self explanatory, and quite easy to parse with
-/// regular expressions.
+/// The fields are fairly self explanatory. They are parsed in a single pass
+/// by an XmcdParser.
+///
+/// The `cd-discid` and `cddb-tool` commands above are only shown for
+/// illustration. The table of contents is now read straight from the drive by
+/// a TocSource, and the disc ID is computed from it in-process (see Toc), with
+/// the same result as `cd-discid`. The query
+/// and read commands are now sent straight to the server by a CddbClient, which
+/// keeps its connection alive. The responses are the same as the output of
+/// `cddb-tool`.
 ///
 /// \TODO Create an abstact base class for the Cddb class to act as an API to
 ///       the database. The purpose of this ABC is to prepare for a switch to using
@@ -164,13 +175,30 @@ class Cddb
 	/// The device name of the CDROM drive.
 	static const std::string CD_DEVICE;
 
-	/// Construct a Cddb instance. This method looks up the `cd-discid` of the
-	/// CD, and gets and stores the results of querying the CDDB for this disc
-	/// via the `cddb-tool query` command.
-	Cddb();
-
-	/// Not virtual since there is no inhertiance here.
-	~Cddb();
+	/// The most entries that prefetchMatches() reads at once.
+	static const size_t PREFETCH_JOBS = 8;
+
+	/// Construct an empty Cddb instance. Nothing is looked up until readDisc()
+	/// and cddbQuery() are called, so that the slow steps of a lookup can
+	/// be run one at a time (see CddbLookup).
+	/// @param client The client used to talk to the CDDB server. It may be
+	///        shared between instances that are used by the same thread, so
+	///        that they share a connection. If null, then a client is
+	///        created when it is first needed.
+	explicit Cddb(std::shared_ptr<CddbClient> client = nullptr);
+
+	/// Read the table of contents of the CD in the drive, and store the disc
+	/// ID and track lengths. If there is no disc in the drive, then
+	/// discFound() returns false afterwards.
+	/// @param device The device name of the drive, or the path of a file
+	///        containing the output of `cd-discid` to stand in for the drive.
+	/// @throws CddbError If the table of contents can't be read.
+	void readDisc(const std::string & device = CD_DEVICE);
+
+	/// Use a table of contents that was read elsewhere, e.g. a saved
+	/// `cd-discid` line, as though the disc were in the drive.
+	/// @param toc The table of contents of the disc.
+	void loadToc(const Toc & toc);
 
 	/// Check if a CD was found in the CDROM drive.
 	/// @return Returns true if a disc was found in the drive, false otherwise.
@@ -180,12 +208,12 @@ class Cddb
 	/// @return Returns true if multiple results were returned for the CD in the drive.
 	inline bool isMultiple() const { return _results.size() > 1; }
 
-	/// Test if any results were found by the `cddb-tool query`.
+	/// Test if any results were found by the `cddb query`.
 	/// @return Returns true if the size of the search results is zero.
 	inline bool noResults() const { return _results.size() == 0; }
 
 	/// Check if inexact matches were found.
-	/// Returns true if the `cddb-tool` status code indicates that inexact matches were found.
+	/// Returns true if the `cddb query` status code indicates that inexact matches were found.
 	inline bool isInexact() const { return _inexact; }
 
 	/// Provide read-only access to the disc ID field returned from the
@@ -194,11 +222,28 @@ class Cddb
 	///         there was not disc in the drive.
 	inline const std::string & cdDiscId() const { return _cdDiscId; }
 
+	/// Provide read-only access to the disc ID, number of tracks, track frame
+	/// offsets and total length of the disc, as printed by `cd-discid`.
+	/// @return Returns the disc ID line, or empty string if there was no disc
+	///         in the drive.
+	inline const std::string & rawDiscId() const { return _rawDiscId; }
+
+	/// Provide read-only access to the table of contents of the disc, e.g.
+	/// to rip it.
+	/// @return Returns the TOC, which is empty if there was no disc in the
+	///         drive.
+	inline const Toc & toc() const { return _toc; }
+
 	/// For inexact matches, the disc ID selected by the user needs to be
 	/// specified for future queries, such as for track information.
 	/// @param val The selected disc ID to be used for this CD.
 	inline void setCdDiscId(const std::string & val) { _cdDiscId = val; }
 
+	/// Set the category of the CD, for an entry whose category isn't given in
+	/// the entry itself, such as a plain xmcd file.
+	/// @param val One of #VALID_CATEGORIES.
+	inline void setCategory(const std::string & val) { _category = val; }
+
 	/// Get the album title.
 	/// @return Returns a refernce to the internal member.
 	inline const std::string & title() const { return _title; }
@@ -235,26 +280,40 @@ class Cddb
 	/// @return Returns a const reference.
 	inline const Track::TrackList & tracks() const { return _tracks; }
 
-	/// The raw row value returned from the `cddb-tool query` command that
+	/// The raw row value returned from the `cddb query` command that
 	/// corresponds to the choice selected by the user.
-	/// @return Returns the line entry of the `cddb-tool query` result.
+	/// @return Returns the line entry of the `cddb query` result.
 	inline const std::string & selectedResult() const { return _result; }
 
 	/// Return the number of tracks on the CD.
 	/// @return Should always return a non-negative number.
 	inline int numberOfTracks() { return tracks().size(); }
 
-	/// Fetch all the track information of a `cddb-tool query` result -- either
+	/// Fetch all the track information of a `cddb query` result -- either
 	/// the sole result of a query, or the one selected by the user. This
-	/// employs the `cddb-tool read` command to get the data and populate the
+	/// sends the `cddb read` command to get the data and populate the
 	/// remaining data structures of this class.
 	/// @param which Which result to fetch. The default value is zero. For the
 	///        cases of multiple or inexact results, the which parameter
 	///        indicates the user's selection.
 	void fetchTracks(int which = 0);
 
-	/// Query the CDDB server using the `cddb-tool`.
-	/// 
+	/// Populate the album and track information from a CDDB entry, either
+	/// the response to a `cddb read` command or a plain xmcd file. The disc
+	/// must have been read first, since only as many track titles are kept
+	/// as there are tracks on the disc.
+	/// @param raw The entry.
+	/// @throws CddbError If the entry has no DTITLE.
+	void parseEntry(const std::string & raw);
+
+	/// Populate the album and track information from an entry that has
+	/// already been parsed, e.g. by the bulk import paths, which need the
+	/// table of contents from the entry before the disc can be loaded.
+	/// @param entry The entry.
+	void setEntry(const XmcdEntry & entry);
+
+	/// Query the CDDB server with the `cddb query` command.
+	///
 	/// **NB**: GnuDB only returns "data" for the category. Frustrating, but
 	/// what can you do? They say that removing categories is an improvement,
 	/// but they leave "data" for backwards compatibility. Seems odd to me.
@@ -263,71 +322,89 @@ class Cddb
 	/// use?
 	/// - https://gnudb.org/ (accessed 2024-09-26)
 	/// - https://wiki.musicbrainz.org/History:FreeDB_Gateway
-	void cddbToolQuery();
-
-	/// Provide a list of possible CDs resulting from the `cddb-tool query`.
+	void cddbQuery();
+
+	/// Order inexact matches by how close their tables of contents are to the
+	/// disc's, closest first. The entry of each match is read from the CDDB
+	/// with prefetchMatches() to get its TOC; the matches whose entries can't
+	/// be read, or have a different number of tracks, are kept after the
+	/// others, in their original order. This does nothing unless the matches
+	/// are inexact.
+	void rankMatches();
+
+	/// Read the entries of all of the possibleMatches() at once, each over
+	/// its own connection, so that they can be shown while the user chooses,
+	/// and so that fetchTracks() doesn't have to wait for the server. Entries
+	/// that have already been read are skipped.
+	/// @param onRead If set, this is called with the index of each match as
+	///        soon as its entry has been read, on the calling thread. Matches
+	///        whose entries can't be read are left out.
+	void prefetchMatches(const std::function<void(int)> & onRead = nullptr);
+
+	/// Get the entry of one of the possibleMatches(), if it has been read by
+	/// prefetchMatches().
+	/// @param which The index of the match.
+	/// @param entry Set to the parsed entry.
+	/// @return Returns false if the entry hasn't been read, or has no DTITLE.
+	bool matchEntry(int which, XmcdEntry & entry) const;
+
+	/// How far each of the possibleMatches() is from the disc, after
+	/// rankMatches().
+	/// @return Returns the mean difference of the track offsets of each match,
+	///         in seconds, or -1 if it isn't known.
+	inline const std::vector<double> & matchDistances() const { return _distances; }
+
+	/// Provide a list of possible CDs resulting from the `cddb query`.
 	/// @return Returns the results of querying the CDDB for possible CDs as a
 	///         read-only reference.
 	inline const std::vector<std::string> & possibleMatches() const { return _results; }
 
-  private:
-
-	/// Return the user name of the individual using the software. This method
-	/// uses lazy evaluation to get and store the user name.
-	/// @retrun Returns the user name of the individual.
-	const std::string & getUser();
-
-	/// Return the host name that the software is being executed on. This method
-	/// uses lazy evaluation to get and store the host name. The host name is
-	/// not the FQDN, just the simple name.
-	/// @retrun Returns the host name of the machine.
-	const std::string & getHost();
-
-	/// Execute a system command, but collect the output and return it as a
-	/// string.
-	/// @param command The command to execute is assumed to be properly formed.
-	/// @return Returns the standard output of the command. Standard error is
-	///         ignored. Thus, if you want to capture standard are, you need to
-	///         construct a command so that it is capture. E.g., using something
-	///         like 2>&1.
-	const std::string execCommand(const std::string & command);
-
 	/// Separate a multiline string containing CDDB data into separate lines.
 	/// Note that the last line of well-formated CDDB data contains only a dot.
+	/// Carriage returns at the end of the lines are removed.
 	/// @param The multi-line, raw string data.
 	/// @return Returns a vector, where each value is a line from the raw string.
-	const std::vector<std::string> separateRawCddbData(const std::string & raw);
+	static const std::vector<std::string> separateRawCddbData(const std::string & raw);
 
 	/// Given the first line of output from a CDDB query, extract the return code.
 	/// @param line The first line returned from CDDB query.
 	/// @return The code is the first number in the line, get it, return it.
-	int getCddbCode(const std::string & line);
+	static int getCddbCode(const std::string & line);
+
+  private:
+
+	/// Get the client used to talk to the CDDB server, creating it if there
+	/// isn't one yet.
+	/// @return Returns the client.
+	CddbClient & client();
 
-	/// Given a discid, process and store the values contained within it.
-	/// @param discId A correctly formatted disc ID.
-	void processDiscId(const std::string & discId);
+	/// Given the table of contents of a disc, compute and store the disc ID
+	/// and the lengths of the tracks.
+	/// @param toc The table of contents of the disc.
+	void processToc(const Toc & toc);
 
   private:
-	std::string _result {""};			///< The selected line item from the `cddb-tool query`.
+	std::string _result {""};			///< The selected line item from the `cddb query`.
 	bool _discFound {false};			///< True if a CD found in the drive.
 
-	std::string _rawDiscId;				///< The raw output of the `cd-discid` command.
+	std::string _rawDiscId;				///< The disc ID and TOC, as output by the `cd-discid` command.
 	std::string _cdDiscId;				///< The `cd-discid` ID of the CD.
-	bool _inexact;						///< True if inexact matches of the CD were found.
-	int _length;						///< The total length of the CD in seconds.
+	bool _inexact {false};				///< True if inexact matches of the CD were found.
+	int _length {0};					///< The total length of the CD in seconds.
 	std::vector<std::string> _results;	///< A list containing all possible results for this CD.
+	std::vector<double> _distances;		///< The distance of each result in seconds, -1 if not known.
+	std::vector<std::string> _entries;	///< The `cddb read` response of each result, empty if not read.
+	Toc _toc;							///< The table of contents of the CD.
 	std::string _artist;				///< Artist of the CD, that must not be empty.
 	std::string _title;					///< Title of the CD, that must not be empty.
 	std::string _category;				///< The FreeDB category, that must be one of +FreeDb::VALID_CATEGORIES+.
 	std::string _genre;					///< An arbitraty string for the genre.
-	int _year;							///< The year of the cd (0 if not known).
+	int _year {0};						///< The year of the cd (0 if not known).
 
-	Track::TrackList _tracks;			///< The track data loaded via the `cddb-tool read` command.
+	Track::TrackList _tracks;			///< The track data loaded via the `cddb read` command.
 
 	std::string _extraInfo;				///< Extra info of the CD.
-	std::string * _user { nullptr };	///< Lazily-acquired user name.
-	std::string * _host { nullptr };	///< Lazily-acquired host name.
+	std::shared_ptr<CddbClient> _client;	///< Lazily-created client for the CDDB server.
 	std::string _rawData;				///< The raw data returned from a complete CDDB entry
-	std::vector<std::string> _data;		///< The raw data broken up by lines.
 };
 
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>			// POSIX only, for pread() and pwrite()
+#include <unistd.h>
+
+#include "cddb_cache.h"
+
+/// Read the whole of a range of a file.
+/// @return Returns true if all of the bytes were read.
+static bool readAll(int fd, void * buf, size_t count, uint64_t offset)
+{
+	char * p = static_cast<char *>(buf);
+	while(count > 0) {
+		ssize_t n = ::pread(fd, p, count, offset);
+		if(n <= 0) {
+			return false;
+		}
+		p += n;
+		count -= n;
+		offset += n;
+	}
+	return true;
+}
+
+/// Write the whole of a buffer to a range of a file.
+/// @return Returns true if all of the bytes were written.
+static bool writeAll(int fd, const void * buf, size_t count, uint64_t offset)
+{
+	const char * p = static_cast<const char *>(buf);
+	while(count > 0) {
+		ssize_t n = ::pwrite(fd, p, count, offset);
+		if(n <= 0) {
+			return false;
+		}
+		p += n;
+		count -= n;
+		offset += n;
+	}
+	return true;
+}
+
+/// Read a non-negative number from an environment variable.
+/// @param name The name of the variable.
+/// @param fallback The value to use if the variable isn't set.
+/// @return Returns the value of the variable, or the fallback.
+static long long fromEnvironment(const char * name, long long fallback)
+{
+	const char * value = std::getenv(name);
+	if(value == nullptr or *value == '\0') {
+		return fallback;
+	}
+	return std::max(0LL, std::atoll(value));
+}
+
+std::shared_ptr<CddbCache> CddbCache::shared()
+{
+	static std::shared_ptr<CddbCache> cache = [] {
+		namespace fs = std::filesystem;
+		fs::path dir;
+		if(const char * xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr and *xdg != '\0') {
+			dir = xdg;
+		} else if(const char * home = std::getenv("HOME"); home != nullptr) {
+			dir = fs::path(home) / ".cache";
+		} else {
+			dir = fs::temp_directory_path();
+		}
+		dir /= "cdimport";
+		std::error_code ec;
+		fs::create_directories(dir, ec);
+
+		return std::make_shared<CddbCache>(
+			(dir / "cddb.cache").string(),
+			static_cast<time_t>(fromEnvironment("CDDB_CACHE_TTL", DEFAULT_TTL)),
+			static_cast<size_t>(fromEnvironment("CDDB_CACHE_MAX_BYTES", DEFAULT_MAX_BYTES)));
+	}();
+	return cache;
+}
+
+CddbCache::CddbCache(const std::string & path, time_t ttl, size_t maxBytes)
+  : _path(path), _ttl(ttl), _maxBytes(maxBytes)
+{
+	if(_ttl == 0) {
+		return;		// Caching is turned off
+	}
+	_fd = ::open(_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if(_fd < 0) {
+		std::cerr << "Unable to open the CDDB cache " << _path << ": "
+				  << std::strerror(errno) << std::endl;
+		return;
+	}
+	load();
+}
+
+CddbCache::~CddbCache()
+{
+	if(_fd >= 0) {
+		::close(_fd);
+	}
+}
+
+bool CddbCache::get(const std::string & key, std::string & body)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto found = _index.find(key);
+	if(found == _index.end() or isStale(found->second.stored)) {
+		++_misses;
+		return false;
+	}
+	const Entry & entry = found->second;
+	body.resize(entry.length);
+	if(not readAll(_fd, body.data(), entry.length, entry.offset)) {
+		_index.erase(found);
+		++_misses;
+		return false;
+	}
+	++_hits;
+	return true;
+}
+
+void CddbCache::put(const std::string & key, const std::string & body)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(_fd < 0) {
+		return;
+	}
+
+	RecordHeader header {
+		RECORD_MAGIC,
+		static_cast<uint32_t>(key.size()),
+		static_cast<uint32_t>(body.size()),
+		0,
+		static_cast<int64_t>(std::time(nullptr))
+	};
+	std::string record(reinterpret_cast<const char *>(&header), sizeof(header));
+	record += key;
+	record += body;
+	if(not writeAll(_fd, record.data(), record.size(), _size)) {
+		std::cerr << "Unable to write to the CDDB cache " << _path << "." << std::endl;
+		return;
+	}
+	_index[key] = { _size + sizeof(header) + key.size(), header.bodyLength, header.stored };
+	_size += record.size();
+
+	if(_size > _maxBytes) {
+		compact();
+	}
+}
+
+void CddbCache::report(std::ostream & out) const
+{
+	if(_hits + _misses > 0) {
+		out << "CDDB cache: " << _hits << " hit(s), " << _misses << " miss(es)." << std::endl;
+	}
+}
+
+void CddbCache::load()
+{
+	uint64_t fileSize = ::lseek(_fd, 0, SEEK_END);
+	uint64_t offset = 0;
+	RecordHeader header;
+	std::string key;
+	while(offset + sizeof(header) <= fileSize) {
+		if(not readAll(_fd, &header, sizeof(header), offset) or header.magic != RECORD_MAGIC) {
+			break;
+		}
+		uint64_t end = offset + sizeof(header) + header.keyLength + header.bodyLength;
+		if(end > fileSize) {
+			break;
+		}
+		key.resize(header.keyLength);
+		if(not readAll(_fd, key.data(), header.keyLength, offset + sizeof(header))) {
+			break;
+		}
+		_index[key] = { offset + sizeof(header) + header.keyLength, header.bodyLength,
+						header.stored };
+		offset = end;
+	}
+
+	// Cut off anything after the last good record, e.g. from a crash mid-write
+	if(offset < fileSize and ::ftruncate(_fd, offset) != 0) {
+		std::cerr << "Unable to repair the CDDB cache " << _path << "." << std::endl;
+	}
+	_size = offset;
+#ifdef DEBUG
+	std::cout << "Loaded " << _index.size() << " CDDB cache entries from " << _path
+			  << "." << std::endl;
+#endif
+}
+
+void CddbCache::compact()
+{
+	// Newest first, and drop the stale entries
+	std::vector<std::pair<std::string, Entry>> entries;
+	for(const auto & kv : _index) {
+		if(not isStale(kv.second.stored)) {
+			entries.push_back(kv);
+		}
+	}
+	std::sort(entries.begin(), entries.end(), [](const auto & a, const auto & b) {
+		return a.second.stored > b.second.stored;
+	});
+
+	std::string tmpPath = _path + ".tmp";
+	int tmp = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(tmp < 0) {
+		return;
+	}
+
+	// Leave some room, so that the next few responses don't compact again
+	const uint64_t target = _maxBytes / 4 * 3;
+	std::unordered_map<std::string, Entry> index;
+	uint64_t size = 0;
+	std::string body;
+	for(const auto & [key, entry] : entries) {
+		uint64_t recordSize = sizeof(RecordHeader) + key.size() + entry.length;
+		if(size + recordSize > target) {
+			break;
+		}
+		body.resize(entry.length);
+		if(not readAll(_fd, body.data(), entry.length, entry.offset)) {
+			continue;
+		}
+		RecordHeader header { RECORD_MAGIC, static_cast<uint32_t>(key.size()),
+							  entry.length, 0, entry.stored };
+		std::string record(reinterpret_cast<const char *>(&header), sizeof(header));
+		record += key;
+		record += body;
+		if(not writeAll(tmp, record.data(), record.size(), size)) {
+			::close(tmp);
+			::unlink(tmpPath.c_str());
+			return;
+		}
+		index[key] = { size + sizeof(header) + key.size(), entry.length, entry.stored };
+		size += recordSize;
+	}
+
+	if(std::rename(tmpPath.c_str(), _path.c_str()) != 0) {
+		::close(tmp);
+		::unlink(tmpPath.c_str());
+		return;
+	}
+	::close(_fd);
+	_fd = tmp;
+	_index.swap(index);
+	_size = size;
+#ifdef DEBUG
+	std::cout << "Compacted the CDDB cache to " << _index.size() << " entries." << std::endl;
+#endif
+}
+
+bool CddbCache::isStale(int64_t stored) const
+{
+	return std::time(nullptr) - stored > _ttl;
+}
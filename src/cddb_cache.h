@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+/// A persistent, on-disk cache of CDDB responses, so that looking up the same
+/// disc again, e.g. after a mis-click or a cleared form, doesn't go back to the
+/// server. The responses are appended to a single file, and an index of the
+/// file is kept in memory, so a hit costs a hash lookup and one read from the
+/// (usually page-cached) file.
+///
+/// Each record in the file is a RecordHeader, followed by the key and the body.
+/// When a key is stored again, the new record shadows the old one. Expired and
+/// shadowed records are dropped when the file grows past its size bound, by
+/// rewriting it with the newest records only.
+///
+/// The cache is safe to use from several threads.
+class CddbCache
+{
+  public:
+
+	/// How long a response stays fresh by default, in seconds.
+	static const time_t DEFAULT_TTL = 30 * 24 * 60 * 60;
+
+	/// The default bound on the size of the cache file, in bytes.
+	static const size_t DEFAULT_MAX_BYTES = 32 * 1024 * 1024;
+
+	/// The cache used by the application, created on first use. It lives in
+	/// `$XDG_CACHE_HOME/cdimport/cddb.cache`, or `~/.cache/cdimport/cddb.cache`.
+	/// The TTL and size bound can be changed with the `CDDB_CACHE_TTL`
+	/// (seconds) and `CDDB_CACHE_MAX_BYTES` environment variables. A TTL of
+	/// zero turns caching off.
+	/// @return Returns the shared cache.
+	static std::shared_ptr<CddbCache> shared();
+
+	/// Open a cache file, creating it if necessary. If the file can't be
+	/// opened, then the cache is disabled and every lookup is a miss.
+	/// @param path The path of the cache file.
+	/// @param ttl How long a response stays fresh, in seconds.
+	/// @param maxBytes The bound on the size of the cache file.
+	CddbCache(const std::string & path, time_t ttl = DEFAULT_TTL,
+			  size_t maxBytes = DEFAULT_MAX_BYTES);
+
+	/// Close the cache file.
+	~CddbCache();
+
+	CddbCache(const CddbCache &) = delete;
+	CddbCache & operator=(const CddbCache &) = delete;
+
+	/// Look up a response.
+	/// @param key The key the response was stored under.
+	/// @param body Set to the response, if it was found.
+	/// @return Returns true on a hit, false if the response is missing or stale.
+	bool get(const std::string & key, std::string & body);
+
+	/// Store a response.
+	/// @param key The key to store the response under.
+	/// @param body The response.
+	void put(const std::string & key, const std::string & body);
+
+	/// The number of lookups that were hits.
+	inline uint64_t hits() const { return _hits; }
+
+	/// The number of lookups that were misses.
+	inline uint64_t misses() const { return _misses; }
+
+	/// Print the hit and miss counts, if there were any lookups.
+	/// @param out Where to print the report.
+	void report(std::ostream & out) const;
+
+  private:
+
+	/// The header of a record in the cache file.
+	struct RecordHeader
+	{
+		uint32_t magic;			///< Always RECORD_MAGIC, to spot a damaged file.
+		uint32_t keyLength;		///< The length of the key that follows the header.
+		uint32_t bodyLength;	///< The length of the body that follows the key.
+		uint32_t reserved;		///< Zero.
+		int64_t stored;			///< When the record was stored, in seconds since the epoch.
+	};
+
+	/// Where a response is in the cache file.
+	struct Entry
+	{
+		uint64_t offset;		///< The offset of the body.
+		uint32_t length;		///< The length of the body.
+		int64_t stored;			///< When the record was stored.
+	};
+
+	static const uint32_t RECORD_MAGIC = 0x63646263;	///< "cbdc"
+
+	/// Read the index of the cache file, and cut off a damaged tail.
+	void load();
+
+	/// Rewrite the cache file with only the newest, fresh records, so that it
+	/// is well within its size bound.
+	void compact();
+
+	/// Test if a record is older than the TTL.
+	/// @param stored When the record was stored.
+	/// @return Returns true if the record is stale.
+	bool isStale(int64_t stored) const;
+
+	const std::string _path;							///< The path of the cache file.
+	const time_t _ttl;									///< How long records stay fresh.
+	const size_t _maxBytes;								///< The bound on the file size.
+	int _fd { -1 };										///< The cache file, or -1 if disabled.
+	uint64_t _size { 0 };								///< The size of the cache file.
+	std::unordered_map<std::string, Entry> _index;		///< Where each key's response is.
+	std::mutex _mutex;									///< Guards the file and the index.
+	std::atomic<uint64_t> _hits { 0 };					///< The number of hits.
+	std::atomic<uint64_t> _misses { 0 };				///< The number of misses.
+};
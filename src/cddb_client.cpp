@@ -0,0 +1,151 @@
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>		// Linux only, needed for gethostname()
+
+#include "cddb_client.h"
+
+#include "cddb.h"
+#include "exceptions.h"
+
+const std::string CddbClient::CLIENT_NAME { "cdimport" };
+const std::string CddbClient::CLIENT_VERSION { "0.1" };
+
+std::string CddbClient::serverUrl()
+{
+	const char * server = std::getenv("CDDB_SERVER");
+	if(server != nullptr and *server != '\0') {
+		return server;
+	}
+	return Cddb::SERVER;
+}
+
+CddbClient::CddbClient(const std::string & server, std::shared_ptr<CddbCache> cache,
+					   std::shared_ptr<CddbMirror> mirror)
+  : _server(server), _curl(curl_easy_init()), _cache(cache), _mirror(mirror)
+{
+	if(_curl == nullptr) {
+		throw CddbError("Unable to initialize the HTTP client.");
+	}
+	curl_easy_setopt(_curl, CURLOPT_WRITEFUNCTION, &CddbClient::append);
+	curl_easy_setopt(_curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(_curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(_curl, CURLOPT_CONNECTTIMEOUT, 10L);
+	curl_easy_setopt(_curl, CURLOPT_TIMEOUT, 30L);
+	curl_easy_setopt(_curl, CURLOPT_NOSIGNAL, 1L);	// We run on worker threads
+	std::string agent = CLIENT_NAME + "/" + CLIENT_VERSION;
+	curl_easy_setopt(_curl, CURLOPT_USERAGENT, agent.c_str());
+}
+
+CddbClient::~CddbClient()
+{
+	curl_easy_cleanup(_curl);
+}
+
+std::string CddbClient::query(const std::string & discId)
+{
+	if(_mirror) {
+		return _mirror->query(discId);
+	}
+	return cached("cddb query " + discId);
+}
+
+std::string CddbClient::read(const std::string & category, const std::string & discId)
+{
+	if(_mirror) {
+		return _mirror->read(category, discId);
+	}
+	return cached("cddb read " + category + " " + discId);
+}
+
+std::string CddbClient::cached(const std::string & command)
+{
+	// Different servers may well give different answers
+	const std::string key = _server + " " + encodeWords(command);
+	std::string body;
+	if(_cache and _cache->get(key, body)) {
+#ifdef DEBUG
+		std::cout << "CDDB cache hit for: " << command << std::endl;
+#endif
+		return body;
+	}
+
+	body = get(command);
+
+	// Only keep the responses that found something, i.e., the exact and
+	// inexact matches of a query and the entry of a read
+	int code = std::atoi(body.c_str());
+	if(_cache and (code == 200 or code == 210 or code == 211)) {
+		_cache->put(key, body);
+	}
+	return body;
+}
+
+std::string CddbClient::get(const std::string & command)
+{
+	std::stringstream url;
+	url << _server
+		<< "?cmd=" << encodeWords(command)
+		<< "&hello=" << hello()
+		<< "&proto=" << Cddb::PROTO_LEVEL;
+#ifdef DEBUG
+	std::cout << "GET " << url.str() << std::endl;
+#endif
+
+	std::string body;
+	curl_easy_setopt(_curl, CURLOPT_URL, url.str().c_str());
+	curl_easy_setopt(_curl, CURLOPT_WRITEDATA, &body);
+	CURLcode res = curl_easy_perform(_curl);
+	if(res != CURLE_OK) {
+		throw CddbError(std::string("Error contacting the CDDB server: ")
+						+ curl_easy_strerror(res));
+	}
+
+	long status = 0;
+	curl_easy_getinfo(_curl, CURLINFO_RESPONSE_CODE, &status);
+	if(status != 200) {
+		throw CddbError("The CDDB server responded with HTTP status " + std::to_string(status));
+	}
+	return body;
+}
+
+std::string CddbClient::encodeWords(const std::string & words)
+{
+	std::istringstream iss(words);
+	std::string word;
+	std::string encoded;
+	while(iss >> word) {
+		char * escaped = curl_easy_escape(_curl, word.c_str(), static_cast<int>(word.size()));
+		if(not encoded.empty()) {
+			encoded += '+';
+		}
+		encoded += escaped;
+		curl_free(escaped);
+	}
+	return encoded;
+}
+
+const std::string & CddbClient::hello()
+{
+	if(_hello.empty()) {
+		const char * user = std::getenv("USER");
+		assert(user);
+
+		char host[1024] = "unknown";
+		if(gethostname(host, sizeof(host)) != 0) {
+			std::cerr << "Error getting hostname of computer. "
+					  << "Using something dumb instead." << std::endl;
+		}
+
+		_hello = encodeWords(std::string(user) + " " + host + " "
+							 + CLIENT_NAME + " " + CLIENT_VERSION);
+	}
+	return _hello;
+}
+
+size_t CddbClient::append(char * data, size_t size, size_t count, void * body)
+{
+	static_cast<std::string *>(body)->append(data, size * count);
+	return size * count;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <curl/curl.h>
+
+#include "cddb_cache.h"
+#include "cddb_mirror.h"
+
+/// An in-process client for the CDDB protocol over HTTP. This replaces running
+/// `cddb-tool` through a shell for every query and read. The commands are sent
+/// as HTTP GET requests to the `cddb.cgi` of the server, e.g.
+///
+/// `GET /~cddb/cddb.cgi?cmd=cddb+read+data+a70d5289&hello=pmvarsa+pumpkin+cdimport+0.1&proto=6`
+///
+/// and the body of the response is exactly what `cddb-tool` used to print. One
+/// curl handle is kept for the lifetime of the client, so the connection to the
+/// server (including the TLS session) is kept alive and reused between the
+/// query and the read of a disc, and from one disc to the next.
+///
+/// Successful responses are stored in a CddbCache, and served from there when
+/// the same disc is looked up again.
+///
+/// If a local CddbMirror is given, then it answers all of the commands, and
+/// the server isn't contacted at all. This is for stations without a usable
+/// internet connection.
+///
+/// A client must not be used by more than one thread at a time.
+class CddbClient
+{
+  public:
+
+	/// The name that the client identifies itself with to the server.
+	static const std::string CLIENT_NAME;
+
+	/// The version that the client identifies itself with to the server.
+	static const std::string CLIENT_VERSION;
+
+	/// The URL of the server to use. This is Cddb::SERVER, unless the
+	/// `CDDB_SERVER` environment variable is set, e.g. to point at a local
+	/// stand-in server that serves recorded responses.
+	/// @return Returns the URL of the `cddb.cgi` script of the server.
+	static std::string serverUrl();
+
+	/// Construct a client. No connection is made until the first request.
+	/// @param server The URL of the `cddb.cgi` script of the server.
+	/// @param cache Where responses are cached, or null to not cache them.
+	/// @param mirror The mirror that answers in place of the server, or null
+	///        to use the server. By default, this is the mirror given by the
+	///        `CDDB_MIRROR` environment variable, if any.
+	explicit CddbClient(const std::string & server = serverUrl(),
+						std::shared_ptr<CddbCache> cache = CddbCache::shared(),
+						std::shared_ptr<CddbMirror> mirror = CddbMirror::shared());
+
+	/// Close the connection to the server.
+	~CddbClient();
+
+	CddbClient(const CddbClient &) = delete;
+	CddbClient & operator=(const CddbClient &) = delete;
+
+	/// Send a `cddb query` command.
+	/// @param discId The disc ID, number of tracks, track frame offsets and
+	///        total length in seconds, separated by spaces, as printed by
+	///        `cd-discid`.
+	/// @return Returns the body of the response.
+	/// @throws CddbError If the request fails.
+	std::string query(const std::string & discId);
+
+	/// Send a `cddb read` command.
+	/// @param category The CDDB category of the entry.
+	/// @param discId The disc ID of the entry.
+	/// @return Returns the body of the response, an xmcd file.
+	/// @throws CddbError If the request fails.
+	std::string read(const std::string & category, const std::string & discId);
+
+  private:
+
+	/// Look up a response in the cache, or send a CDDB command to the server
+	/// and cache the response if it found something.
+	/// @param command The words of the command, separated by spaces.
+	/// @return Returns the body of the response.
+	/// @throws CddbError If the request fails.
+	std::string cached(const std::string & command);
+
+	/// Send a CDDB command to the server.
+	/// @param command The words of the command, separated by spaces.
+	/// @return Returns the body of the response.
+	/// @throws CddbError If the request fails.
+	std::string get(const std::string & command);
+
+	/// URL-encode the words of a CDDB command, and join them with a `+`.
+	/// @param words The words, separated by spaces.
+	/// @return Returns a string that can be used as a URL parameter.
+	std::string encodeWords(const std::string & words);
+
+	/// Build the `hello` parameter of a request from the user and host names.
+	/// This uses lazy evaluation to compute and store the value.
+	/// @return Returns the encoded `hello` parameter.
+	const std::string & hello();
+
+	/// Collect the body of a response. Called by curl.
+	static size_t append(char * data, size_t size, size_t count, void * body);
+
+	const std::string _server;		///< The URL of the server's `cddb.cgi`.
+	CURL * _curl;					///< The handle, which keeps the connection alive.
+	std::shared_ptr<CddbCache> _cache;	///< Where responses are cached, may be null.
+	std::shared_ptr<CddbMirror> _mirror;	///< The mirror that answers in place of the server, may be null.
+	std::string _hello;				///< Lazily-built hello parameter.
+};
@@ -0,0 +1,155 @@
+#include <cassert>
+#include <iostream>
+#include <regex>
+
+#include "cddb_lookup.h"
+
+#include "exceptions.h"
+#include "macros.h"
+#include "metrics.h"
+#include "pg_conn.h"
+#include "ripper.h"
+
+CddbLookup::CddbLookup(const std::string & device, QObject * parent)
+  : QObject(parent), _device(device), _client(std::make_shared<CddbClient>())
+{
+}
+
+void CddbLookup::registerMetaTypes()
+{
+	qRegisterMetaType<Cddb>("Cddb");
+	qRegisterMetaType<AlbumMatches>("AlbumMatches");
+	qRegisterMetaType<Cd::CdAlbumData>("Cd::CdAlbumData");
+	qRegisterMetaType<Track::TrackList>("Track::TrackList");
+	qRegisterMetaType<Trace::Ptr>("Trace::Ptr");
+}
+
+void CddbLookup::discover(const Trace::Ptr & trace)
+{
+#ifdef DEBUG
+	using std::cout, std::endl;
+#endif
+	_trace = trace;
+	Trace::Attach attach(_trace);
+	Trace::nameThread("lookup " + _device);
+	TRACE_SPAN("discover");
+	try {
+		// Start over from a clean slate
+		_cd = Cddb(_client);
+		_cd.readDisc(_device);
+		if(not _cd.discFound()) {
+			emit noDisc();
+			return;
+		}
+		if(_trace) {
+			_trace->setLabel(_cd.cdDiscId());
+		}
+		emit discovered(_cd);
+
+		_cd.cddbQuery();
+		_cd.rankMatches();
+		emit candidatesFound(_cd);
+
+		if(_cd.noResults()) {
+			emit finished();
+		} else if(not _cd.isMultiple() and not _cd.isInexact()) {
+#ifdef DEBUG
+			cout << "One exact match, reading it straight away." << endl;
+#endif
+			read(0);
+		} else {
+			// Read all of the candidates while the user chooses one, then wait
+			// for the choice. Inexact matches have already been read to rank
+			// them.
+			_cd.prefetchMatches([this](int which) {
+				emit candidateRead(_cd, which);
+			});
+		}
+	} catch(const CddbError & e) {
+		std::string message = std::string("Something went wrong querying CDDB: ") + e.what();
+		emit failed(QStr(message));
+	} catch(const std::exception & e) {
+		// e.g. std::bad_alloc from a malformed entry, which would otherwise end the thread
+		std::string message = std::string("Something went wrong reading the disc: ") + e.what();
+		emit failed(QStr(message));
+	}
+}
+
+void CddbLookup::read(int which)
+{
+	Trace::Attach attach(_trace);
+	TRACE_SPAN("read");
+	try {
+		if(_cd.isInexact()) {
+			// Get the disc id from the inexact match
+			std::regex regex("^[a-z]+ ([a-z0-9]+) .*$");
+			std::smatch match;
+			if(std::regex_search(_cd.possibleMatches()[which], match, regex)) {
+				// the matched string should be in location 1, 0 is the whole input string
+				assert(match.size() == 2);
+				_cd.setCdDiscId(match[1]);
+			} else {
+				emit failed("Unable to find the disc ID of the selected match.");
+				return;
+			}
+		}
+
+		_cd.fetchTracks(which);
+		emit tracksRead(_cd);
+
+		checkDuplicates();
+		emit finished();
+	} catch(const std::exception & e) {
+		std::string message = std::string("Something went wrong reading CDDB: ") + e.what();
+		emit failed(QStr(message));
+	}
+	// Keep the metrics file current while the station is running
+	Metrics::save();
+}
+
+void CddbLookup::save(const Cd::CdAlbumData & album, const Track::TrackList & tracks, bool rip)
+{
+	Trace::Attach attach(_trace);
+	Checksums::List checksums;
+	if(rip) {
+		// The disc is read while the encoders start on the first tracks
+		try {
+			TRACE_SPAN("rip");
+			checksums = Ripper::rip(_device, _cd.toc(), album, tracks, [this](int track, int total) {
+				emit ripProgress(track, total);
+			});
+		} catch(const RipError & e) {
+			emit ripFailed(QStr(std::string("Something went wrong ripping the disc: ") + e.what()));
+			Metrics::save();
+			return;
+		}
+	}
+	bool ok;
+	{
+		// Recorded before the user interface hears of it, and ejects
+		TRACE_SPAN("save");
+		ok = PgConn::insertCd(album, tracks, checksums);
+	}
+	emit saved(ok);
+	Metrics::save();
+}
+
+void CddbLookup::checkDuplicates()
+{
+	TRACE_SPAN("duplicate_check");
+	// Look if this CD exists
+	auto result = PgConn::queryCdDiscId(_cd.cdDiscId());
+	if(not result.empty()) {
+		emit duplicatesFound(result);
+	} else if(_cd.isInexact()) {
+		// If this was an inexact match, we should also search by album/artist
+		auto inexactResults = PgConn::queryArtistTitle(_cd.artist(), _cd.title());
+		if(not inexactResults.empty()) {
+			emit duplicatesFound(inexactResults);
+		}
+#ifdef DEBUG
+	} else {
+		std::cout << "CD Does not exist in DB." << std::endl;
+#endif
+	}
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <QObject>
+#include <QString>
+
+#include <pqxx/pqxx>
+
+#include "cddb.h"
+#include "pg_rows.h"
+#include "trace.h"
+
+Q_DECLARE_METATYPE(Cddb)
+Q_DECLARE_METATYPE(AlbumMatches)
+Q_DECLARE_METATYPE(Cd::CdAlbumData)
+Q_DECLARE_METATYPE(Track::TrackList)
+Q_DECLARE_METATYPE(Trace::Ptr)
+
+/// Run the slow stages of looking up a CD on a worker thread, so that the user
+/// interface does not freeze while `cd-discid`, the CDDB server and the
+/// database are busy. An instance of this class is meant to be moved to a
+/// QThread, and its slots are invoked through queued signals from the GUI
+/// thread.
+///
+/// The lookup is split into four stages, and the result of each stage is
+/// posted back as soon as it is ready:
+/// 1. Discover: read the `cd-discid` of the disc, then emit #discovered with
+///    the disc ID and the track lengths.
+/// 2. Query: send `cddb query` to the server, then emit #candidatesFound. If
+///    there are several candidates, their entries are read all at once while
+///    the user chooses, and #candidateRead is emitted for each. Inexact
+///    matches are read first, since they are ranked by their entries.
+/// 3. Read: send `cddb read` for the chosen candidate, then emit
+///    #tracksRead. A single exact match is read straight away, otherwise the
+///    stage waits for the user's choice via read().
+/// 4. Duplicate check: query the database for the disc, then emit
+///    #duplicatesFound if it was already catalogued.
+///
+/// Every lookup ends with either #finished, #noDisc or #failed, except when
+/// the user cancels the choice of candidates, in which case nothing more is
+/// emitted.
+///
+/// The album is saved to the database by the same worker, with save(), so
+/// that each drive has its own pipeline and a slow insert doesn't hold up the
+/// user interface or the other drives. The disc can be ripped on the way, see
+/// Ripper.
+class CddbLookup : public QObject
+{
+	Q_OBJECT
+
+  public:
+
+	/// Construct the worker with an optional parent.
+	/// @param device The device name of the drive to look up, or a file that
+	///        stands in for it.
+	/// @param parent Must be nullptr if the object is to be moved to a thread.
+	explicit CddbLookup(const std::string & device = Cddb::CD_DEVICE, QObject * parent = nullptr);
+
+	/// Register the types carried by the signals of this class, which is
+	/// required before they can be used in queued connections.
+	static void registerMetaTypes();
+
+  public slots:
+
+	/// Start a new lookup with the discover and query stages. A single exact
+	/// match continues on through the read and duplicate check stages.
+	/// @param trace The trace of the disc, which the rest of the lookup and
+	///        the save are recorded into, or nullptr if tracing is off.
+	void discover(const Trace::Ptr & trace);
+
+	/// Continue the current lookup with the read and duplicate check stages.
+	/// @param which The index of the candidate chosen by the user.
+	void read(int which);
+
+	/// Insert an album into the database, then emit #saved. If it is to be
+	/// ripped, then the audio is read first, emitting #ripProgress for each
+	/// track, and the checksums of the tracks are inserted with them. If the
+	/// rip fails, then #ripFailed is emitted instead, and the album isn't
+	/// inserted.
+	/// @param album The album.
+	/// @param tracks The tracks of the album.
+	/// @param rip True to rip the disc too.
+	void save(const Cd::CdAlbumData & album, const Track::TrackList & tracks, bool rip);
+
+  signals:
+
+	/// The disc ID and the track lengths of the disc are known.
+	/// @param cd A snapshot of the lookup so far.
+	void discovered(const Cddb & cd);
+
+	/// There is no disc in the drive. The lookup is over.
+	void noDisc();
+
+	/// The CDDB has been queried for the disc.
+	/// @param cd A snapshot of the lookup so far, with the possible matches.
+	void candidatesFound(const Cddb & cd);
+
+	/// The entry of one of the candidates has been read, before the user has
+	/// chosen.
+	/// @param cd A snapshot of the lookup so far, with the entries read so far.
+	/// @param which The index of the candidate.
+	void candidateRead(const Cddb & cd, int which);
+
+	/// The track titles and album information of the chosen candidate are known.
+	/// @param cd A snapshot of the lookup so far.
+	void tracksRead(const Cddb & cd);
+
+	/// The disc appears to already exist in the database.
+	/// @param result The matching rows from the database.
+	void duplicatesFound(const AlbumMatches & result);
+
+	/// The lookup is over.
+	void finished();
+
+	/// The lookup failed. The lookup is over.
+	/// @param message A message suitable for the user.
+	void failed(const QString & message);
+
+	/// An album has been inserted by save(), or not.
+	/// @param ok False if the insert failed.
+	void saved(bool ok);
+
+	/// A track has been read by save(), and queued to be encoded.
+	/// @param track The number of tracks read so far.
+	/// @param tracks The number of audio tracks on the disc.
+	void ripProgress(int track, int tracks);
+
+	/// The disc couldn't be ripped by save(), so the album wasn't inserted.
+	/// @param message A message suitable for the user.
+	void ripFailed(const QString & message);
+
+  private:
+
+	/// Look for the disc in the database, by disc ID, or for inexact matches
+	/// also by artist and title.
+	void checkDuplicates();
+
+	std::string _device;					///< The drive that is looked up.
+	Cddb _cd;								///< The lookup in progress.
+	std::shared_ptr<CddbClient> _client;	///< Keeps the connection to the server open between lookups.
+	Trace::Ptr _trace;						///< The trace of the disc, or nullptr.
+};
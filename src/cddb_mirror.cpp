@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>			// POSIX only, for mmap()
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cddb_mirror.h"
+
+#include "cddb.h"
+#include "exceptions.h"
+#include "tar_reader.h"
+#include "xmcd.h"
+
+const std::string CddbMirror::INDEX_FILE { "cddb.index" };
+const std::string CddbMirror::DATA_FILE { "cddb.data" };
+const std::string CddbMirror::TOCS_FILE { "cddb.tocs" };
+
+/// Parse a disc ID, which is eight hexadecimal digits.
+/// @param text The disc ID.
+/// @param discId Set to the disc ID.
+/// @return Returns false if the text isn't a disc ID.
+static bool parseDiscId(const std::string & text, uint32_t & discId)
+{
+	if(text.empty() or text.size() > 8) {
+		return false;
+	}
+	char * end = nullptr;
+	unsigned long value = std::strtoul(text.c_str(), &end, 16);
+	if(*end != '\0') {
+		return false;
+	}
+	discId = static_cast<uint32_t>(value);
+	return true;
+}
+
+/// Find a category in Cddb::VALID_CATEGORIES.
+/// @param category The name of the category.
+/// @return Returns the index of the category, or -1 if it isn't valid.
+static int categoryIndex(const std::string & category)
+{
+	for(size_t i=0;i<Cddb::NUM_VALID_CATEGORIES;++i) {
+		if(Cddb::VALID_CATEGORIES[i] == category) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+std::shared_ptr<CddbMirror> CddbMirror::shared()
+{
+	static std::shared_ptr<CddbMirror> mirror = []() -> std::shared_ptr<CddbMirror> {
+		const char * dir = std::getenv("CDDB_MIRROR");
+		if(dir == nullptr or *dir == '\0') {
+			return nullptr;
+		}
+		try {
+			return std::make_shared<CddbMirror>(dir);
+		} catch(const std::exception & e) {
+			std::cerr << "Unable to open the CDDB mirror: " << e.what() << std::endl;
+			return nullptr;
+		}
+	}();
+	return mirror;
+}
+
+size_t CddbMirror::build(const std::string & archive, const std::string & dir)
+{
+	namespace fs = std::filesystem;
+	fs::create_directories(dir);
+	const std::string dataPath = (fs::path(dir) / DATA_FILE).string();
+	const std::string indexPath = (fs::path(dir) / INDEX_FILE).string();
+	const std::string tocsPath = (fs::path(dir) / TOCS_FILE).string();
+
+	// Write new files next to the old ones, and swap them in at the end
+	std::ofstream data(dataPath + ".tmp", std::ios::binary | std::ios::trunc);
+	if(not data) {
+		throw std::runtime_error("Unable to write " + dataPath + ".tmp.");
+	}
+
+	std::vector<IndexEntry> entries;
+	TocMatcher tocs;
+	std::vector<std::pair<uint32_t, uint8_t>> fileKeys;	// The disc ID and category of each file
+	uint64_t offset = 0;
+	size_t files = 0;
+	TarReader tar(archive);
+	std::string name;
+	std::string content;
+	while(tar.next(name, content)) {
+		if(content.compare(0, 6, "# xmcd") != 0 or content.size() > UINT32_MAX) {
+			continue;
+		}
+
+		// The files are laid out as category/discid
+		fs::path path(name);
+		int category = categoryIndex(path.parent_path().filename().string());
+		XmcdEntry entry;
+		if(category < 0 or not XmcdParser::parse(content, entry)) {
+			continue;
+		}
+
+		// The file is found by its name, and by the disc IDs it lists
+		std::vector<uint32_t> discIds;
+		entry.discIds.push_back(path.filename().string());
+		for(const auto & text : entry.discIds) {
+			uint32_t discId;
+			if(parseDiscId(text, discId)
+			   and std::find(discIds.begin(), discIds.end(), discId) == discIds.end()) {
+				discIds.push_back(discId);
+			}
+		}
+		if(discIds.empty()) {
+			continue;
+		}
+
+		for(auto discId : discIds) {
+			entries.push_back({
+				discId,
+				static_cast<uint8_t>(category),
+				static_cast<uint8_t>(std::min<size_t>(entry.offsets.size(), UINT8_MAX)),
+				0,
+				static_cast<uint32_t>(content.size()),
+				0,
+				offset
+			});
+		}
+		if(not entry.offsets.empty() and entry.discLength * Cddb::CD_FRAME > entry.offsets.back()) {
+			Toc toc;
+			toc.offsets = entry.offsets;
+			toc.leadOut = entry.discLength * Cddb::CD_FRAME;
+			tocs.add(toc, fileKeys.size());
+			fileKeys.emplace_back(discIds.front(), static_cast<uint8_t>(category));
+		}
+		data.write(content.data(), content.size());
+		offset += content.size();
+		++files;
+	}
+	tar.close();
+	data.close();
+	if(not data) {
+		throw std::runtime_error("Unable to write " + dataPath + ".tmp.");
+	}
+	if(files == 0) {
+		// Don't replace a mirror with an empty one, e.g. from the wrong archive
+		std::error_code ec;
+		fs::remove(dataPath + ".tmp", ec);
+		throw std::runtime_error("No xmcd entries were found in " + archive
+								 + ", so the mirror is left as it was.");
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const IndexEntry & a, const IndexEntry & b) {
+		return a.discId < b.discId or (a.discId == b.discId and a.category < b.category);
+	});
+
+	// Tag each TOC with the position of its entry's record in the sorted index
+	std::vector<uint32_t> positions;
+	positions.reserve(fileKeys.size());
+	for(const auto & [discId, category] : fileKeys) {
+		auto it = std::lower_bound(entries.begin(), entries.end(), std::make_pair(discId, category),
+								   [](const IndexEntry & a, const std::pair<uint32_t, uint8_t> & key) {
+			return a.discId < key.first or (a.discId == key.first and a.category < key.second);
+		});
+		positions.push_back(it - entries.begin());
+	}
+	tocs.retag(positions);
+	tocs.save(tocsPath + ".tmp");
+
+	IndexHeader header { INDEX_MAGIC, INDEX_VERSION, entries.size() };
+	std::ofstream index(indexPath + ".tmp", std::ios::binary | std::ios::trunc);
+	index.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	index.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(IndexEntry));
+	index.close();
+	if(not index) {
+		throw std::runtime_error("Unable to write " + indexPath + ".tmp.");
+	}
+
+	fs::rename(dataPath + ".tmp", dataPath);
+	fs::rename(indexPath + ".tmp", indexPath);
+	fs::rename(tocsPath + ".tmp", tocsPath);
+	return files;
+}
+
+CddbMirror::CddbMirror(const std::string & dir)
+{
+	namespace fs = std::filesystem;
+	_index = map((fs::path(dir) / INDEX_FILE).string(), _indexSize);
+	try {
+		_data = map((fs::path(dir) / DATA_FILE).string(), _dataSize);
+
+		IndexHeader header;
+		if(_indexSize < sizeof(header)) {
+			throw std::runtime_error("The CDDB mirror index is damaged.");
+		}
+		std::memcpy(&header, _index, sizeof(header));
+		if(header.magic != INDEX_MAGIC or header.version != INDEX_VERSION
+		   or sizeof(header) + header.count * sizeof(IndexEntry) != _indexSize) {
+			throw std::runtime_error("The CDDB mirror index is damaged.");
+		}
+		_entries = reinterpret_cast<const IndexEntry *>(_index + sizeof(header));
+		_count = header.count;
+
+		// Mirrors built before inexact matching have no TOCs
+		if(fs::exists(fs::path(dir) / TOCS_FILE)) {
+			_tocs = std::make_unique<TocMatcher>((fs::path(dir) / TOCS_FILE).string());
+		}
+	} catch(...) {
+		if(_index != nullptr) {
+			munmap(const_cast<char *>(_index), _indexSize);
+		}
+		if(_data != nullptr) {
+			munmap(const_cast<char *>(_data), _dataSize);
+		}
+		throw;
+	}
+}
+
+CddbMirror::~CddbMirror()
+{
+	if(_index != nullptr) {
+		munmap(const_cast<char *>(_index), _indexSize);
+	}
+	if(_data != nullptr) {
+		munmap(const_cast<char *>(_data), _dataSize);
+	}
+}
+
+std::string CddbMirror::query(const std::string & discId) const
+{
+	std::istringstream iss(discId);
+	std::string id;
+	int numTracks = 0;
+	uint32_t value;
+	if(not (iss >> id >> numTracks) or not parseDiscId(id, value)) {
+		return "500 Command syntax error.\r\n";
+	}
+
+	std::vector<std::string> matches;
+	auto [first, last] = find(value);
+	for(auto it = first; it != last; ++it) {
+		if(it->numTracks == std::min(numTracks, static_cast<int>(UINT8_MAX))
+		   and it->offset + it->length <= _dataSize) {
+			matches.push_back(matchLine(*it));
+		}
+	}
+
+	if(matches.empty() and _tocs) {
+		Toc toc;
+		try {
+			toc = Toc::parse(discId);
+		} catch(const CddbError & e) {
+			return "500 Command syntax error.\r\n";
+		}
+		for(const auto & match : _tocs->rank(toc)) {
+			if(match.tag < _count and _entries[match.tag].offset + _entries[match.tag].length <= _dataSize) {
+				matches.push_back(matchLine(_entries[match.tag]));
+			}
+		}
+		if(not matches.empty()) {
+			std::string response = "211 Found inexact matches, list follows (until terminating `.')\r\n";
+			for(const auto & match : matches) {
+				response += match + "\r\n";
+			}
+			return response + ".\r\n";
+		}
+	}
+
+	if(matches.empty()) {
+		return "202 No match found.\r\n";
+	} else if(matches.size() == 1) {
+		return "200 " + matches[0] + "\r\n";
+	}
+	std::string response = "210 Found exact matches, list follows (until terminating `.')\r\n";
+	for(const auto & match : matches) {
+		response += match + "\r\n";
+	}
+	return response + ".\r\n";
+}
+
+std::string CddbMirror::read(const std::string & category, const std::string & discId) const
+{
+	uint32_t value;
+	std::string xmcd;
+	if(not parseDiscId(discId, value) or not entry(category, value, xmcd)) {
+		return "401 " + category + " " + discId + " No such CD entry in database.\r\n";
+	}
+	std::string response = "210 " + category + " " + discId
+						 + " CD database entry follows (until terminating `.')\r\n";
+	response += xmcd;
+	if(not xmcd.empty() and xmcd.back() != '\n') {
+		response += "\r\n";
+	}
+	return response + ".\r\n";
+}
+
+bool CddbMirror::entry(const std::string & category, uint32_t discId, std::string & xmcd) const
+{
+	int index = categoryIndex(category);
+	auto [first, last] = find(discId);
+	for(auto it = first; it != last; ++it) {
+		if(it->category == index and it->offset + it->length <= _dataSize) {
+			xmcd.assign(_data + it->offset, it->length);
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string CddbMirror::matchLine(const IndexEntry & record) const
+{
+	XmcdEntry entry;
+	XmcdParser::parse(std::string_view(_data + record.offset, record.length), entry);
+	char discId[9];
+	std::snprintf(discId, sizeof(discId), "%08x", record.discId);
+	std::string dtitle = entry.artist == entry.title
+						 ? entry.title
+						 : entry.artist + " / " + entry.title;
+	return Cddb::VALID_CATEGORIES[record.category] + " " + discId + " " + dtitle;
+}
+
+std::pair<const CddbMirror::IndexEntry *, const CddbMirror::IndexEntry *>
+CddbMirror::find(uint32_t discId) const
+{
+	return std::equal_range(_entries, _entries + _count, discId, [](const auto & a, const auto & b) {
+		if constexpr(std::is_same_v<std::decay_t<decltype(a)>, uint32_t>) {
+			return a < b.discId;
+		} else {
+			return a.discId < b;
+		}
+	});
+}
+
+const char * CddbMirror::map(const std::string & path, size_t & size)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		throw std::runtime_error("Unable to open " + path + ": " + std::strerror(errno));
+	}
+	struct stat st;
+	if(::fstat(fd, &st) != 0) {
+		::close(fd);
+		throw std::runtime_error("Unable to read " + path + ": " + std::strerror(errno));
+	}
+	size = st.st_size;
+	if(size == 0) {
+		::close(fd);
+		return nullptr;
+	}
+	void * mapped = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);	// The mapping keeps the file open
+	if(mapped == MAP_FAILED) {
+		throw std::runtime_error("Unable to map " + path + ": " + std::strerror(errno));
+	}
+	return static_cast<const char *>(mapped);
+}
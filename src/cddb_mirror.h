@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "toc_matcher.h"
+
+/// A local, read-only mirror of the CDDB, built from a freedb or gnudb dump, so
+/// that discs can be looked up without a network connection. A mirror is a
+/// directory of three files:
+/// - `cddb.data` holds the xmcd files of the dump, one after the other.
+/// - `cddb.index` holds an IndexEntry for every disc ID of every entry,
+///   sorted by disc ID, which points at the entry in the data file.
+/// - `cddb.tocs` holds the table of contents of every entry, for a
+///   TocMatcher, so that a disc with no exact match gets the closest entries
+///   as inexact matches (code 211). A mirror without this file only gives
+///   exact matches.
+///
+/// The files are memory mapped, so a mirror opens instantly whatever its
+/// size, and a lookup is a binary search of the index followed by a copy of
+/// the entry. The pages that are touched stay in the page cache, so a query
+/// and read of a disc take a few microseconds.
+///
+/// A mirror answers the `cddb query` and `cddb read` commands with the same
+/// responses as a CDDB server, so that a CddbClient can use it in place of
+/// the server (see `CDDB_MIRROR`), and so that it can be served to other
+/// machines over HTTP by a MirrorServer.
+///
+/// A mirror may be shared between threads.
+class CddbMirror
+{
+  public:
+
+	/// The name of the index file in the mirror directory.
+	static const std::string INDEX_FILE;
+
+	/// The name of the data file in the mirror directory.
+	static const std::string DATA_FILE;
+
+	/// The name of the TOC file in the mirror directory.
+	static const std::string TOCS_FILE;
+
+	/// The mirror used by the application, if the `CDDB_MIRROR` environment
+	/// variable is set to the directory of a mirror. It is opened on first use.
+	/// @return Returns the mirror, or null if there isn't one.
+	static std::shared_ptr<CddbMirror> shared();
+
+	/// Build a mirror from a dump. Any mirror that is already in the
+	/// directory is replaced, unless the dump has no entries.
+	/// @param archive The path of the dump, see TarReader.
+	/// @param dir The directory to build the mirror in, which is created if
+	///        necessary.
+	/// @return Returns the number of entries in the mirror.
+	/// @throws std::runtime_error If the dump can't be read or has no
+	///         entries, or the mirror can't be written.
+	static size_t build(const std::string & archive, const std::string & dir);
+
+	/// Open a mirror.
+	/// @param dir The directory of the mirror.
+	/// @throws std::runtime_error If the mirror can't be opened, or is damaged.
+	explicit CddbMirror(const std::string & dir);
+
+	/// Unmap the mirror.
+	~CddbMirror();
+
+	CddbMirror(const CddbMirror &) = delete;
+	CddbMirror & operator=(const CddbMirror &) = delete;
+
+	/// The number of disc IDs in the index.
+	inline size_t size() const { return _count; }
+
+	/// Answer a `cddb query` command. The entries whose disc ID and number of
+	/// tracks match are exact matches. If there are none, then the entries
+	/// whose TOCs are closest to the disc are inexact matches, closest first.
+	/// @param discId The disc ID, number of tracks, track frame offsets and
+	///        total length in seconds, separated by spaces, as printed by
+	///        `cd-discid`.
+	/// @return Returns the response, with code 200, 210, 211 or 202 (no
+	///         match), or 500 if the disc ID can't be parsed.
+	std::string query(const std::string & discId) const;
+
+	/// Answer a `cddb read` command.
+	/// @param category The CDDB category of the entry.
+	/// @param discId The disc ID of the entry.
+	/// @return Returns the response, with code 210 followed by the xmcd file,
+	///         or 401 if there is no such entry.
+	std::string read(const std::string & category, const std::string & discId) const;
+
+	/// Look up the xmcd file of an entry.
+	/// @param category The CDDB category of the entry.
+	/// @param discId The disc ID of the entry.
+	/// @param xmcd Set to the xmcd file, if it was found.
+	/// @return Returns false if there is no such entry.
+	bool entry(const std::string & category, uint32_t discId, std::string & xmcd) const;
+
+  private:
+
+	/// The header at the start of the index file.
+	struct IndexHeader
+	{
+		uint32_t magic;			///< Always INDEX_MAGIC.
+		uint32_t version;		///< Always INDEX_VERSION.
+		uint64_t count;			///< The number of IndexEntry records that follow.
+	};
+
+	/// One disc ID of an entry. An entry with several disc IDs has several
+	/// records, all pointing at the same xmcd file.
+	struct IndexEntry
+	{
+		uint32_t discId;		///< The disc ID.
+		uint8_t category;		///< The index of the category in Cddb::VALID_CATEGORIES.
+		uint8_t numTracks;		///< The number of tracks, from the track frame offsets.
+		uint16_t reserved;		///< Zero.
+		uint32_t length;		///< The length of the xmcd file.
+		uint32_t reserved2;		///< Zero.
+		uint64_t offset;		///< The offset of the xmcd file in the data file.
+	};
+
+	static const uint32_t INDEX_MAGIC = 0x696d6463;		///< "cdmi"
+	static const uint32_t INDEX_VERSION = 1;			///< The layout of the index.
+
+	/// Format a line of a query response for a record, whose entry must be in
+	/// the data file.
+	/// @param record The record.
+	/// @return Returns the category, disc ID and DTITLE of the entry.
+	std::string matchLine(const IndexEntry & record) const;
+
+	/// Find the records of a disc ID.
+	/// @param discId The disc ID.
+	/// @return Returns the first and one past the last record.
+	std::pair<const IndexEntry *, const IndexEntry *> find(uint32_t discId) const;
+
+	/// Map a file read-only.
+	/// @param path The path of the file.
+	/// @param size Set to the size of the file.
+	/// @return Returns the mapping, or null if the file is empty.
+	/// @throws std::runtime_error If the file can't be mapped.
+	static const char * map(const std::string & path, size_t & size);
+
+	const char * _index { nullptr };			///< The mapped index file.
+	size_t _indexSize { 0 };					///< The size of the index file.
+	const char * _data { nullptr };				///< The mapped data file.
+	size_t _dataSize { 0 };						///< The size of the data file.
+	const IndexEntry * _entries { nullptr };	///< The records of the index.
+	size_t _count { 0 };						///< The number of records.
+	std::unique_ptr<TocMatcher> _tocs;			///< The TOCs of the entries, tagged by record, may be null.
+};
@@ -0,0 +1,292 @@
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) or defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUMS_X86
+#endif
+
+#include "checksums.h"
+
+/// The CRC32 polynomial of zlib, bit reflected.
+static const uint32_t CRC_POLYNOMIAL = 0xedb88320;
+
+/// Sum the weighted samples of a stretch of a track, for AccurateRip.
+/// @param samples The samples.
+/// @param count The number of samples.
+/// @param mult The weight of the first sample, i.e., its position in the
+///        track from 1. Each sample after it weighs one more.
+/// @param lo Set to the sum of the low 32 bits of the products.
+/// @param hi Set to the sum of the high 32 bits of the products.
+typedef void (*SumKernel)(const char * samples, size_t count, uint32_t mult,
+						  uint32_t & lo, uint32_t & hi);
+
+/// The table of the byte at a time CRC32, built once.
+/// @return Returns the CRC of each byte value.
+static const std::array<uint32_t, 256> & crcTable()
+{
+	static const std::array<uint32_t, 256> table = [] {
+		std::array<uint32_t, 256> t;
+		for(uint32_t i=0;i<256;++i) {
+			uint32_t c = i;
+			for(int bit=0;bit<8;++bit) {
+				c = c & 1 ? CRC_POLYNOMIAL ^ (c >> 1) : c >> 1;
+			}
+			t[i] = c;
+		}
+		return t;
+	}();
+	return table;
+}
+
+/// Run the CRC32 a byte at a time.
+/// @param data The data.
+/// @param bytes The size of the data.
+/// @param crc The CRC so far, not inverted.
+/// @return Returns the CRC, not inverted.
+static uint32_t scalarCrc(const char * data, size_t bytes, uint32_t crc)
+{
+	const auto & table = crcTable();
+	for(size_t i=0;i<bytes;++i) {
+		crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+/// The scalar AccurateRip sums, which are used if the processor has no AVX2,
+/// and which the vectorized kernel must agree with.
+static void scalarSums(const char * samples, size_t count, uint32_t mult,
+					   uint32_t & lo, uint32_t & hi)
+{
+	lo = 0;
+	hi = 0;
+	for(size_t i=0;i<count;++i,++mult) {
+		uint32_t sample;
+		std::memcpy(&sample, samples + i * 4, 4);
+		uint64_t product = static_cast<uint64_t>(sample) * mult;
+		lo += static_cast<uint32_t>(product);
+		hi += static_cast<uint32_t>(product >> 32);
+	}
+}
+
+#ifdef CHECKSUMS_X86
+/// Load 16 bytes.
+/// @param p Where from, unaligned.
+/// @return Returns the bytes.
+__attribute__((target("sse2")))
+static inline __m128i load(const char * p)
+{
+	return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+/// Fold 128 bits of a CRC over the next 128 bits of data.
+/// @param x The CRC so far.
+/// @param next The next data.
+/// @param k The folding constants.
+/// @return Returns the CRC so far, with the data.
+__attribute__((target("pclmul,sse4.1")))
+static inline __m128i fold(__m128i x, __m128i next, __m128i k)
+{
+	__m128i low = _mm_clmulepi64_si128(x, k, 0x00);
+	return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), next), low);
+}
+
+/// Fold the CRC32 of data with carry-less multiplication, 64 bytes at a time,
+/// as in Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+/// Instruction", with the constants for the reflected zlib polynomial.
+/// @param data The data.
+/// @param bytes The size of the data, at least 64 and a multiple of 16.
+/// @param crc The CRC so far, not inverted.
+/// @return Returns the CRC, not inverted.
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t clmulCrc(const char * data, size_t bytes, uint32_t crc)
+{
+	alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+	alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+	alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+	alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+	// Four lanes of 128 bits, the first with the CRC so far
+	__m128i x1 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(crc));
+	__m128i x2 = load(data + 16);
+	__m128i x3 = load(data + 32);
+	__m128i x4 = load(data + 48);
+	data += 64;
+	bytes -= 64;
+
+	// Fold 64 bytes at a time into the lanes
+	__m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+	while(bytes >= 64) {
+		x1 = fold(x1, load(data), k);
+		x2 = fold(x2, load(data + 16), k);
+		x3 = fold(x3, load(data + 32), k);
+		x4 = fold(x4, load(data + 48), k);
+		data += 64;
+		bytes -= 64;
+	}
+
+	// Fold the lanes into one, then the rest 16 bytes at a time
+	k = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+	x1 = fold(x1, x2, k);
+	x1 = fold(x1, x3, k);
+	x1 = fold(x1, x4, k);
+	while(bytes >= 16) {
+		x1 = fold(x1, load(data), k);
+		data += 16;
+		bytes -= 16;
+	}
+
+	// Fold 128 bits into 64
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	k = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduce to 32 bits
+	k = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), k, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return _mm_extract_epi32(x1, 1);
+}
+
+/// The AVX2 AccurateRip sums, which work on eight samples at a time. The
+/// products are 64 bits, so the even and odd samples are multiplied apart,
+/// and the low and high halves are summed in 64-bit lanes, of which only the
+/// low 32 bits are kept.
+__attribute__((target("avx2")))
+static void avx2Sums(const char * samples, size_t count, uint32_t mult,
+					 uint32_t & lo, uint32_t & hi)
+{
+	__m256i weights = _mm256_add_epi32(_mm256_set1_epi32(mult), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	const __m256i step = _mm256_set1_epi32(8);
+	__m256i los = _mm256_setzero_si256();
+	__m256i his = _mm256_setzero_si256();
+	size_t i = 0;
+	for(;i+8<=count;i+=8) {
+		__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(samples + i * 4));
+		__m256i even = _mm256_mul_epu32(s, weights);
+		__m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(s, 32), _mm256_srli_epi64(weights, 32));
+		los = _mm256_add_epi64(los, _mm256_add_epi64(even, odd));
+		his = _mm256_add_epi64(his, _mm256_add_epi64(_mm256_srli_epi64(even, 32),
+													 _mm256_srli_epi64(odd, 32)));
+		weights = _mm256_add_epi32(weights, step);
+	}
+
+	// Add up the low 32 bits of the four lanes, then the samples left over
+	alignas(32) uint64_t lanes[8];
+	_mm256_store_si256(reinterpret_cast<__m256i *>(lanes), los);
+	_mm256_store_si256(reinterpret_cast<__m256i *>(lanes + 4), his);
+	scalarSums(samples + i * 4, count - i, mult + i, lo, hi);
+	for(int l=0;l<4;++l) {
+		lo += static_cast<uint32_t>(lanes[l]);
+		hi += static_cast<uint32_t>(lanes[l + 4]);
+	}
+}
+#endif
+
+/// Check if the processor can fold a CRC with PCLMULQDQ.
+/// @return Returns true if clmulCrc() can be used.
+static bool hasClmul()
+{
+#ifdef CHECKSUMS_X86
+	static const bool has = __builtin_cpu_supports("pclmul") and __builtin_cpu_supports("sse4.1");
+	return has;
+#else
+	return false;
+#endif
+}
+
+/// Choose the AccurateRip kernel for this processor, once.
+/// @return Returns the fastest kernel.
+static SumKernel sumKernel()
+{
+	static const SumKernel chosen = [] {
+#ifdef CHECKSUMS_X86
+		if(__builtin_cpu_supports("avx2")) {
+			return &avx2Sums;
+		}
+#endif
+		return &scalarSums;
+	}();
+	return chosen;
+}
+
+/// The positions of the samples of a track that AccurateRip counts.
+/// @param bytes The size of the audio of the track.
+/// @param first True if this is the first track of the disc.
+/// @param last True if this is the last track of the disc.
+/// @param from Set to the position of the first sample counted, from 1.
+/// @param to Set to the position of the last sample counted, which is less
+///        than `from` if there are none.
+static void countedSamples(size_t bytes, bool first, bool last, size_t & from, size_t & to)
+{
+	size_t samples = bytes / 4;
+	from = first ? Checksums::SKIPPED_SAMPLES : 1;
+	to = last ? (samples > Checksums::SKIPPED_SAMPLES ? samples - Checksums::SKIPPED_SAMPLES : 0)
+			  : samples;
+}
+
+/// Compute the AccurateRip checksums with a kernel, as
+/// Checksums::accurateRip().
+/// @param kernel The kernel.
+static void accurateRip(SumKernel kernel, const char * audio, size_t bytes, bool first, bool last,
+						uint32_t & v1, uint32_t & v2)
+{
+	size_t from, to;
+	countedSamples(bytes, first, last, from, to);
+	uint32_t lo = 0;
+	uint32_t hi = 0;
+	if(to >= from) {
+		kernel(audio + (from - 1) * 4, to - from + 1, from, lo, hi);
+	}
+	v1 = lo;
+	v2 = lo + hi;
+}
+
+bool Checksums::isVectorized()
+{
+	return hasClmul() or sumKernel() != &scalarSums;
+}
+
+TrackChecksums Checksums::track(const char * audio, size_t bytes, bool first, bool last)
+{
+	TrackChecksums checksums;
+	checksums.crc32 = crc32(audio, bytes);
+	accurateRip(audio, bytes, first, last, checksums.accurateRipV1, checksums.accurateRipV2);
+	return checksums;
+}
+
+uint32_t Checksums::crc32(const char * data, size_t bytes)
+{
+	uint32_t crc = ~0u;
+#ifdef CHECKSUMS_X86
+	if(bytes >= 64 and hasClmul()) {
+		size_t folded = bytes & ~static_cast<size_t>(15);
+		crc = clmulCrc(data, folded, crc);
+		data += folded;
+		bytes -= folded;
+	}
+#endif
+	return ~scalarCrc(data, bytes, crc);
+}
+
+void Checksums::accurateRip(const char * audio, size_t bytes, bool first, bool last,
+							uint32_t & v1, uint32_t & v2)
+{
+	::accurateRip(sumKernel(), audio, bytes, first, last, v1, v2);
+}
+
+uint32_t Checksums::scalarCrc32(const char * data, size_t bytes)
+{
+	return ~scalarCrc(data, bytes, ~0u);
+}
+
+void Checksums::scalarAccurateRip(const char * audio, size_t bytes, bool first, bool last,
+								  uint32_t & v1, uint32_t & v2)
+{
+	::accurateRip(&scalarSums, audio, bytes, first, last, v1, v2);
+}
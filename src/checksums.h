@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/// The checksums of the audio of a track, by which a rip can be verified.
+struct TrackChecksums
+{
+	uint32_t crc32 { 0 };			///< The CRC32 of the whole track, as EAC's "Copy CRC".
+	uint32_t accurateRipV1 { 0 };	///< The AccurateRip checksum, version 1.
+	uint32_t accurateRipV2 { 0 };	///< The AccurateRip checksum, version 2.
+};
+
+/// Compute the checksums of ripped tracks, i.e., the CRC32 of the audio, and
+/// the AccurateRip checksums that are compared with other rips of the same
+/// disc. The audio is 16-bit little-endian stereo, so each sample is a 32-bit
+/// word, the left channel in the low half.
+///
+/// The AccurateRip checksums weight each sample by its position in the track,
+/// from 1, and add up the products: version 1 adds up the low 32 bits of each
+/// product, and version 2 the low and the high 32 bits. The first
+/// #SKIPPED_SAMPLES of the first track of a disc and the last of the last
+/// track are left out, since drives with different offsets can't read them
+/// alike.
+///
+/// The sums are computed by vectorized kernels when the processor has them,
+/// PCLMULQDQ folding for the CRC32 and AVX2 for AccurateRip, otherwise by
+/// scalar loops. The scalar loops are the reference that the kernels must
+/// agree with, and are public so that they can be compared, see
+/// `bench/cdimport_bench.cpp`.
+class Checksums
+{
+  public:
+
+	/// The checksums of each track of a disc, or none for a track that
+	/// wasn't ripped, e.g. a data track.
+	typedef std::vector<std::optional<TrackChecksums>> List;
+
+	/// The samples left out of AccurateRip at either end of a disc, five
+	/// frames' worth.
+	static const size_t SKIPPED_SAMPLES = 5 * 588;
+
+	/// Check if the vectorized kernels are used on this processor.
+	/// @return Returns true if either of the kernels is vectorized.
+	static bool isVectorized();
+
+	/// Compute all of the checksums of a track.
+	/// @param audio The audio of the track.
+	/// @param bytes The size of the audio, a multiple of 4.
+	/// @param first True if this is the first track of the disc.
+	/// @param last True if this is the last track of the disc.
+	/// @return Returns the checksums.
+	static TrackChecksums track(const char * audio, size_t bytes, bool first, bool last);
+
+	/// Compute a CRC32, with the polynomial of zlib and EAC.
+	/// @param data The data.
+	/// @param bytes The size of the data.
+	/// @return Returns the CRC32.
+	static uint32_t crc32(const char * data, size_t bytes);
+
+	/// Compute the AccurateRip checksums of a track.
+	/// @param audio The audio of the track.
+	/// @param bytes The size of the audio, a multiple of 4.
+	/// @param first True if this is the first track of the disc.
+	/// @param last True if this is the last track of the disc.
+	/// @param v1 Set to the version 1 checksum.
+	/// @param v2 Set to the version 2 checksum.
+	static void accurateRip(const char * audio, size_t bytes, bool first, bool last,
+							uint32_t & v1, uint32_t & v2);
+
+	/// The scalar reference of crc32(), a byte at a time.
+	static uint32_t scalarCrc32(const char * data, size_t bytes);
+
+	/// The scalar reference of accurateRip(), a sample at a time.
+	static void scalarAccurateRip(const char * audio, size_t bytes, bool first, bool last,
+								  uint32_t & v1, uint32_t & v2);
+};
@@ -0,0 +1,60 @@
+#include <climits>		// CDSL_CURRENT is INT_MAX
+#include <iostream>
+
+#include <fcntl.h>			// Linux only, the CDROM ioctls
+#include <linux/cdrom.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "drive_monitor.h"
+
+DriveMonitor::DriveMonitor(const std::string & device, QObject * parent)
+  : QObject(parent), _device(device)
+{
+}
+
+bool DriveMonitor::hasDisc(const std::string & device)
+{
+	struct stat st;
+	if(::stat(device.c_str(), &st) == 0 and S_ISREG(st.st_mode)) {
+		return st.st_size > 0;
+	}
+
+	// Non-blocking, so that opening doesn't wait for the drive to spin up
+	int fd = ::open(device.c_str(), O_RDONLY | O_NONBLOCK);
+	if(fd < 0) {
+		return false;
+	}
+	bool present = ioctl(fd, CDROM_DRIVE_STATUS, CDSL_CURRENT) == CDS_DISC_OK;
+	::close(fd);
+	return present;
+}
+
+void DriveMonitor::start()
+{
+	if(_timer == nullptr) {
+		_timer = new QTimer(this);
+		QObject::connect(_timer, &QTimer::timeout, this, &DriveMonitor::poll);
+	}
+	_timer->start(POLL_INTERVAL);
+	poll();
+}
+
+void DriveMonitor::poll()
+{
+	bool present = hasDisc(_device);
+	if(present == _present) {
+		return;
+	}
+	_present = present;
+#ifdef DEBUG
+	std::cout << "A disc was " << (present ? "inserted into " : "removed from ") << _device
+			  << "." << std::endl;
+#endif
+	if(present) {
+		emit discInserted();
+	} else {
+		emit discRemoved();
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+
+#include <QObject>
+#include <QTimer>
+
+#include "cddb.h"
+
+/// Watch a CD drive for discs being inserted and removed, so that a lookup can
+/// be started as soon as a disc goes in, before the user asks for it. The
+/// drive is polled with the `CDROM_DRIVE_STATUS` ioctl, which doesn't spin the
+/// disc up, so polling is cheap.
+///
+/// A regular file stands in for the drive the same way as for TocSource, and
+/// holds a disc whenever it is not empty, e.g. for testing with
+/// `echo "$(cd-discid)" > fake-drive`.
+///
+/// An instance of this class is meant to be moved to a QThread, with start()
+/// connected to the thread's `started` signal, so that a slow drive doesn't
+/// hold up the user interface.
+class DriveMonitor : public QObject
+{
+	Q_OBJECT
+
+  public:
+
+	/// The time between polls of the drive, in milliseconds.
+	static const int POLL_INTERVAL = 1000;
+
+	/// Construct the monitor with an optional parent. The drive isn't polled
+	/// until start() is called.
+	/// @param device The device name of the drive, or a file that stands in
+	///        for it.
+	/// @param parent Must be nullptr if the object is to be moved to a thread.
+	explicit DriveMonitor(const std::string & device = Cddb::CD_DEVICE, QObject * parent = nullptr);
+
+	/// Check if there is a disc in a drive.
+	/// @param device The device name of the drive, or a file that stands in
+	///        for it.
+	/// @return Returns true if the drive reports a disc, false if it is
+	///         empty, open, not ready or can't be opened.
+	static bool hasDisc(const std::string & device);
+
+  public slots:
+
+	/// Start polling the drive. A disc that is already in the drive is
+	/// reported as inserted by the first poll.
+	void start();
+
+	/// Poll the drive once, and report any change.
+	void poll();
+
+  signals:
+
+	/// A disc has gone into the drive.
+	void discInserted();
+
+	/// The disc has been taken out, or the tray has been opened.
+	void discRemoved();
+
+  private:
+
+	std::string _device;			///< The device name of the drive.
+	QTimer * _timer { nullptr };	///< Fires every #POLL_INTERVAL, owned by this.
+	bool _present { false };		///< Was there a disc at the last poll?
+};
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <thread>
+
+#include "dump_loader.h"
+
+#include "batch_import.h"
+#include "cddb.h"
+#include "tar_reader.h"
+#include "xmcd.h"
+
+using Clock = std::chrono::steady_clock;
+
+int DumpLoader::main(int argc, char * argv[])
+{
+	int jobs = std::max(1u, std::thread::hardware_concurrency());
+	std::string checkpoint;
+	std::string archive;
+	for(int i=0;i<argc;++i) {
+		std::string arg = argv[i];
+		if(arg == "--jobs" and i + 1 < argc) {
+			jobs = std::max(1, std::atoi(argv[++i]));
+		} else if(arg == "--checkpoint" and i + 1 < argc) {
+			checkpoint = argv[++i];
+		} else if(archive.empty()) {
+			archive = arg;
+		} else {
+			archive.clear();
+			break;
+		}
+	}
+	if(archive.empty()) {
+		std::cerr << "Usage: cdimport --load-dump [--jobs N] [--checkpoint NAME] ARCHIVE"
+				  << std::endl;
+		return 1;
+	}
+	if(checkpoint.empty()) {
+		checkpoint = std::filesystem::path(archive).filename().string();
+	}
+
+	DumpLoader loader(archive, jobs, checkpoint);
+	return loader.run() ? 0 : 1;
+}
+
+DumpLoader::DumpLoader(const std::string & archive, int jobs, const std::string & checkpoint)
+  : _archive(archive), _jobs(jobs), _checkpoint(checkpoint),
+	_chunks(QUEUE_CHUNKS * jobs), _rows(QUEUE_CHUNKS * jobs)
+{
+}
+
+bool DumpLoader::run()
+{
+	if(not PgConn::queryLoadProgress(_checkpoint, _resumeFrom)) {
+		std::cerr << "Unable to read the progress of " << _checkpoint << "." << std::endl;
+		return false;
+	}
+	if(_resumeFrom > 0) {
+		std::cout << "Resuming " << _checkpoint << " after " << _resumeFrom << " files."
+				  << std::endl;
+	}
+
+	auto start = Clock::now();
+	_parsers = _jobs;
+	std::vector<std::thread> threads;
+	threads.emplace_back(&DumpLoader::read, this);
+	for(int i=0;i<_jobs;++i) {
+		threads.emplace_back(&DumpLoader::parse, this);
+	}
+	write();
+	for(auto & thread : threads) {
+		thread.join();
+	}
+
+	std::chrono::duration<double> elapsed = Clock::now() - start;
+	double seconds = std::max(elapsed.count(), 1e-9);
+	size_t rows = _albums + _tracks;
+	std::cout << std::fixed << std::setprecision(2)
+			  << (_failed ? "Stopped" : "Loaded") << " " << _files << " files in " << seconds
+			  << " s, " << rows / seconds << " rows/s." << std::endl
+			  << "  albums:  " << _albums << std::endl
+			  << "  tracks:  " << _tracks << std::endl
+			  << "  skipped: " << _skipped << std::endl;
+	return not _failed;
+}
+
+void DumpLoader::read()
+{
+	try {
+		TarReader tar(_archive);
+		size_t count = 0;
+		size_t sequence = 0;
+		Chunk chunk { sequence, 0, {} };
+		std::string name;
+		std::string content;
+		while(tar.next(name, content)) {
+			// Files loaded by an earlier run are still read, but not parsed
+			if(++count <= _resumeFrom) {
+				continue;
+			}
+			chunk.files.emplace_back(std::move(name), std::move(content));
+			if(chunk.files.size() == CHUNK_SIZE) {
+				chunk.end = count;
+				if(not _chunks.push(std::move(chunk))) {
+					return;
+				}
+				chunk = Chunk { ++sequence, 0, {} };
+				chunk.files.reserve(CHUNK_SIZE);
+			}
+		}
+		// The end of what the decompressor wrote is only the end of the
+		// archive if it succeeded
+		tar.close();
+		if(not chunk.files.empty()) {
+			chunk.end = count;
+			_chunks.push(std::move(chunk));
+		}
+	} catch(const std::exception & e) {
+		std::cerr << _archive << ": " << e.what() << std::endl;
+		stop();
+	}
+	_chunks.close();
+}
+
+void DumpLoader::parse()
+{
+	Chunk chunk;
+	while(_chunks.pop(chunk)) {
+		if(not waitForWriter(chunk.sequence)) {
+			break;
+		}
+		Rows rows { chunk.sequence, chunk.end, {}, 0, 0 };
+		rows.cds.reserve(chunk.files.size());
+		for(const auto & [path, text] : chunk.files) {
+			try {
+				if(parseFile(path, text, rows.cds)) {
+					rows.tracks += rows.cds.back().second.size();
+					continue;
+				}
+			} catch(const std::exception & e) {
+#ifdef DEBUG
+				std::cerr << path << ": " << e.what() << std::endl;
+#endif
+			}
+			++rows.skipped;
+		}
+		if(not _rows.push(std::move(rows))) {
+			break;
+		}
+	}
+
+	// The last parser out tells the writer that there is nothing more coming
+	if(--_parsers == 0) {
+		_rows.close();
+	}
+}
+
+void DumpLoader::write()
+{
+	// The parsers can finish chunks out of order, so hold on to the early ones
+	// until the chunks before them have been written
+	std::map<size_t, Rows> waiting;
+	size_t next = 0;
+	auto lastProgress = Clock::now();
+	auto start = lastProgress;
+
+	Rows rows;
+	while(_rows.pop(rows)) {
+		waiting.emplace(rows.sequence, std::move(rows));
+		for(auto it = waiting.find(next); it != waiting.end(); it = waiting.find(next)) {
+			Rows & ready = it->second;
+			bool loaded = false;
+			try {
+				// The progress is recorded with the rows, even if they are all skipped files
+				loaded = PgConn::loadCds(ready.cds, _checkpoint, ready.end);
+			} catch(const std::exception & e) {
+				std::cerr << e.what() << std::endl;
+			}
+			if(not loaded) {
+				std::cerr << "Failed to load the files up to " << ready.end << "." << std::endl;
+				stop();
+				return;
+			}
+			_files = ready.end - _resumeFrom;
+			_albums += ready.cds.size();
+			_tracks += ready.tracks;
+			_skipped += ready.skipped;
+			waiting.erase(it);
+			++next;
+			{
+				std::lock_guard<std::mutex> lock(_writtenMutex);
+				_written = next;
+			}
+			_writtenChanged.notify_all();
+		}
+
+		auto now = Clock::now();
+		if(now - lastProgress >= std::chrono::seconds(PROGRESS_INTERVAL)) {
+			std::chrono::duration<double> elapsed = now - start;
+			std::cout << std::fixed << std::setprecision(0)
+					  << _files << " files, " << (_albums + _tracks) / elapsed.count()
+					  << " rows/s" << std::endl;
+			lastProgress = now;
+		}
+	}
+}
+
+void DumpLoader::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(_writtenMutex);
+		_failed = true;
+	}
+	_writtenChanged.notify_all();
+	_chunks.close();
+	_rows.close();
+}
+
+bool DumpLoader::waitForWriter(size_t sequence)
+{
+	// The parser of the next chunk to be written never waits, so the writer
+	// always gets it
+	std::unique_lock<std::mutex> lock(_writtenMutex);
+	_writtenChanged.wait(lock, [&] {
+		return _failed or sequence < _written + QUEUE_CHUNKS * _jobs;
+	});
+	return not _failed;
+}
+
+bool DumpLoader::parseFile(const std::string & path, const std::string & text,
+						   PgConn::CdList & cds)
+{
+	if(text.compare(0, 6, "# xmcd") != 0) {
+		return false;	// e.g. the README or COPYING at the top of the archive
+	}
+	XmcdEntry entry;
+	if(not XmcdParser::parse(text, entry) or entry.offsets.empty()) {
+		return false;
+	}
+	Toc toc;
+	toc.offsets = std::move(entry.offsets);
+	toc.leadOut = entry.discLength * Cddb::CD_FRAME;
+	if(toc.leadOut <= toc.offsets.back()) {
+		return false;
+	}
+
+	Cddb cd;
+	cd.loadToc(toc);
+	cd.setEntry(entry);
+	if(cd.category().empty()) {
+		// The category is the directory that the file is in
+		size_t slash = path.rfind('/');
+		if(slash != std::string::npos and slash > 0) {
+			size_t start = path.rfind('/', slash - 1);
+			start = start == std::string::npos ? 0 : start + 1;
+			cd.setCategory(path.substr(start, slash - start));
+		}
+	}
+	cds.emplace_back(BatchImport::albumData(cd), cd.tracks());
+	return true;
+}
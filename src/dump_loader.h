@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "pg_conn.h"
+
+/// Seed the database from a full freedb or gnudb dump, which is a tarball of
+/// millions of xmcd files laid out as `category/discid`. This is run with
+///
+/// `% cdimport --load-dump [--jobs N] [--checkpoint NAME] ARCHIVE`
+///
+/// The load is a pipeline of three stages, joined by bounded queues, so that
+/// a stage that gets ahead waits for the next one rather than filling up the
+/// memory:
+/// - A reader streams the archive with a TarReader, and groups the files into
+///   chunks of #CHUNK_SIZE.
+/// - `N` parsers, one per core by default, turn the xmcd files of a chunk into
+///   album and track rows. Files that aren't complete xmcd entries are
+///   skipped. A parser waits before parsing a chunk that is more than
+///   `#QUEUE_CHUNKS * N` chunks ahead of the writer, so that the chunks the
+///   writer holds until the ones before them are parsed stay bounded.
+/// - A writer loads each chunk in one transaction with PgConn::loadCds, which
+///   streams the rows in with COPY.
+///
+/// The chunks are written in the order they were read, and the number of files
+/// that have been loaded is recorded under the name of the load, in the same
+/// transaction as each chunk (see `sql/003_load_progress.sql`). If the load is
+/// stopped, running it again with the same name skips the files that were
+/// already loaded, and none are loaded twice. Since the dump holds every disc
+/// it has, the loader doesn't check for discs that are already in the
+/// database.
+class DumpLoader
+{
+  public:
+
+	/// The number of files loaded in one transaction.
+	static const size_t CHUNK_SIZE = 1000;
+
+	/// The number of chunks held in each of the queues.
+	static const size_t QUEUE_CHUNKS = 4;
+
+	/// How often progress is printed, in seconds.
+	static const int PROGRESS_INTERVAL = 10;
+
+	/// Parse the command line arguments that follow `--load-dump`, and run
+	/// the load.
+	/// @param argc The number of arguments.
+	/// @param argv The arguments, not including the program name or `--load-dump`.
+	/// @return Returns the exit status of the program.
+	static int main(int argc, char * argv[]);
+
+	/// Construct a load.
+	/// @param archive The path of the dump.
+	/// @param jobs The number of parsers.
+	/// @param checkpoint The name that the progress is recorded under.
+	DumpLoader(const std::string & archive, int jobs, const std::string & checkpoint);
+
+	/// Load the dump, starting after the last checkpoint.
+	/// @return Returns true if the whole dump was loaded.
+	bool run();
+
+  private:
+
+	/// Files read from the archive, the path in the archive and the content.
+	struct Chunk
+	{
+		size_t sequence;	///< The position of the chunk in the load, from zero.
+		size_t end;			///< The number of files in the archive up to the end of the chunk.
+		std::vector<std::pair<std::string, std::string>> files;	///< The files.
+	};
+
+	/// The rows parsed from a chunk.
+	struct Rows
+	{
+		size_t sequence;	///< The position of the chunk in the load, from zero.
+		size_t end;			///< The number of files in the archive up to the end of the chunk.
+		PgConn::CdList cds;	///< The albums, with their tracks.
+		size_t tracks;		///< The total number of tracks.
+		size_t skipped;		///< The files that weren't complete xmcd entries.
+	};
+
+	/// Read the archive into chunks, skipping the files that were loaded.
+	void read();
+
+	/// Parse chunks until there are none left.
+	void parse();
+
+	/// Write the rows of the chunks, in order, until there are none left.
+	void write();
+
+	/// Stop all of the stages, e.g. after an error.
+	void stop();
+
+	/// Wait until the writer is close enough behind a chunk to parse it.
+	/// @param sequence The position of the chunk in the load.
+	/// @return Returns false if the load has been stopped.
+	bool waitForWriter(size_t sequence);
+
+	/// Parse one xmcd file into album and track rows.
+	/// @param path The path of the file in the archive, e.g. `rock/a70d520d`.
+	/// @param text The content of the file.
+	/// @param cds Where the rows are added.
+	/// @return Returns false if the file isn't a complete xmcd entry.
+	static bool parseFile(const std::string & path, const std::string & text,
+						  PgConn::CdList & cds);
+
+	const std::string _archive;				///< The path of the dump.
+	const int _jobs;						///< The number of parsers.
+	const std::string _checkpoint;			///< The name that the progress is recorded under.
+	size_t _resumeFrom { 0 };				///< The files loaded by earlier runs.
+
+	BoundedQueue<Chunk> _chunks;			///< From the reader to the parsers.
+	BoundedQueue<Rows> _rows;				///< From the parsers to the writer.
+	std::atomic<int> _parsers { 0 };		///< The parsers still running.
+
+	size_t _written { 0 };					///< The chunks written so far.
+	std::mutex _writtenMutex;				///< Guards the chunks written, and stopping.
+	std::condition_variable _writtenChanged;	///< Wakes the parsers that wait for the writer.
+
+	std::atomic<bool> _failed { false };	///< True if any stage failed.
+	std::atomic<size_t> _files { 0 };		///< Files loaded by this run.
+	std::atomic<size_t> _albums { 0 };		///< Album rows loaded by this run.
+	std::atomic<size_t> _tracks { 0 };		///< Track rows loaded by this run.
+	std::atomic<size_t> _skipped { 0 };		///< Files that weren't complete xmcd entries.
+};
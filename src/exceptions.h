@@ -22,3 +22,12 @@ class NoCdFound : public std::runtime_error {
 	{ }
 };
 
+/// The audio of a disc couldn't be ripped.
+class RipError : public std::runtime_error {
+  public:
+	/// Only allow construction with a message.
+	/// @param message A suitable run time error message for the user.
+	RipError(const std::string & message)
+	  : std::runtime_error(message)
+	{}
+};
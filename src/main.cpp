@@ -1,17 +1,99 @@
 
 
+#include <cstring>
 #include <iostream>
+#include <memory>
 
+#include <curl/curl.h>
+
+#include "album_index.h"
+#include "batch_import.h"
 #include "cd_import.h"
+#include "cddb_cache.h"
+#include "cddb_mirror.h"
+#include "dump_loader.h"
+#include "metrics.h"
+#include "mirror_server.h"
+#include "multi_drive_import.h"
+#include "pg_conn.h"
+#include "pg_statements.h"
+#include "ripper.h"
 
 int main(int argc, char * argv[])
 {
+	// Must be done before any threads are started
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
+	// Headless batch import, see BatchImport
+	if(argc > 1 and std::strcmp(argv[1], "--batch") == 0) {
+		PgConn::loadAlbumIndex();
+		auto retVal = BatchImport::main(argc - 2, argv + 2);
+		Metrics::report(std::cout);
+		PgStatements::report(std::cout);
+		AlbumIndex::shared().report(std::cout);
+		CddbCache::shared()->report(std::cout);
+		Metrics::save();
+		curl_global_cleanup();
+		return retVal;
+	}
+
+	// Seed the database from a freedb dump, see DumpLoader
+	if(argc > 1 and std::strcmp(argv[1], "--load-dump") == 0) {
+		auto retVal = DumpLoader::main(argc - 2, argv + 2);
+		PgStatements::report(std::cout);
+		curl_global_cleanup();
+		return retVal;
+	}
+
+	// Build a local CDDB mirror from a freedb dump, see CddbMirror
+	if(argc == 4 and std::strcmp(argv[1], "--build-mirror") == 0) {
+		try {
+			auto entries = CddbMirror::build(argv[2], argv[3]);
+			std::cout << "Built a mirror of " << entries << " entries in " << argv[3] << "."
+					  << std::endl;
+		} catch(const std::exception & e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	// Serve a local CDDB mirror over HTTP, see MirrorServer
+	if(argc > 1 and std::strcmp(argv[1], "--serve-mirror") == 0) {
+		return MirrorServer::main(argc - 2, argv + 2);
+	}
+
 	QApplication app(argc, argv);
 
-	CdImport ci;
-	ci.show();
+	// Connect to the database before the first disc is looked up, and load
+	// what is already in it for the duplicate checks
+	PgConn::warmUp();
+	PgConn::loadAlbumIndex();
+
+	// One form for a single drive, or a tab for each of several, see
+	// MultiDriveImport
+	auto drives = MultiDriveImport::drives();
+	std::unique_ptr<QWidget> window;
+	if(drives.size() == 1) {
+		window = std::make_unique<CdImport>(nullptr, drives[0]);
+	} else {
+		window = std::make_unique<MultiDriveImport>(drives);
+	}
+	window->show();
 
 	auto retVal = app.exec();
+	window.reset();
+
+	// The last discs may still be being encoded
+	Ripper::finish();
+
+	// Show where the time went during this session
+	Metrics::report(std::cout);
+	PgStatements::report(std::cout);
+	AlbumIndex::shared().report(std::cout);
+	CddbCache::shared()->report(std::cout);
+	Metrics::save();
+	curl_global_cleanup();
 	std::cout << "Bye now!" << std::endl;
 	return retVal;
 }
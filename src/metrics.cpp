@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+
+#include "metrics.h"
+
+/// Keep the formatting of a stream from leaking into, or out of, an export.
+class FormatGuard
+{
+  public:
+	/// Save the formatting of a stream, and reset it to plain numbers.
+	/// @param out The stream.
+	explicit FormatGuard(std::ostream & out)
+	  : _out(out), _flags(out.flags()), _precision(out.precision())
+	{
+		_out.unsetf(std::ios_base::floatfield | std::ios_base::adjustfield);
+		_out.precision(9);
+	}
+
+	/// Restore the formatting of the stream.
+	~FormatGuard()
+	{
+		_out.flags(_flags);
+		_out.precision(_precision);
+	}
+
+  private:
+	std::ostream & _out;				///< The stream.
+	std::ios_base::fmtflags _flags;		///< Its flags.
+	std::streamsize _precision;			///< Its precision.
+};
+
+const double Metrics::BUCKETS[NUM_BUCKETS] = {
+	0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0
+};
+
+const char * const Metrics::OUTCOME_NAMES[NUM_OUTCOMES] = { "ok", "no_result", "error" };
+
+Metrics::StageMetrics Metrics::_stages[NUM_STAGES] = {
+	{ "read_disc" },
+	{ "cddb_query" },
+	{ "cddb_read" },
+	{ "query_cd_disc_id" },
+	{ "query_artist_title" },
+	{ "insert_cd" },
+	{ "read_audio" },
+	{ "encode" }
+};
+
+std::atomic<uint64_t> Metrics::_discsImported { 0 };
+
+const std::chrono::system_clock::time_point Metrics::_start = std::chrono::system_clock::now();
+
+void Metrics::record(Stage stage, Outcome outcome, std::chrono::steady_clock::duration elapsed)
+{
+	double seconds = std::chrono::duration<double>(elapsed).count();
+	int bucket = 0;
+	while(bucket < NUM_BUCKETS and seconds > BUCKETS[bucket]) {
+		++bucket;
+	}
+	StageMetrics & s = _stages[stage];
+	s.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	s.outcomes[outcome].fetch_add(1, std::memory_order_relaxed);
+	s.totalUs.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(),
+						std::memory_order_relaxed);
+}
+
+void Metrics::discsImported(uint64_t discs)
+{
+	_discsImported.fetch_add(discs, std::memory_order_relaxed);
+}
+
+uint64_t Metrics::count(const StageMetrics & stage)
+{
+	uint64_t n = 0;
+	for(const auto & outcome : stage.outcomes) {
+		n += outcome.load(std::memory_order_relaxed);
+	}
+	return n;
+}
+
+double Metrics::quantile(Stage stage, double q)
+{
+	const StageMetrics & s = _stages[stage];
+	uint64_t counts[NUM_BUCKETS + 1];
+	uint64_t n = 0;
+	for(int b=0;b<=NUM_BUCKETS;++b) {
+		counts[b] = s.buckets[b].load(std::memory_order_relaxed);
+		n += counts[b];
+	}
+	if(n == 0) {
+		return 0.0;
+	}
+	double rank = q * n;
+	uint64_t below = 0;
+	for(int b=0;b<NUM_BUCKETS;++b) {
+		if(counts[b] > 0 and below + counts[b] >= rank) {
+			double lower = b == 0 ? 0.0 : BUCKETS[b-1];
+			return lower + (BUCKETS[b] - lower) * (rank - below) / counts[b];
+		}
+		below += counts[b];
+	}
+	// Slower than the last bound, which is as much as can be said
+	return BUCKETS[NUM_BUCKETS-1];
+}
+
+void Metrics::writePrometheus(std::ostream & out)
+{
+	FormatGuard guard(out);
+	out << "# HELP cdimport_stage_duration_seconds Time spent in each stage of importing a disc.\n"
+		<< "# TYPE cdimport_stage_duration_seconds histogram\n";
+	for(const auto & s : _stages) {
+		uint64_t cumulative = 0;
+		for(int b=0;b<NUM_BUCKETS;++b) {
+			cumulative += s.buckets[b].load(std::memory_order_relaxed);
+			out << "cdimport_stage_duration_seconds_bucket{stage=\"" << s.name
+				<< "\",le=\"" << BUCKETS[b] << "\"} " << cumulative << "\n";
+		}
+		cumulative += s.buckets[NUM_BUCKETS].load(std::memory_order_relaxed);
+		out << "cdimport_stage_duration_seconds_bucket{stage=\"" << s.name
+			<< "\",le=\"+Inf\"} " << cumulative << "\n"
+			<< "cdimport_stage_duration_seconds_sum{stage=\"" << s.name << "\"} "
+			<< s.totalUs.load(std::memory_order_relaxed) / 1e6 << "\n"
+			<< "cdimport_stage_duration_seconds_count{stage=\"" << s.name << "\"} "
+			<< cumulative << "\n";
+	}
+
+	out << "# HELP cdimport_stage_outcomes_total Runs of each stage of importing a disc, by outcome.\n"
+		<< "# TYPE cdimport_stage_outcomes_total counter\n";
+	for(const auto & s : _stages) {
+		for(int o=0;o<NUM_OUTCOMES;++o) {
+			out << "cdimport_stage_outcomes_total{stage=\"" << s.name << "\",outcome=\""
+				<< OUTCOME_NAMES[o] << "\"} " << s.outcomes[o].load(std::memory_order_relaxed)
+				<< "\n";
+		}
+	}
+
+	out << "# HELP cdimport_discs_imported_total Discs inserted into the database.\n"
+		<< "# TYPE cdimport_discs_imported_total counter\n"
+		<< "cdimport_discs_imported_total " << _discsImported.load(std::memory_order_relaxed)
+		<< "\n"
+		<< "# HELP cdimport_start_time_seconds When the program started, in seconds since the epoch.\n"
+		<< "# TYPE cdimport_start_time_seconds gauge\n"
+		<< "cdimport_start_time_seconds "
+		<< std::chrono::duration_cast<std::chrono::seconds>(_start.time_since_epoch()).count()
+		<< "\n";
+}
+
+void Metrics::writeJson(std::ostream & out)
+{
+	FormatGuard guard(out);
+	std::chrono::duration<double> uptime = std::chrono::system_clock::now() - _start;
+	double hours = std::max(uptime.count(), 1e-9) / 3600;
+	uint64_t discs = _discsImported.load(std::memory_order_relaxed);
+
+	out << "{\n"
+		<< "  \"uptime_seconds\": " << uptime.count() << ",\n"
+		<< "  \"discs_imported\": " << discs << ",\n"
+		<< "  \"discs_per_hour\": " << discs / hours << ",\n"
+		<< "  \"stages\": {";
+	for(int i=0;i<NUM_STAGES;++i) {
+		const StageMetrics & s = _stages[i];
+		uint64_t n = count(s);
+		double total = s.totalUs.load(std::memory_order_relaxed) / 1e6;
+		out << (i == 0 ? "\n" : ",\n")
+			<< "    \"" << s.name << "\": {\n"
+			<< "      \"count\": " << n << ",\n"
+			<< "      \"sum_seconds\": " << total << ",\n"
+			<< "      \"mean_seconds\": " << (n > 0 ? total / n : 0.0) << ",\n"
+			<< "      \"p50_seconds\": " << quantile(static_cast<Stage>(i), 0.5) << ",\n"
+			<< "      \"p95_seconds\": " << quantile(static_cast<Stage>(i), 0.95) << ",\n"
+			<< "      \"outcomes\": {";
+		for(int o=0;o<NUM_OUTCOMES;++o) {
+			out << (o == 0 ? " " : ", ") << "\"" << OUTCOME_NAMES[o] << "\": "
+				<< s.outcomes[o].load(std::memory_order_relaxed);
+		}
+		out << " },\n"
+			<< "      \"buckets\": [";
+		for(int b=0;b<=NUM_BUCKETS;++b) {
+			out << (b == 0 ? " " : ", ") << "{ \"le\": ";
+			if(b < NUM_BUCKETS) {
+				out << BUCKETS[b];
+			} else {
+				out << "\"+Inf\"";
+			}
+			out << ", \"count\": " << s.buckets[b].load(std::memory_order_relaxed) << " }";
+		}
+		out << " ]\n"
+			<< "    }";
+	}
+	out << "\n  }\n"
+		<< "}\n";
+}
+
+bool Metrics::save()
+{
+	const char * path = std::getenv("CDIMPORT_METRICS");
+	if(path == nullptr or *path == '\0') {
+		return true;
+	}
+	// Each drive's lookup saves as it finishes, so they take turns
+	static std::mutex mutex;
+	std::lock_guard<std::mutex> lock(mutex);
+	std::string target(path);
+	std::string temp = target + ".tmp";
+	{
+		std::ofstream out(temp);
+		bool json = target.size() >= 5 and target.compare(target.size() - 5, 5, ".json") == 0;
+		if(json) {
+			writeJson(out);
+		} else {
+			writePrometheus(out);
+		}
+		if(not out) {
+			std::cerr << "Unable to write the metrics to " << temp << std::endl;
+			return false;
+		}
+	}
+	if(std::rename(temp.c_str(), target.c_str()) != 0) {
+		std::cerr << "Unable to replace the metrics in " << target << std::endl;
+		std::remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+void Metrics::report(std::ostream & out)
+{
+	FormatGuard guard(out);
+	bool any = false;
+	for(int i=0;i<NUM_STAGES;++i) {
+		const StageMetrics & s = _stages[i];
+		uint64_t n = count(s);
+		if(n == 0) {
+			continue;
+		}
+		if(not any) {
+			out << "Import stages:" << std::endl;
+			any = true;
+		}
+		double meanMs = s.totalUs.load(std::memory_order_relaxed) / 1e3 / n;
+		out << "  " << std::left << std::setw(20) << s.name << std::right << std::fixed
+			<< std::setprecision(2)
+			<< std::setw(8) << n << " runs"
+			<< std::setw(10) << meanMs << " ms mean"
+			<< std::setw(10) << quantile(static_cast<Stage>(i), 0.5) * 1e3 << " ms p50"
+			<< std::setw(10) << quantile(static_cast<Stage>(i), 0.95) * 1e3 << " ms p95"
+			<< std::setw(6) << s.outcomes[NoResult].load(std::memory_order_relaxed) << " empty"
+			<< std::setw(6) << s.outcomes[Error].load(std::memory_order_relaxed) << " failed"
+			<< std::endl;
+	}
+	if(_discsImported > 0) {
+		out << "Discs imported: " << _discsImported << std::endl;
+	}
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <ostream>
+#include <string>
+
+/// Latency histograms and outcome counters for the stages of importing a disc,
+/// so that it can be seen where the time goes, and how often each stage fails
+/// or comes back empty. Every stage is timed with a Timer, wherever it is
+/// called from, be it the user interface or a batch import.
+///
+/// The metrics can be printed with report(), and written with save() to the
+/// file named by the `CDIMPORT_METRICS` environment variable, as a JSON
+/// snapshot if the name ends in `.json`, or otherwise in the Prometheus text
+/// format, e.g. for the textfile collector of the node exporter. Together with
+/// the count of imported discs, this lets lookup latency and discs per hour be
+/// followed across stations.
+///
+/// Recording is lock-free, and safe from any thread.
+class Metrics
+{
+  public:
+
+	/// The stages of an import.
+	enum Stage
+	{
+		ReadDisc = 0,		///< Read the table of contents of the disc in a drive.
+		CddbQuery,			///< Send `cddb query` for a disc.
+		CddbRead,			///< Send `cddb read` for an entry.
+		QueryCdDiscId,		///< Check the database for a disc ID.
+		QueryArtistTitle,	///< Search the database for an artist and title.
+		InsertCd,			///< Insert albums into the database.
+		ReadAudio,			///< Read the audio of a track, to rip it.
+		Encode,				///< Encode a ripped track to FLAC.
+		NUM_STAGES
+	};
+
+	/// How a stage ended.
+	enum Outcome
+	{
+		Ok = 0,				///< There was a result.
+		NoResult,			///< The stage worked, but found nothing, e.g. no disc or no match.
+		Error,				///< The stage failed, or threw.
+		NUM_OUTCOMES
+	};
+
+	/// The number of latency buckets, not counting the one for everything
+	/// slower than the last bound.
+	static const int NUM_BUCKETS = 14;
+
+	/// The upper bounds of the latency buckets, in seconds.
+	static const double BUCKETS[NUM_BUCKETS];
+
+	/// Time a stage, from construction to destruction. The outcome is Ok
+	/// unless it is set otherwise, or the stage is left by an exception.
+	class Timer
+	{
+	  public:
+		/// Start timing.
+		/// @param stage The stage that is being timed.
+		explicit Timer(Stage stage)
+		  : _stage(stage), _start(std::chrono::steady_clock::now()),
+			_exceptions(std::uncaught_exceptions())
+		{}
+
+		/// Stop timing, and record the stage.
+		~Timer()
+		{
+			record(_stage, std::uncaught_exceptions() > _exceptions ? Error : _outcome,
+				   std::chrono::steady_clock::now() - _start);
+		}
+
+		/// Set how the stage ended.
+		/// @param outcome The outcome.
+		inline void setOutcome(Outcome outcome) { _outcome = outcome; }
+
+	  private:
+		Stage _stage;										///< The stage being timed.
+		Outcome _outcome { Ok };							///< How the stage ended.
+		std::chrono::steady_clock::time_point _start;		///< When the stage started.
+		int _exceptions;									///< The exceptions in flight at the start.
+	};
+
+	/// Record a run of a stage.
+	/// @param stage The stage.
+	/// @param outcome How it ended.
+	/// @param elapsed How long it took.
+	static void record(Stage stage, Outcome outcome, std::chrono::steady_clock::duration elapsed);
+
+	/// Count discs that have been imported into the database.
+	/// @param discs The number of discs.
+	static void discsImported(uint64_t discs);
+
+	/// Estimate a quantile of the latency of a stage, by interpolating within
+	/// its bucket.
+	/// @param stage The stage.
+	/// @param q The quantile, from 0 to 1, e.g. 0.95.
+	/// @return Returns the latency in seconds, or 0 if the stage hasn't run.
+	static double quantile(Stage stage, double q);
+
+	/// Write the metrics in the Prometheus text format.
+	/// @param out Where to write them.
+	static void writePrometheus(std::ostream & out);
+
+	/// Write a JSON snapshot of the metrics.
+	/// @param out Where to write it.
+	static void writeJson(std::ostream & out);
+
+	/// Write the metrics to the file named by `CDIMPORT_METRICS`, if it is
+	/// set. The file is replaced in one step, so a reader never sees half of
+	/// it. Failure is reported, but isn't fatal.
+	/// @return Returns false if the file couldn't be written.
+	static bool save();
+
+	/// Print the count, mean, median and 95th percentile of each stage that
+	/// has run, and how many runs found nothing or failed.
+	/// @param out Where to print the report.
+	static void report(std::ostream & out);
+
+  private:
+
+	/// A stage, and what is known about its runs.
+	struct StageMetrics
+	{
+		const char * name;									///< The name of the stage in the exports.
+		std::atomic<uint64_t> buckets[NUM_BUCKETS + 1];		///< The runs in each bucket, not cumulative.
+		std::atomic<uint64_t> outcomes[NUM_OUTCOMES];		///< The runs with each outcome.
+		std::atomic<uint64_t> totalUs;						///< The total time spent, in microseconds.
+	};
+
+	/// The number of runs of a stage.
+	/// @param stage The stage.
+	/// @return Returns the number of runs, whatever their outcome.
+	static uint64_t count(const StageMetrics & stage);
+
+	static const char * const OUTCOME_NAMES[NUM_OUTCOMES];	///< The names of the outcomes in the exports.
+	static StageMetrics _stages[NUM_STAGES];				///< Indexed by Stage.
+	static std::atomic<uint64_t> _discsImported;			///< The discs imported.
+	static const std::chrono::system_clock::time_point _start;	///< When the program started.
+};
@@ -0,0 +1,245 @@
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <arpa/inet.h>		// POSIX only, for the sockets
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "mirror_server.h"
+
+const std::string MirrorServer::DEFAULT_ADDRESS { "127.0.0.1" };
+
+/// Send the whole of a buffer.
+/// @return Returns true if all of the bytes were sent.
+static bool sendAll(int fd, const std::string & data)
+{
+	const char * p = data.data();
+	size_t count = data.size();
+	while(count > 0) {
+		ssize_t n = ::send(fd, p, count, MSG_NOSIGNAL);
+		if(n <= 0) {
+			return false;
+		}
+		p += n;
+		count -= n;
+	}
+	return true;
+}
+
+int MirrorServer::main(int argc, char * argv[])
+{
+	int port = DEFAULT_PORT;
+	std::string address = DEFAULT_ADDRESS;
+	std::string dir;
+	for(int i=0;i<argc;++i) {
+		std::string arg = argv[i];
+		if(arg == "--port" and i + 1 < argc) {
+			port = std::atoi(argv[++i]);
+		} else if(arg == "--bind" and i + 1 < argc) {
+			address = argv[++i];
+		} else {
+			dir = arg;
+		}
+	}
+	if(dir.empty()) {
+		std::cerr << "Usage: cdimport --serve-mirror [--port N] [--bind ADDRESS] DIR" << std::endl;
+		return 1;
+	}
+
+	try {
+		auto mirror = std::make_shared<CddbMirror>(dir);
+		MirrorServer server(mirror, port, address);
+		std::cout << "Serving " << mirror->size() << " disc IDs at http://" << address << ":"
+				  << port << "/~cddb/cddb.cgi" << std::endl;
+		server.run();
+	} catch(const std::exception & e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+MirrorServer::MirrorServer(std::shared_ptr<CddbMirror> mirror, int port, const std::string & address)
+  : _mirror(mirror)
+{
+	sockaddr_in addr {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if(inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+		throw std::runtime_error("Not an IPv4 address: " + address);
+	}
+
+	_listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(_listener < 0) {
+		throw std::runtime_error(std::string("Unable to create a socket: ") + std::strerror(errno));
+	}
+	int on = 1;
+	::setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if(::bind(_listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+	   or ::listen(_listener, SOMAXCONN) != 0) {
+		std::string err = std::strerror(errno);
+		::close(_listener);
+		throw std::runtime_error("Unable to listen on " + address + ":" + std::to_string(port)
+								 + ": " + err);
+	}
+}
+
+MirrorServer::~MirrorServer()
+{
+	::close(_listener);
+}
+
+void MirrorServer::run()
+{
+	while(true) {
+		int fd = ::accept4(_listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if(fd < 0) {
+			if(errno == EINTR or errno == ECONNABORTED) {
+				continue;
+			}
+			throw std::runtime_error(std::string("Unable to accept a connection: ")
+									 + std::strerror(errno));
+		}
+		if(_connections >= MAX_CONNECTIONS) {
+#ifdef DEBUG
+			std::cout << "Refusing a connection, " << MAX_CONNECTIONS << " are open." << std::endl;
+#endif
+			::close(fd);
+			continue;
+		}
+
+		// Don't let a client that stops sending or reading hold on to a thread forever
+		timeval timeout {};
+		timeout.tv_sec = IDLE_TIMEOUT;
+		::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		++_connections;
+		std::thread([this, fd]() {
+			serve(fd);
+			--_connections;
+		}).detach();
+	}
+}
+
+void MirrorServer::serve(int fd) const
+{
+	std::string buffer;
+	char chunk[4096];
+	bool keepAlive = true;
+	while(keepAlive) {
+		// Read up to the end of the headers; the requests are GETs, without a body
+		size_t end;
+		while((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+			if(buffer.size() > MAX_REQUEST) {
+				::close(fd);
+				return;
+			}
+			ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+			if(n <= 0) {
+				::close(fd);
+				return;
+			}
+			buffer.append(chunk, n);
+		}
+		std::string headers = buffer.substr(0, end);
+		buffer.erase(0, end + 4);
+
+		std::istringstream request(headers);
+		std::string method;
+		std::string target;
+		std::string version;
+		request >> method >> target >> version;
+		keepAlive = version == "HTTP/1.1";
+		std::string line;
+		while(std::getline(request, line)) {
+			for(auto & c : line) {
+				c = std::tolower(static_cast<unsigned char>(c));
+			}
+			if(line.compare(0, 11, "connection:") == 0) {
+				keepAlive = line.find("close") == std::string::npos
+							and (version == "HTTP/1.1" or line.find("keep-alive") != std::string::npos);
+			}
+		}
+
+		int status = 405;
+		std::string body;
+		if(method == "GET") {
+			status = 200;
+			body = respond(target, status);
+		}
+		std::ostringstream response;
+		response << "HTTP/1.1 " << status << (status == 200 ? " OK" : " Error") << "\r\n"
+				 << "Content-Type: text/plain; charset=UTF-8\r\n"
+				 << "Content-Length: " << body.size() << "\r\n"
+				 << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n"
+				 << "\r\n"
+				 << body;
+		if(not sendAll(fd, response.str())) {
+			break;
+		}
+	}
+	::close(fd);
+}
+
+std::string MirrorServer::respond(const std::string & target, int & status) const
+{
+	size_t question = target.find('?');
+	std::string path = target.substr(0, question);
+	if(path.size() < 8 or path.compare(path.size() - 8, 8, "cddb.cgi") != 0) {
+		status = 404;
+		return "";
+	}
+
+	// Only the cmd parameter matters; hello and proto are accepted as they are
+	std::string cmd;
+	std::istringstream params(question == std::string::npos ? "" : target.substr(question + 1));
+	std::string param;
+	while(std::getline(params, param, '&')) {
+		if(param.compare(0, 4, "cmd=") == 0) {
+			cmd = decode(param.substr(4));
+		}
+	}
+
+	std::istringstream words(cmd);
+	std::string command;
+	std::string sub;
+	words >> command >> sub;
+	if(command == "cddb" and sub == "query") {
+		std::string rest;
+		std::getline(words >> std::ws, rest);
+		return _mirror->query(rest);
+	} else if(command == "cddb" and sub == "read") {
+		std::string category;
+		std::string discId;
+		if(words >> category >> discId) {
+			return _mirror->read(category, discId);
+		}
+	}
+	return "500 Unrecognized command.\r\n";
+}
+
+std::string MirrorServer::decode(const std::string & value)
+{
+	std::string decoded;
+	decoded.reserve(value.size());
+	for(size_t i=0;i<value.size();++i) {
+		if(value[i] == '+') {
+			decoded += ' ';
+		} else if(value[i] == '%' and i + 2 < value.size()) {
+			decoded += static_cast<char>(std::strtol(value.substr(i + 1, 2).c_str(), nullptr, 16));
+			i += 2;
+		} else {
+			decoded += value[i];
+		}
+	}
+	return decoded;
+}
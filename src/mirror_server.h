@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "cddb_mirror.h"
+
+/// A stand-in CDDB server that answers from a local CddbMirror, for stations
+/// that can't reach the internet but can reach a machine that holds a mirror.
+/// It speaks just enough HTTP/1.1 for a CddbClient, i.e., `GET` requests of
+/// the `cddb.cgi` script with keep-alive connections. This is run with
+///
+/// `% cdimport --serve-mirror [--port N] [--bind ADDRESS] DIR`
+///
+/// and the clients are pointed at it with the `CDDB_SERVER` environment
+/// variable, e.g. `CDDB_SERVER=http://mirror:8880/~cddb/cddb.cgi`.
+///
+/// Each connection is served by its own thread. A connection that is idle, or
+/// stalls part way through a request, for IDLE_TIMEOUT is closed, and no more
+/// than MAX_CONNECTIONS are served at the same time.
+class MirrorServer
+{
+  public:
+
+	/// The port that is listened on by default.
+	static const int DEFAULT_PORT = 8880;
+
+	/// The address that is listened on by default, which is only reachable
+	/// from the same machine.
+	static const std::string DEFAULT_ADDRESS;
+
+	/// The largest request that is accepted, in bytes.
+	static const size_t MAX_REQUEST = 16 * 1024;
+
+	/// How long a connection may go without sending or receiving, in seconds.
+	static const int IDLE_TIMEOUT = 30;
+
+	/// The most connections that are served at the same time. More are closed
+	/// as soon as they are accepted.
+	static const int MAX_CONNECTIONS = 256;
+
+	/// Parse the command line arguments that follow `--serve-mirror`, and run
+	/// the server until the program is killed.
+	/// @param argc The number of arguments.
+	/// @param argv The arguments, not including the program name or `--serve-mirror`.
+	/// @return Returns the exit status of the program.
+	static int main(int argc, char * argv[]);
+
+	/// Start listening.
+	/// @param mirror The mirror to answer from.
+	/// @param port The port to listen on.
+	/// @param address The IPv4 address to listen on.
+	/// @throws std::runtime_error If the port can't be listened on.
+	MirrorServer(std::shared_ptr<CddbMirror> mirror, int port = DEFAULT_PORT,
+				 const std::string & address = DEFAULT_ADDRESS);
+
+	/// Stop listening.
+	~MirrorServer();
+
+	MirrorServer(const MirrorServer &) = delete;
+	MirrorServer & operator=(const MirrorServer &) = delete;
+
+	/// Accept connections, and serve them, forever.
+	void run();
+
+  private:
+
+	/// Serve the requests of one connection until it is closed.
+	/// @param fd The connection.
+	void serve(int fd) const;
+
+	/// Answer the request for a URL.
+	/// @param target The path and query string of the request.
+	/// @param status Set to the HTTP status of the response.
+	/// @return Returns the body of the response.
+	std::string respond(const std::string & target, int & status) const;
+
+	/// Decode a URL-encoded query parameter.
+	/// @param value The encoded value.
+	/// @return Returns the decoded value.
+	static std::string decode(const std::string & value);
+
+	std::shared_ptr<CddbMirror> _mirror;	///< The mirror that answers the requests.
+	int _listener { -1 };					///< The listening socket.
+	std::atomic<int> _connections { 0 };	///< The connections being served.
+};
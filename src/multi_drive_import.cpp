@@ -0,0 +1,75 @@
+#include <cstdlib>
+#include <sstream>
+
+#include <QHeaderView>
+#include <QVBoxLayout>
+
+#include "multi_drive_import.h"
+
+#include "macros.h"
+
+std::vector<std::string> MultiDriveImport::drives()
+{
+	std::vector<std::string> devices;
+	const char * value = std::getenv("CDIMPORT_DRIVES");
+	if(value != nullptr) {
+		std::istringstream iss(value);
+		std::string device;
+		while(std::getline(iss, device, ',')) {
+			if(not device.empty()) {
+				devices.push_back(device);
+			}
+		}
+	}
+	if(devices.empty()) {
+		devices.push_back(Cddb::CD_DEVICE);
+	}
+	return devices;
+}
+
+MultiDriveImport::MultiDriveImport(const std::vector<std::string> & drives, QWidget * parent)
+  : QWidget(parent)
+{
+	setWindowTitle("CD Import");
+
+	_statusPanel = new QTableWidget(drives.size(), 2, this);
+	_statusPanel->setHorizontalHeaderLabels({ "Drive", "Status" });
+	_statusPanel->horizontalHeader()->setStretchLastSection(true);
+	_statusPanel->verticalHeader()->setVisible(false);
+	_statusPanel->setEditTriggers(QAbstractItemView::NoEditTriggers);
+	_statusPanel->setSelectionBehavior(QAbstractItemView::SelectRows);
+	_statusPanel->setSelectionMode(QAbstractItemView::SingleSelection);
+
+	_tabs = new QTabWidget(this);
+	for(int i=0;i<drives.size();++i) {
+		// Each form is a dialog of its own, so make it an ordinary widget to
+		// sit in the tab
+		auto import = new CdImport(nullptr, drives[i]);
+		import->setWindowFlags(Qt::Widget);
+		_imports.push_back(import);
+		_tabs->addTab(import, QStr(drives[i]));
+
+		_statusPanel->setItem(i, 0, new QTableWidgetItem(QStr(drives[i])));
+		_statusPanel->setItem(i, 1, new QTableWidgetItem(import->status()));
+		QObject::connect(import, &CdImport::statusChanged, this, [this, i](const QString & status) {
+			onStatusChanged(i, status);
+		});
+	}
+	_statusPanel->resizeColumnToContents(0);
+	_statusPanel->setMaximumHeight(_statusPanel->horizontalHeader()->height()
+								   + drives.size() * _statusPanel->verticalHeader()->defaultSectionSize() + 4);
+
+	QObject::connect(_statusPanel, &QTableWidget::cellClicked, this, [this](int row, int) {
+		_tabs->setCurrentIndex(row);
+	});
+
+	auto layout = new QVBoxLayout(this);
+	layout->addWidget(_statusPanel);
+	layout->addWidget(_tabs);
+}
+
+void MultiDriveImport::onStatusChanged(int which, const QString & status)
+{
+	_statusPanel->item(which, 1)->setText(status);
+	_tabs->setTabText(which, QStr(_imports[which]->device()) + " - " + status);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <QTabWidget>
+#include <QTableWidget>
+#include <QWidget>
+
+#include "cd_import.h"
+
+/// The main window for a workstation with several CD drives. Each drive gets
+/// its own CdImport in a tab, with its own lookup worker and drive monitor,
+/// so discs in all of the drives are read, looked up and saved in parallel.
+/// A status panel above the tabs shows what every drive is doing, and
+/// clicking a drive in it switches to its tab.
+///
+/// The drives are configured with the `CDIMPORT_DRIVES` environment variable,
+/// see drives().
+class MultiDriveImport : public QWidget
+{
+	Q_OBJECT
+
+  public:
+
+	/// The drives to import from. These are listed in the `CDIMPORT_DRIVES`
+	/// environment variable, separated by commas, e.g.
+	/// `/dev/sr0,/dev/sr1`. A drive may be a file that stands in for it,
+	/// as for TocSource.
+	/// @return Returns the drives, or just Cddb::CD_DEVICE if the variable is
+	///         not set.
+	static std::vector<std::string> drives();
+
+	/// Construct the window.
+	/// @param drives The device names of the drives.
+	/// @param parent Specify an optional parent object.
+	explicit MultiDriveImport(const std::vector<std::string> & drives, QWidget * parent = nullptr);
+
+  private slots:
+
+	/// Show the new status of a drive in the status panel and on its tab.
+	/// @param which The index of the drive.
+	/// @param status The status of the drive.
+	void onStatusChanged(int which, const QString & status);
+
+  private:
+
+	QTableWidget * _statusPanel;		///< A row per drive, owned by this.
+	QTabWidget * _tabs;					///< A CdImport per drive, owned by this.
+	std::vector<CdImport *> _imports;	///< The CdImport of each drive, owned by the tabs.
+};
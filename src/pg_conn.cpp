@@ -1,17 +1,25 @@
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <iostream>
+#include <optional>
 #include <tuple>
+#include <vector>
 
 #include "pg_conn.h"
 
+#include "metrics.h"
+#include "pg_statements.h"
+#include "trace.h"
+
 /// Not much of a macro, but I want to match the #CATCH macro.
 #define TRY try {
 
-/// Boilerplate code to create a database connection and start a transaction.
+/// Boilerplate code to borrow a pooled database connection and start a transaction.
 #define CONN \
-pqxx::connection conn(DB_CONNECTION_STRING); \
-pqxx::work w(conn);
+PgPool::Lease lease(pool()); \
+pqxx::work w(lease.conn());
 
 /// Boilerplate code to commit the transaction.
 #define ABORT w.abort();
@@ -25,128 +33,326 @@ pqxx::work w(conn);
 	std::cerr << "Failed to connect to the database: " << e.what() << std::endl; \
 }
 
+/// As #CATCH, but also for a statement that the database rejected, e.g. since
+/// a script under sql/ hasn't been applied, or a constraint was violated.
+#define CATCH_SQL \
+} catch(const pqxx::sql_error & e) { \
+	std::cerr << "The database rejected a statement: " << e.what() << std::endl; \
+CATCH
+
+/// Call a prepared statement by name, and record how long it took.
+/// @param w The transaction to call the statement in.
+/// @param id The statement to call.
+/// @param args The parameters of the statement.
+/// @return Returns the result of the statement.
+template<typename... Args>
+static pqxx::result execPrepared(pqxx::work & w, PgStatements::Id id, Args &&... args)
+{
+	PgStatements::Timer timer(id);
+	Trace::Span span(PgStatements::name(id));
+	return w.exec_prepared(PgStatements::name(id), std::forward<Args>(args)...);
+}
+
+/// Stream the tracks of several CDs into the tracks table with a single COPY.
+/// The checksum columns are only copied if there are checksums, so that
+/// inserts without them work on a database without the columns. If there are
+/// checksums but not the columns, the checksums are left out, with a warning.
+/// @param w The transaction to copy in.
+/// @param cds The albums, with their track information.
+/// @param albumIds The album ID of each of the albums.
+/// @param checksums The checksums of the tracks of each of the albums, if any.
+static void copyTracks(pqxx::work & w, const PgConn::CdList & cds, const std::vector<int> & albumIds,
+					   const std::vector<Checksums::List> & checksums = {})
+{
+	using std::get;
+#ifdef DEBUG
+	using std::cout, std::endl;
+#endif
+	PgStatements::Timer timer(PgStatements::CopyTracks);
+	Trace::Span span(PgStatements::name(PgStatements::CopyTracks));
+	bool withChecksums = std::any_of(checksums.begin(), checksums.end(),
+									 [](const Checksums::List & list) { return not list.empty(); });
+	if(withChecksums and not PgStatements::isAvailable(PgStatements::ProbeTrackChecksums)) {
+		static std::atomic<bool> warned { false };
+		if(not warned.exchange(true)) {
+			std::cerr << "The checksums of the tracks aren't stored, since the tracks table has no "
+					  << "columns for them. Apply sql/002_track_checksums.sql to add them." << std::endl;
+		}
+		withChecksums = false;
+	}
+	std::vector<std::string> columns {
+		"album_id",
+		"number",
+		"name",
+		"length",
+		"extra_info"
+	};
+	if(withChecksums) {
+		columns.insert(columns.end(), { "crc32", "accuraterip_v1", "accuraterip_v2" });
+	}
+	pqxx::stream_to copy(w, "tracks", columns);
+	for(size_t c=0;c<cds.size();++c) {
+		const Track::TrackList & tracks = cds[c].second;
+		for(int i=0;i<tracks.size();++i) {
+			const auto & track = tracks[i];
+			auto row = std::make_tuple(
+				albumIds[c],
+				i+1,
+				get<Track::Title>(track),
+				get<Track::Length_S>(track),
+				get<Track::ExtraInfo>(track)
+			);
+			if(withChecksums) {
+				// The columns are bigint, since the checksums are unsigned
+				std::optional<int64_t> crc, v1, v2;
+				if(c < checksums.size() and i < checksums[c].size() and checksums[c][i]) {
+					crc = checksums[c][i]->crc32;
+					v1 = checksums[c][i]->accurateRipV1;
+					v2 = checksums[c][i]->accurateRipV2;
+				}
+				copy << std::tuple_cat(row, std::make_tuple(crc, v1, v2));
+			} else {
+				copy << row;
+			}
+#ifdef DEBUG
+			cout << "Adding track " << (i+1) << ". '"
+				 << get<Track::Title>(track) << "' to album_id " << albumIds[c]
+				 << "." << endl;
+#endif
+		}
+	}
+	copy.complete();
+}
+
+/// Add inserted albums to the AlbumIndex, if it is in use.
+/// @param cds The albums.
+static void indexAlbums(const PgConn::CdList & cds)
+{
+	using std::get;
+	AlbumIndex & index = AlbumIndex::shared();
+	if(not index.isLoaded()) {
+		return;
+	}
+	for(const auto & [album, tracks] : cds) {
+		index.add(get<Cd::DiscId>(album));
+	}
+}
+
 const std::string PgConn::DB_NAME { "albums" };
 const std::string PgConn::DB_HOST { "elephant" };
 const std::string PgConn::DB_USER { "pmvarsa" };
 const std::string PgConn::DB_CONNECTION_STRING { "postgresql://pmvarsa@elephant/albums" };
 
-pqxx::result PgConn::queryCdDiscId(const std::string & cdDiscId)
+PgPool & PgConn::pool()
+{
+	static PgPool pool(DB_CONNECTION_STRING, POOL_SIZE, PgStatements::prepare);
+	return pool;
+}
+
+void PgConn::warmUp()
+{
+	TRY
+		pool().warmUp();
+	CATCH_SQL
+}
+
+bool PgConn::loadAlbumIndex()
 {
+	AlbumIndex & index = AlbumIndex::shared();
+	TRY
+		CONN
+		Rows<AlbumKey> keys(execPrepared(w, PgStatements::QueryAlbumKeys));
+		COMMIT
+		for(const AlbumKey & key : keys) {
+			index.add(key.discId);
+		}
+		index.setLoaded(true);
+		return true;
+	CATCH_SQL
+	return false;
+}
+
+AlbumMatches PgConn::queryCdDiscId(const std::string & cdDiscId)
+{
+	Metrics::Timer timer(Metrics::QueryCdDiscId);
+	if(not AlbumIndex::shared().mayHaveDiscId(cdDiscId)) {
+		timer.setOutcome(Metrics::NoResult);
+		return AlbumMatches();
+	}
 	TRY
 		CONN	// Create an RAII connection and a transaction
 
-		auto results = w.exec_params(
-			"SELECT artist, title, categories.category "
-				"FROM albums "
-				"INNER JOIN categories "
-				"ON albums.category_id = categories.category_id "
-				"WHERE albums.disc_id = $1;", cdDiscId);
+		AlbumMatches results(execPrepared(w, PgStatements::QueryCdDiscId, cdDiscId));
 		COMMIT	// Commit the transaction
+		timer.setOutcome(results.empty() ? Metrics::NoResult : Metrics::Ok);
 		return results;
 	CATCH
-	return pqxx::result();
+	timer.setOutcome(Metrics::Error);
+	return AlbumMatches();
 }
 
-pqxx::result PgConn::queryArtistTitle(const std::string & artist, const std::string & title)
+AlbumMatches PgConn::queryArtistTitle(const std::string & artist, const std::string & title,
+									  int limit)
 {
+	Metrics::Timer timer(Metrics::QueryArtistTitle);
 	TRY
 		CONN
-		auto results = w.exec_params(
-			"SELECT artist, title, category "
-			"FROM v_albums "
-			"WHERE title ILIKE $1 AND artist ILIKE $2;", title, artist);
+		// The connection has been prepared by now, so it is known if the fuzzy search can be used
+		PgStatements::Id search = PgStatements::QueryArtistTitle;
+		if(not PgStatements::isAvailable(search)) {
+			search = PgStatements::QueryArtistTitleIlike;
+		}
+		AlbumMatches results(execPrepared(w, search, artist, title, limit));
 		COMMIT
+		timer.setOutcome(results.empty() ? Metrics::NoResult : Metrics::Ok);
 		return results;
-	CATCH
-	return pqxx::result();
+	CATCH_SQL
+	timer.setOutcome(Metrics::Error);
+	return AlbumMatches();
 }
 
-bool PgConn::insertCd(const Cd::CdAlbumData & album, const Track::TrackList & tracks)
+bool PgConn::insertCd(const Cd::CdAlbumData & album, const Track::TrackList & tracks,
+					  const Checksums::List & checksums)
+{
+	return insertCds({ { album, tracks } }, { checksums });
+}
+
+bool PgConn::insertCds(const CdList & cds, const std::vector<Checksums::List> & checksums)
 {
 	using std::get;
+	Metrics::Timer timer(Metrics::InsertCd);
+	bool inserted = false;
 	TRY
 		CONN
 #ifdef DEBUG
 		using std::cout, std::endl, std::flush;
-		cout << "Inserting an entry into the albums table." << endl;
+		cout << "Inserting " << cds.size() << " entries into the albums table." << endl;
 #endif
-		auto result = w.exec_params(
-			"INSERT INTO albums("
-				"medium_id, "
-				"type_id, "
-				"category_id, "
-				"is_compilation, "
-				"result_id, "
-				"disc_id, "
-				"title, "
-				"artist, "
-				"genre, "
-				"length, "
-				"extra_info, "
-				"year, "
-				"num_tracks"
-			") VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13) "
-			"RETURNING album_id",
-			get<Cd::MediumId>(album),
-			get<Cd::TypeId>(album),
-			get<Cd::CategoryId>(album),
-			get<Cd::IsCompilation>(album),
-			get<Cd::ResultId>(album),
-			get<Cd::DiscId>(album),
-			get<Cd::Title>(album),
-			get<Cd::Artist>(album),
-			get<Cd::Genre>(album),
-			get<Cd::Length>(album),
-			get<Cd::ExtraInfo>(album),
-			get<Cd::Year>(album),
-			get<Cd::NumberOfTracks>(album)
-		);
-
-		// Test that the insert succeeded
-		if(result.size() > 0) {
-			int album_id = result[0][0].as<int>(); // index is faster than name
+		std::vector<int> albumIds;
+		for(const auto & [album, tracks] : cds) {
+			auto result = execPrepared(w, PgStatements::InsertAlbum,
+				get<Cd::MediumId>(album),
+				get<Cd::TypeId>(album),
+				get<Cd::CategoryId>(album),
+				get<Cd::IsCompilation>(album),
+				get<Cd::ResultId>(album),
+				get<Cd::DiscId>(album),
+				get<Cd::Title>(album),
+				get<Cd::Artist>(album),
+				get<Cd::Genre>(album),
+				get<Cd::Length>(album),
+				get<Cd::ExtraInfo>(album),
+				get<Cd::Year>(album),
+				get<Cd::NumberOfTracks>(album)
+			);
+
+			// Test that the insert succeeded
+			if(result.size() == 0) {
+				std::cerr << "Failed to insert into the albums table." << std::endl;
+				timer.setOutcome(Metrics::Error);
+				return false;
+			}
+			albumIds.push_back(result[0][0].as<int>()); // index is faster than name
 #ifdef DEBUG
-			cout << "Successfully inserted " << result.size() << " item(s) into the database. "
-				 << "The new album_id is " << album_id << "." << endl;
+			cout << "Successfully inserted '" << get<Cd::Title>(album) << "' into the database. "
+				 << "The new album_id is " << albumIds.back() << "." << endl;
 #endif
-			for(int i=0;i<tracks.size();++i) {
-				auto track = tracks[i];
-				auto result = w.exec_params(
-					"INSERT INTO tracks (" 
-						"album_id, "
-						"number, "
-						"name, "
-						"length, "
-						"extra_info"
-					") VALUES ($1, $2, $3, $4, $5) "
-					"RETURNING track_id",
-					album_id,
-					i+1,
-					get<Track::Title>(track),
-					get<Track::Length_S>(track),
-					get<Track::ExtraInfo>(track)
-				);
-				assert(result.size() == 1);
+		}
+
+		// Stream all of the tracks in with a single COPY, rather than paying
+		// for a round trip per track
+		copyTracks(w, cds, albumIds, checksums);
 #ifdef DEBUG
-				int track_id = result[0][0].as<int>();
-				cout << "Successfully added track " << (i+1) << ". '"
-					 << get<Track::Title>(track) << "' "
-					 << "as track_id " << track_id << "." << endl;
+		// Abort the transaction in Debug mode
+		cout << "*** *** *** ABORTING TRANSACTION IN Debug MODE *** *** ***" << endl;
+		ABORT
+#else
+		COMMIT
+		indexAlbums(cds);
+		Metrics::discsImported(cds.size());
 #endif
-			}
-		} else {
-			std::cerr << "Failed to insert into the albums table." << std::endl;
+		inserted = true;
+	CATCH_SQL
+
+	if(not inserted) {
+		timer.setOutcome(Metrics::Error);
+	}
+	return inserted;
+}
+
+bool PgConn::loadCds(const CdList & cds, const std::string & load, size_t files)
+{
+	bool loaded = false;
+	TRY
+		CONN
+#ifdef DEBUG
+		using std::cout, std::endl;
+		cout << "Loading " << cds.size() << " entries into the albums table." << endl;
+#endif
+		// Take the album IDs from the sequence, so that the tracks can refer
+		// to the albums without a round trip per album
+		std::vector<int> albumIds;
+		albumIds.reserve(cds.size());
+		for(const auto & row : execPrepared(w, PgStatements::ReserveAlbumIds,
+											static_cast<int>(cds.size()))) {
+			albumIds.push_back(row[0].as<int>());
+		}
+		if(albumIds.size() != cds.size()) {
+			std::cerr << "Failed to reserve album IDs." << std::endl;
 			return false;
 		}
+
+		{
+			PgStatements::Timer timer(PgStatements::CopyAlbums);
+			pqxx::stream_to copy(w, "albums", std::vector<std::string> {
+				"album_id",
+				"medium_id",
+				"type_id",
+				"category_id",
+				"is_compilation",
+				"result_id",
+				"disc_id",
+				"title",
+				"artist",
+				"genre",
+				"length",
+				"extra_info",
+				"year",
+				"num_tracks"
+			});
+			for(size_t c=0;c<cds.size();++c) {
+				const Cd::CdAlbumData & album = cds[c].first;
+				copy << std::tuple_cat(std::make_tuple(albumIds[c]), album);
+			}
+			copy.complete();
+		}
+
+		copyTracks(w, cds, albumIds);
+		if(not load.empty()) {
+			execPrepared(w, PgStatements::SaveLoadProgress, load, static_cast<int64_t>(files));
+		}
 #ifdef DEBUG
 		// Abort the transaction in Debug mode
 		cout << "*** *** *** ABORTING TRANSACTION IN Debug MODE *** *** ***" << endl;
 		ABORT
 #else
 		COMMIT
+		indexAlbums(cds);
 #endif
-	CATCH
+		loaded = true;
+	CATCH_SQL
 
-	return true;
+	return loaded;
 }
 
+bool PgConn::queryLoadProgress(const std::string & load, size_t & files)
+{
+	TRY
+		CONN
+		auto result = execPrepared(w, PgStatements::QueryLoadProgress, load);
+		COMMIT
+		files = result.empty() ? 0 : result[0][0].as<int64_t>();
+		return true;
+	CATCH_SQL
+	return false;
+}
@@ -1,18 +1,29 @@
 #pragma once
 
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <pqxx/pqxx>
 
+#include "album_index.h"
 #include "cd.h"
+#include "checksums.h"
+#include "pg_pool.h"
+#include "pg_rows.h"
 
 /// Data Layer Wrapper. Database operations are encapsulated with this class.
 /// Methods in this class have a fair amount of boiler-late code, which is
 /// provided in the macros #TRY, #CONN, and #CATCH.
 ///
-/// \TODO Ideally, this class would actually process the data and return it to
-/// the rest of the application in a typed format suitable for the application,
-/// but that's a lot of work that I don't want to do right now.
+/// Connections are not opened per call. Instead, each transaction borrows a
+/// persistent connection from a PgPool that is owned by this class. The SQL
+/// statements live in PgStatements, which prepares them on every connection,
+/// and they are called by name.
+///
+/// Queries return their rows as Rows of a struct from pg_rows.h, which maps
+/// each row by column index and views its strings in place, rather than as a
+/// raw `pqxx::result` to be picked apart by column name.
 class PgConn
 {
   private:
@@ -21,25 +32,99 @@ class PgConn
 	static const std::string DB_HOST;		///< The database host.
 	static const std::string DB_USER;		///< The user of the database.
 
+	/// The pool of connections shared by all of the queries.
+	/// @return Returns the pool, which is created on first use.
+	static PgPool & pool();
+
+  public:
+
+	/// A list of CDs to insert, each with its track information.
+	typedef std::vector<std::pair<Cd::CdAlbumData, Track::TrackList>> CdList;
+
 	/// Static creation of a database connection string useing other members.
 	static const std::string DB_CONNECTION_STRING;
 
-  public:
+	/// The maximum number of connections held open to the database.
+	static const size_t POOL_SIZE = 4;
+
+	/// The most albums returned by queryArtistTitle() by default.
+	static const int SEARCH_LIMIT = 10;
+
+	/// Open the pooled connections ahead of time, so that the first lookup
+	/// does not wait for them. Failure is reported, but isn't fatal, since the
+	/// pool will try to connect again when a query is made.
+	static void warmUp();
+
+	/// Load the AlbumIndex with every album in the database, so that the
+	/// disc ID check below is answered without the database when there is
+	/// no match. Failure is reported, but isn't fatal, since the checks
+	/// then go to the database.
+	/// @return Returns true if the index was loaded.
+	static bool loadAlbumIndex();
+
 	/// Query the database to see if a `cd-discid` tool entry already exists.
+	/// If the AlbumIndex is loaded and has no such disc, then the database
+	/// isn't queried.
 	/// @param cdDiscId A `cd-discid` string to query for.
-	/// @return Returns the raw pqxx::result data.
-	static pqxx::result queryCdDiscId(const std::string & cdDiscId);
+	/// @return Returns the albums, with a score of 1, as for
+	///         queryArtistTitle().
+	static AlbumMatches queryCdDiscId(const std::string & cdDiscId);
 
-	/// Query for an album by artist and title.
+	/// Search for albums by artist and title, allowing for near misses such
+	/// as "The Beatles" for "Beatles, The", or a typo. The artists and titles
+	/// are normalized by the `album_key()` function and compared by trigram
+	/// similarity, using the indexes of `sql/001_fuzzy_search.sql`, which must
+	/// have been applied to the database.
 	/// @param artist The artist's name.
 	/// @param title The title of the album.
-	/// @return Returns the raw pqxx::result data.
-	static pqxx::result queryArtistTitle(const std::string & artist,
-										 const std::string & title);
+	/// @param limit The most albums to return.
+	/// @return Returns the albums that are alike in both, most alike first.
+	///         The score is the mean similarity of the artist and title, from
+	///         0 to 1.
+	static AlbumMatches queryArtistTitle(const std::string & artist,
+										 const std::string & title,
+										 int limit = SEARCH_LIMIT);
 
-	/// Insert a CD into the database.
+	/// Insert a CD into the database. The AlbumIndex is updated, as it is by
+	/// the other inserts.
 	/// @param album The information to store regarding this album.
 	/// @param tracks The track information for this album.
-	static bool insertCd(const Cd::CdAlbumData & album, const Track::TrackList & tracks);
+	/// @param checksums Optionally, the checksums of the tracks, if the CD
+	///        was ripped. Storing them needs `sql/002_track_checksums.sql`,
+	///        without which they are left out, with a warning.
+	/// @return Returns true if the CD was inserted.
+	static bool insertCd(const Cd::CdAlbumData & album, const Track::TrackList & tracks,
+						 const Checksums::List & checksums = Checksums::List());
+
+	/// Insert several CDs into the database in a single transaction, with
+	/// the tracks of all of them streamed in by one COPY.
+	/// @param cds The albums to insert, with their track information.
+	/// @param checksums Optionally, the checksums of the tracks of each CD,
+	///        as for insertCd.
+	/// @return Returns true if all of the CDs were inserted, false if none were.
+	static bool insertCds(const CdList & cds,
+						  const std::vector<Checksums::List> & checksums = {});
+
+	/// Load several CDs into the database in a single transaction, for bulk
+	/// loading. Unlike insertCds, the album IDs are taken from the sequence up
+	/// front, so that the albums can be streamed in by COPY as well as the
+	/// tracks. Nothing is returned from the albums table.
+	/// @param cds The albums to load, with their track information.
+	/// @param load The name of the load. If it isn't empty, `files` is
+	///        recorded as its progress in the same transaction, so that the
+	///        progress always agrees with what has been loaded. This needs
+	///        `sql/003_load_progress.sql`.
+	/// @param files The number of files of the dump loaded by the end of this
+	///        transaction.
+	/// @return Returns true if all of the CDs were loaded, false if none were.
+	static bool loadCds(const CdList & cds, const std::string & load = "", size_t files = 0);
+
+	/// Read the progress of a load, as recorded by loadCds.
+	/// @param load The name of the load.
+	/// @param files Set to the number of files loaded, or zero if the load
+	///        hasn't been started.
+	/// @return Returns false if the progress can't be read, e.g. since
+	///         `sql/003_load_progress.sql` hasn't been applied.
+	static bool queryLoadProgress(const std::string & load, size_t & files);
 };
 
@@ -0,0 +1,131 @@
+#include <iostream>
+
+#include "pg_pool.h"
+
+#include "trace.h"
+
+PgPool::Lease::Lease(PgPool & pool)
+  : _pool(pool), _conn(pool.acquire())
+{
+}
+
+PgPool::Lease::~Lease()
+{
+	_pool.release(std::move(_conn));
+}
+
+PgPool::PgPool(const std::string & connectionString, size_t size, OnConnect onConnect)
+  : _connectionString(connectionString), _size(size), _onConnect(onConnect)
+{
+}
+
+void PgPool::warmUp()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while(_open < _size) {
+		// Count the connection before unlocking, so no one else overfills the pool
+		++_open;
+		lock.unlock();
+		std::unique_ptr<pqxx::connection> conn;
+		try {
+			conn = connect();
+		} catch(...) {
+			lock.lock();
+			--_open;
+			throw;
+		}
+		lock.lock();
+		_idle.push_back({ std::move(conn), std::chrono::steady_clock::now() });
+		_available.notify_one();
+	}
+#ifdef DEBUG
+	std::cout << "Warmed up " << _open << " database connection(s)." << std::endl;
+#endif
+}
+
+size_t PgPool::openConnections()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _open;
+}
+
+std::unique_ptr<pqxx::connection> PgPool::acquire()
+{
+	TRACE_SPAN("pg_acquire");
+	std::unique_lock<std::mutex> lock(_mutex);
+	for(;;) {
+		// Prefer the most recently used connection, it is the least likely to be stale
+		if(not _idle.empty()) {
+			Idle idle = std::move(_idle.back());
+			_idle.pop_back();
+
+			// Don't hold up the other threads while pinging the server
+			lock.unlock();
+			if(isHealthy(idle)) {
+				return std::move(idle.conn);
+			}
+#ifdef DEBUG
+			std::cout << "Dropping a broken database connection." << std::endl;
+#endif
+			idle.conn.reset();
+			lock.lock();
+			--_open;
+			continue;
+		}
+
+		if(_open < _size) {
+			++_open;
+			lock.unlock();
+			try {
+				return connect();
+			} catch(...) {
+				lock.lock();
+				--_open;
+				_available.notify_one();
+				throw;
+			}
+		}
+
+		// Every connection is in use, wait for one to be returned
+		_available.wait(lock);
+	}
+}
+
+void PgPool::release(std::unique_ptr<pqxx::connection> conn)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(conn and conn->is_open()) {
+		_idle.push_back({ std::move(conn), std::chrono::steady_clock::now() });
+	} else {
+		--_open;
+	}
+	_available.notify_one();
+}
+
+std::unique_ptr<pqxx::connection> PgPool::connect()
+{
+	auto conn = std::make_unique<pqxx::connection>(_connectionString);
+	if(_onConnect) {
+		_onConnect(*conn);
+	}
+	return conn;
+}
+
+bool PgPool::isHealthy(Idle & idle)
+{
+	if(not idle.conn->is_open()) {
+		return false;
+	}
+	if(std::chrono::steady_clock::now() - idle.since < IDLE_CHECK) {
+		return true;
+	}
+	try {
+		pqxx::nontransaction ping(*idle.conn);
+		ping.exec("SELECT 1");
+		return true;
+	} catch(...) {
+		// Not only a broken connection, anything that fails the ping drops the
+		// connection, or acquire() would leave its slot counted as open
+		return false;
+	}
+}
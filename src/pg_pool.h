@@ -0,0 +1,107 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <pqxx/pqxx>
+
+/// A pool of persistent database connections, shared between threads. Opening
+/// a connection costs a TCP connect, authentication and a backend fork on the
+/// server, so rather than paying for that on every query, connections are
+/// opened once and borrowed for the length of a transaction via a Lease.
+///
+/// Connections are health-checked before they are handed out. A connection
+/// that is closed is replaced, and one that has been idle for longer than
+/// #IDLE_CHECK is pinged first, since the server or a firewall may have
+/// dropped it in the meantime.
+class PgPool
+{
+  public:
+
+	/// Idle connections older than this are pinged before being handed out.
+	static constexpr std::chrono::seconds IDLE_CHECK { 30 };
+
+	/// A connection borrowed from the pool. The connection is returned to the
+	/// pool when the lease goes out of scope, or discarded if it was broken.
+	class Lease
+	{
+	  public:
+		/// Borrow a connection, waiting if all of them are in use.
+		/// @param pool The pool to borrow from.
+		explicit Lease(PgPool & pool);
+
+		/// Return the connection to the pool.
+		~Lease();
+
+		Lease(const Lease &) = delete;
+		Lease & operator=(const Lease &) = delete;
+
+		/// Access the borrowed connection.
+		/// @return Returns a connection that is open.
+		inline pqxx::connection & conn() { return *_conn; }
+
+	  private:
+		PgPool & _pool;								///< Where the connection goes back to.
+		std::unique_ptr<pqxx::connection> _conn;	///< The borrowed connection.
+	};
+
+	/// Called on every newly-opened connection, e.g. to prepare statements.
+	typedef std::function<void(pqxx::connection &)> OnConnect;
+
+	/// Construct an empty pool. No connections are opened until warmUp() is
+	/// called or a connection is first borrowed.
+	/// @param connectionString The libpq connection string of the database.
+	/// @param size The maximum number of open connections.
+	/// @param onConnect Optionally, set up each connection once it is opened.
+	PgPool(const std::string & connectionString, size_t size,
+		   OnConnect onConnect = nullptr);
+
+	/// Open connections until the pool is full, so that the first queries
+	/// do not pay for connecting.
+	/// @throws pqxx::broken_connection If the database can't be reached.
+	void warmUp();
+
+	/// The number of connections that are currently open.
+	/// @return Returns a number no larger than the size of the pool.
+	size_t openConnections();
+
+  private:
+
+	/// An idle connection, and when it was returned to the pool.
+	struct Idle
+	{
+		std::unique_ptr<pqxx::connection> conn;			///< The connection.
+		std::chrono::steady_clock::time_point since;	///< When it was last used.
+	};
+
+	/// Take a healthy connection from the pool, or open a new one.
+	/// @return Returns an open connection.
+	std::unique_ptr<pqxx::connection> acquire();
+
+	/// Put a connection back into the pool. Closed connections are dropped.
+	/// @param conn The connection to return.
+	void release(std::unique_ptr<pqxx::connection> conn);
+
+	/// Open a new connection, and set it up.
+	/// @return Returns an open connection.
+	std::unique_ptr<pqxx::connection> connect();
+
+	/// Check that an idle connection is still usable.
+	/// @param idle The connection to check.
+	/// @return Returns true if the connection can be handed out, false if it
+	/// is closed or the ping fails in any way.
+	static bool isHealthy(Idle & idle);
+
+	const std::string _connectionString;	///< The libpq connection string.
+	const size_t _size;						///< The maximum number of connections.
+	const OnConnect _onConnect;				///< Sets up newly-opened connections.
+	size_t _open { 0 };						///< The number of connections open, idle or not.
+	std::vector<Idle> _idle;				///< The connections that are not in use.
+	std::mutex _mutex;						///< Guards the members above.
+	std::condition_variable _available;		///< Signalled when a connection is returned.
+};
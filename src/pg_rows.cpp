@@ -0,0 +1,38 @@
+#include "pg_rows.h"
+
+const std::array<const char *, 4> AlbumMatch::COLUMNS { "artist", "title", "category", "score" };
+
+AlbumMatch AlbumMatch::from(const pqxx::row & row, const Rows<AlbumMatch>::Columns & columns)
+{
+	return {
+		view(row[columns[0]]),
+		view(row[columns[1]]),
+		view(row[columns[2]]),
+		row[columns[3]].as<double>(1.0)
+	};
+}
+
+const std::array<const char *, 1> AlbumKey::COLUMNS { "disc_id" };
+
+AlbumKey AlbumKey::from(const pqxx::row & row, const Rows<AlbumKey>::Columns & columns)
+{
+	return { view(row[columns[0]]) };
+}
+
+const std::array<const char *, 8> CatalogueRow::COLUMNS {
+	"album_id", "artist", "title", "year", "category", "genre", "num_tracks", "length"
+};
+
+CatalogueRow CatalogueRow::from(const pqxx::row & row, const Rows<CatalogueRow>::Columns & columns)
+{
+	return {
+		row[columns[0]].as<int>(0),
+		view(row[columns[1]]),
+		view(row[columns[2]]),
+		row[columns[3]].as<int>(0),
+		view(row[columns[4]]),
+		view(row[columns[5]]),
+		row[columns[6]].as<int>(0),
+		row[columns[7]].as<int>(0)
+	};
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+
+#include <pqxx/pqxx>
+
+/// Typed access to the rows of a query result. Each row is mapped to a
+/// lightweight struct T, by column index, and the indices are looked up by
+/// name only once, when the result is wrapped, rather than once per field.
+///
+/// The string fields of the structs are views of the result, which is shared,
+/// so they stay valid for as long as any copy of the Rows is alive, and
+/// nothing is copied out of the result.
+///
+/// A row type T provides:
+/// - `static const std::array<const char *, N> COLUMNS`, the names of the
+///   columns that it is mapped from;
+/// - `static T from(const pqxx::row & row, const Rows<T>::Columns & columns)`,
+///   which maps a row given the index of each of the COLUMNS.
+template <typename T>
+class Rows
+{
+  public:
+
+	/// The index in the result of each of the columns of T, in the same order
+	/// as T::COLUMNS.
+	typedef std::array<pqxx::row::size_type, std::tuple_size<decltype(T::COLUMNS)>::value> Columns;
+
+	/// Iterate over the rows, mapping each one as it is reached.
+	class const_iterator
+	{
+	  public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const T * pointer;
+		typedef T reference;
+
+		const_iterator(const Rows * rows, size_t i) : _rows(rows), _i(i) {}
+		T operator*() const { return (*_rows)[_i]; }
+		const_iterator & operator++() { ++_i; return *this; }
+		bool operator==(const const_iterator & other) const { return _i == other._i; }
+		bool operator!=(const const_iterator & other) const { return _i != other._i; }
+
+	  private:
+		const Rows * _rows;		///< The rows being iterated over.
+		size_t _i;				///< The index of the current row.
+	};
+
+	/// Construct an empty result.
+	Rows() : _columns {} {}
+
+	/// Wrap a result, and look up the columns of T in it.
+	/// @param result The result of a query that has all of T::COLUMNS.
+	/// @throws pqxx::argument_error If a column is missing.
+	explicit Rows(const pqxx::result & result)
+	  : _result(result), _columns {}
+	{
+		if(not _result.empty()) {
+			for(size_t c=0;c<_columns.size();++c) {
+				_columns[c] = _result.column_number(T::COLUMNS[c]);
+			}
+		}
+	}
+
+	/// The number of rows.
+	inline size_t size() const { return _result.size(); }
+
+	/// Check if there are no rows.
+	inline bool empty() const { return _result.empty(); }
+
+	/// Map a row.
+	/// @param i The index of the row.
+	/// @return Returns the row, whose strings are views of the result.
+	inline T operator[](size_t i) const { return T::from(_result[i], _columns); }
+
+	inline const_iterator begin() const { return const_iterator(this, 0); }
+	inline const_iterator end() const { return const_iterator(this, size()); }
+
+	/// The result that the rows are views of.
+	inline const pqxx::result & result() const { return _result; }
+
+  private:
+	pqxx::result _result;	///< The result, which owns the data.
+	Columns _columns;		///< The index of each of the columns of T.
+};
+
+/// View a field as a string, without copying it.
+/// @param field The field.
+/// @return Returns the text of the field, or empty if it is null.
+inline std::string_view view(const pqxx::field & field)
+{
+	return std::string_view(field.c_str(), field.size());
+}
+
+/// An album found by a duplicate check, see PgConn::queryCdDiscId and
+/// PgConn::queryArtistTitle.
+struct AlbumMatch
+{
+	std::string_view artist;		///< The artist of the album.
+	std::string_view title;			///< The title of the album.
+	std::string_view category;		///< The CDDB category of the album.
+	double score;					///< How alike the album is, from 0 to 1.
+
+	/// The columns that an AlbumMatch is mapped from.
+	static const std::array<const char *, 4> COLUMNS;
+
+	/// Map a row.
+	/// @param row The row.
+	/// @param columns The index of each of the #COLUMNS.
+	/// @return Returns the album.
+	static AlbumMatch from(const pqxx::row & row, const Rows<AlbumMatch>::Columns & columns);
+};
+
+/// The disc ID of an album, for loading the AlbumIndex.
+struct AlbumKey
+{
+	std::string_view discId;		///< The disc ID, empty if there isn't one.
+
+	/// The columns that an AlbumKey is mapped from.
+	static const std::array<const char *, 1> COLUMNS;
+
+	/// Map a row.
+	/// @param row The row.
+	/// @param columns The index of each of the #COLUMNS.
+	/// @return Returns the key.
+	static AlbumKey from(const pqxx::row & row, const Rows<AlbumKey>::Columns & columns);
+};
+
+/// An album in the catalogue, as listed by CatalogueModel.
+struct CatalogueRow
+{
+	int albumId;					///< The album ID.
+	std::string_view artist;		///< The artist of the album.
+	std::string_view title;			///< The title of the album.
+	int year;						///< The year of the album, or 0 if unknown.
+	std::string_view category;		///< The CDDB category of the album.
+	std::string_view genre;			///< The genre of the album.
+	int numTracks;					///< The number of tracks.
+	int length;						///< The total runtime in seconds.
+
+	/// The columns that a CatalogueRow is mapped from.
+	static const std::array<const char *, 8> COLUMNS;
+
+	/// Map a row.
+	/// @param row The row.
+	/// @param columns The index of each of the #COLUMNS.
+	/// @return Returns the album.
+	static CatalogueRow from(const pqxx::row & row, const Rows<CatalogueRow>::Columns & columns);
+};
+
+/// The albums found by a duplicate check.
+typedef Rows<AlbumMatch> AlbumMatches;
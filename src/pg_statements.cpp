@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <iterator>
+#include <vector>
+
+#include "pg_statements.h"
+
+PgStatements::Statement PgStatements::_statements[NUM_STATEMENTS] = {
+	{
+		"query_cd_disc_id",
+		"SELECT artist, title, categories.category, 1.0::real AS score "
+			"FROM albums "
+			"INNER JOIN categories "
+			"ON albums.category_id = categories.category_id "
+			"WHERE albums.disc_id = $1;",
+		nullptr,
+		0, 0.0, 0.0
+	},
+	{
+		"query_artist_title",
+		// The % operators use the trigram indexes of sql/001_fuzzy_search.sql
+		"SELECT artist, title, category, score "
+			"FROM ("
+				"SELECT artist, title, categories.category, "
+					"(similarity(album_key(artist), album_key($1)) "
+					"+ similarity(album_key(title), album_key($2))) / 2 AS score "
+				"FROM albums "
+				"INNER JOIN categories "
+				"ON albums.category_id = categories.category_id "
+				"WHERE album_key(artist) % album_key($1) "
+				"AND album_key(title) % album_key($2)"
+			") AS matches "
+			"ORDER BY score DESC "
+			"LIMIT $3;",
+		"sql/001_fuzzy_search.sql",
+		0, 0.0, 0.0
+	},
+	{
+		"insert_album",
+		"INSERT INTO albums("
+			"medium_id, "
+			"type_id, "
+			"category_id, "
+			"is_compilation, "
+			"result_id, "
+			"disc_id, "
+			"title, "
+			"artist, "
+			"genre, "
+			"length, "
+			"extra_info, "
+			"year, "
+			"num_tracks"
+		") VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13) "
+		"RETURNING album_id",
+		nullptr,
+		0, 0.0, 0.0
+	},
+	{
+		"copy_tracks",
+		nullptr,	// COPY can't be prepared
+		nullptr,
+		0, 0.0, 0.0
+	},
+	{
+		"reserve_album_ids",
+		"SELECT nextval(pg_get_serial_sequence('albums', 'album_id')) "
+			"FROM generate_series(1, $1);",
+		nullptr,
+		0, 0.0, 0.0
+	},
+	{
+		"copy_albums",
+		nullptr,	// COPY can't be prepared
+		nullptr,
+		0, 0.0, 0.0
+	},
+	{
+		"query_album_keys",
+		"SELECT disc_id FROM albums;",
+		nullptr,
+		0, 0.0, 0.0
+	},
+	{
+		"query_catalogue",
+		nullptr,	// Built by CatalogueModel for its sort order and filter
+		nullptr,
+		0, 0.0, 0.0
+	},
+	{
+		"query_load_progress",
+		"SELECT files FROM load_progress WHERE name = $1;",
+		"sql/003_load_progress.sql",
+		0, 0.0, 0.0
+	},
+	{
+		"save_load_progress",
+		"INSERT INTO load_progress(name, files) VALUES ($1, $2) "
+			"ON CONFLICT (name) DO UPDATE SET files = EXCLUDED.files, updated = now();",
+		"sql/003_load_progress.sql",
+		0, 0.0, 0.0
+	},
+	{
+		"probe_track_checksums",
+		// Only prepared, to find out if copyTracks can stream the checksums
+		"SELECT crc32, accuraterip_v1, accuraterip_v2 FROM tracks LIMIT 0;",
+		"sql/002_track_checksums.sql",
+		0, 0.0, 0.0
+	},
+	{
+		"query_artist_title_ilike",
+		// The search before sql/001_fuzzy_search.sql, which only finds the
+		// same artist and title, ignoring case
+		"SELECT artist, title, category, 1.0::real AS score "
+			"FROM v_albums "
+			"WHERE artist ILIKE $1 AND title ILIKE $2 "
+			"LIMIT $3;",
+		nullptr,
+		0, 0.0, 0.0
+	}
+};
+
+std::atomic<bool> PgStatements::_available[NUM_STATEMENTS] = {};
+
+std::mutex PgStatements::_mutex;
+
+const char * PgStatements::name(Id id)
+{
+	return _statements[id].name;
+}
+
+const char * PgStatements::sql(Id id)
+{
+	return _statements[id].sql;
+}
+
+void PgStatements::prepare(pqxx::connection & conn)
+{
+	static std::atomic<bool> reported[NUM_STATEMENTS] = {};
+	for(int id=0;id<NUM_STATEMENTS;++id) {
+		const Statement & statement = _statements[id];
+		if(statement.sql == nullptr) {
+			continue;
+		}
+		if(statement.script == nullptr) {
+			conn.prepare(statement.name, statement.sql);
+			continue;
+		}
+		// Outside of a transaction, a failed PREPARE leaves the connection usable
+		try {
+			conn.prepare(statement.name, statement.sql);
+			_available[id] = true;
+		} catch(const pqxx::sql_error & e) {
+			_available[id] = false;
+			if(not reported[id].exchange(true)) {
+				std::cerr << "The " << statement.name << " statement is unavailable until "
+						  << statement.script << " is applied: " << e.what() << std::endl;
+			}
+		}
+	}
+}
+
+bool PgStatements::isAvailable(Id id)
+{
+	return _statements[id].script == nullptr or _available[id];
+}
+
+void PgStatements::record(Id id, std::chrono::steady_clock::duration elapsed)
+{
+	double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+	std::lock_guard<std::mutex> lock(_mutex);
+	Statement & statement = _statements[id];
+	++statement.calls;
+	statement.totalMs += ms;
+	statement.maxMs = std::max(statement.maxMs, ms);
+}
+
+void PgStatements::report(std::ostream & out)
+{
+	std::vector<Statement> called;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		std::copy_if(std::begin(_statements), std::end(_statements), std::back_inserter(called),
+					 [](const Statement & s) { return s.calls > 0; });
+	}
+	if(called.empty()) {
+		return;
+	}
+	std::sort(called.begin(), called.end(), [](const Statement & a, const Statement & b) {
+		return a.totalMs > b.totalMs;
+	});
+
+	out << "Database statements:" << std::endl;
+	for(const auto & s : called) {
+		out << "  " << std::left << std::setw(20) << s.name << std::right << std::fixed
+			<< std::setprecision(2)
+			<< std::setw(8) << s.calls << " calls"
+			<< std::setw(12) << s.totalMs << " ms total"
+			<< std::setw(10) << s.totalMs / s.calls << " ms mean"
+			<< std::setw(10) << s.maxMs << " ms max" << std::endl;
+	}
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+#include <pqxx/pqxx>
+
+/// Registry of the SQL statements used by PgConn. Each statement is prepared
+/// under its name once per connection, when the connection is opened by the
+/// PgPool, so the server parses and plans it only once. The registry also
+/// keeps track of how often each statement is called and how long the calls
+/// take, which can be printed with report().
+///
+/// A statement that needs a script under `sql/` names the script. If it can't
+/// be prepared, e.g. since the script hasn't been applied, the connection is
+/// still used for the other statements, and the statement is marked as
+/// unavailable, which is reported once.
+class PgStatements
+{
+  public:
+
+	/// The statements, used to look up their names and to record their timings.
+	enum Id
+	{
+		QueryCdDiscId = 0,	///< Look for an album by disc ID.
+		QueryArtistTitle,	///< Look for albums like an artist and title, closest first.
+		InsertAlbum,		///< Insert a row into the albums table.
+		CopyTracks,			///< Stream rows into the tracks table. Not prepared.
+		ReserveAlbumIds,	///< Take a number of album IDs from the albums sequence.
+		CopyAlbums,			///< Stream rows into the albums table. Not prepared.
+		QueryAlbumKeys,		///< Get the disc ID of every album.
+		QueryCatalogue,		///< Read a page of the catalogue through a cursor. Not prepared.
+		QueryLoadProgress,	///< Get the files loaded so far by a load of a dump.
+		SaveLoadProgress,	///< Record the files loaded so far by a load of a dump.
+		ProbeTrackChecksums,	///< Check that the tracks table has the checksum columns. Never called.
+		QueryArtistTitleIlike,	///< Look for albums by artist and title with ILIKE, without sql/001.
+		NUM_STATEMENTS
+	};
+
+	/// Time a call of a statement, from construction to destruction.
+	class Timer
+	{
+	  public:
+		/// Start timing.
+		/// @param id The statement that is being called.
+		explicit Timer(Id id)
+		  : _id(id), _start(std::chrono::steady_clock::now())
+		{}
+
+		/// Stop timing, and record the call.
+		~Timer() { record(_id, std::chrono::steady_clock::now() - _start); }
+
+	  private:
+		Id _id;												///< The statement being called.
+		std::chrono::steady_clock::time_point _start;		///< When the call started.
+	};
+
+	/// Get the name that a statement is prepared under.
+	/// @param id The statement.
+	/// @return Returns the name of the statement.
+	static const char * name(Id id);
+
+	/// Get the SQL that a statement is prepared with, e.g. to run the same
+	/// statement without preparing it.
+	/// @param id The statement.
+	/// @return Returns the SQL, or nullptr if the statement isn't prepared.
+	static const char * sql(Id id);
+
+	/// Prepare all of the statements on a newly-opened connection.
+	/// @param conn The connection.
+	static void prepare(pqxx::connection & conn);
+
+	/// Check if a statement could be prepared when the last connection was
+	/// opened. Only a statement that needs a script under `sql/` can be
+	/// unavailable.
+	/// @param id The statement.
+	/// @return Returns false if the statement couldn't be prepared.
+	static bool isAvailable(Id id);
+
+	/// Record a call of a statement.
+	/// @param id The statement that was called.
+	/// @param elapsed How long the call took.
+	static void record(Id id, std::chrono::steady_clock::duration elapsed);
+
+	/// Print the number of calls and the timings of each statement that has
+	/// been called, the slowest in total first.
+	/// @param out Where to print the report.
+	static void report(std::ostream & out);
+
+  private:
+
+	/// A statement, and what is known about its calls.
+	struct Statement
+	{
+		const char * name;		///< The name of the prepared statement.
+		const char * sql;		///< The SQL, or nullptr if it isn't prepared.
+		const char * script;	///< The script under sql/ that the statement needs, or nullptr.
+		uint64_t calls;			///< The number of calls.
+		double totalMs;			///< The total time spent in calls.
+		double maxMs;			///< The slowest call.
+	};
+
+	static Statement _statements[NUM_STATEMENTS];	///< Indexed by Id.
+	static std::atomic<bool> _available[NUM_STATEMENTS];	///< Indexed by Id.
+	static std::mutex _mutex;						///< Guards the call statistics.
+};
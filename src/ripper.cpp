@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include <fcntl.h>			// Linux only, the CDROM ioctls
+#include <linux/cdrom.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ripper.h"
+
+#include "exceptions.h"
+#include "metrics.h"
+#include "trace.h"
+#include "utility.h"
+
+/// The frame offset of the start of the disc, which the offsets in a Toc
+/// include, but the addresses read from the drive don't.
+static const int LEAD_IN = 150;
+
+/// The frames between the last audio track of the first session and a data
+/// track in the next, on an enhanced CD. They are counted as part of the
+/// audio track, but can't be read as audio.
+static const int SESSION_GAP = 11400;
+
+/// Close a file descriptor when it goes out of scope.
+struct FileDescriptor
+{
+	int fd;		///< The descriptor, or negative if it isn't open.
+	~FileDescriptor() { if(fd >= 0) { ::close(fd); } }
+};
+
+BoundedQueue<Ripper::Job> Ripper::_jobs(Ripper::QUEUE_TRACKS);
+
+std::vector<std::thread> Ripper::_encoders;
+
+std::mutex Ripper::_mutex;
+
+size_t Ripper::_buffered = 0;
+
+std::mutex Ripper::_bufferMutex;
+
+std::condition_variable Ripper::_bufferFreed;
+
+bool Ripper::enabled()
+{
+	const char * dir = std::getenv("CDIMPORT_RIP_DIR");
+	return dir != nullptr and *dir != '\0';
+}
+
+Checksums::List Ripper::rip(const std::string & device, const Toc & toc, const Cd::CdAlbumData & album,
+				 const Track::TrackList & tracks, const Progress & progress)
+{
+	namespace fs = std::filesystem;
+	if(not enabled()) {
+		throw RipError("Ripping is turned off, since CDIMPORT_RIP_DIR isn't set.");
+	}
+	struct stat st;
+	if(::stat(device.c_str(), &st) == 0 and S_ISREG(st.st_mode)) {
+		throw RipError("There is no audio to rip from " + device + ", which stands in for a drive.");
+	}
+
+	FileDescriptor drive { ::open(device.c_str(), O_RDONLY | O_NONBLOCK) };
+	int fd = drive.fd;
+	if(fd < 0) {
+		throw RipError("Unable to open " + device + ": " + std::strerror(errno));
+	}
+
+	// The TOC doesn't say which tracks hold data, so ask the drive
+	cdrom_tochdr header;
+	if(ioctl(fd, CDROMREADTOCHDR, &header) != 0) {
+		throw RipError("Unable to read the table of contents of " + device + ".");
+	}
+	int numTracks = toc.offsets.size();
+	std::vector<bool> data(numTracks);
+	int audioTracks = 0;
+	int firstAudio = -1;
+	int lastAudio = -1;
+	cdrom_tocentry entry;
+	std::memset(&entry, 0, sizeof(entry));
+	entry.cdte_format = CDROM_LBA;
+	for(int i=0;i<numTracks;++i) {
+		entry.cdte_track = header.cdth_trk0 + i;
+		if(ioctl(fd, CDROMREADTOCENTRY, &entry) != 0) {
+			throw RipError("Unable to read the table of contents of " + device + ".");
+		}
+		data[i] = (entry.cdte_ctrl & CDROM_DATA_TRACK) != 0;
+		if(not data[i]) {
+			++audioTracks;
+			firstAudio = firstAudio < 0 ? i : firstAudio;
+			lastAudio = i;
+		}
+	}
+	if(audioTracks == 0) {
+		throw RipError("There are no audio tracks on the disc.");
+	}
+
+	fs::path dir = fs::path(std::getenv("CDIMPORT_RIP_DIR"))
+				 / fileName(std::get<Cd::Artist>(album)) / fileName(std::get<Cd::Title>(album));
+	std::error_code error;
+	fs::create_directories(dir, error);
+	if(error) {
+		throw RipError("Unable to create " + dir.string() + ": " + error.message());
+	}
+
+	start();
+	Checksums::List checksums(numTracks);
+	std::vector<std::pair<int, std::future<bool>>> encoded;
+	int ripped = 0;
+	for(int i=0;i<numTracks;++i) {
+		if(data[i]) {
+			continue;
+		}
+		int first = toc.offsets[i] - LEAD_IN;
+		int end = (i + 1 < numTracks ? toc.offsets[i + 1] : toc.leadOut) - LEAD_IN;
+		if(i + 1 < numTracks and data[i + 1]) {
+			end -= SESSION_GAP;
+		}
+		if(end <= first) {
+			throw RipError("Track " + std::to_string(i + 1) + " of the disc is empty.");
+		}
+
+		Job job;
+		job.bytes = static_cast<size_t>(end - first) * FRAME_BYTES;
+		{
+			// The drive waits here while the encoders hold too much audio
+			TRACE_SPAN("wait_for_buffer");
+			reserve(job.bytes);
+		}
+		try {
+			readTrack(fd, device, i + 1, first, end, job.audio);
+		} catch(...) {
+			release(job.bytes);
+			throw;
+		}
+
+		{
+			// AccurateRip leaves out the ends of the audio, not of the disc
+			TRACE_SPAN("checksum");
+			checksums[i] = Checksums::track(job.audio.data(), job.audio.size(),
+											i == firstAudio, i == lastAudio);
+		}
+
+		std::string title = i < tracks.size() ? std::get<Track::Title>(tracks[i]) : "";
+		std::string extraInfo = i < tracks.size() ? std::get<Track::ExtraInfo>(tracks[i]) : "";
+		if(title.empty()) {
+			title = "Track " + std::to_string(i + 1);
+		}
+		char number[4];
+		std::snprintf(number, sizeof(number), "%02d", i + 1);
+		job.path = (dir / (number + std::string(" - ") + fileName(title) + ".flac")).string();
+		job.tags = tags(album, i + 1, audioTracks, title, extraInfo);
+		encoded.emplace_back(i + 1, job.encoded.get_future());
+		{
+			// The drive waits here while the encoders are all busy
+			TRACE_SPAN("wait_for_encoder");
+			size_t bytes = job.bytes;
+			if(not _jobs.push(std::move(job))) {
+				release(bytes);
+				throw RipError("The encoders have been stopped.");
+			}
+		}
+		++ripped;
+		if(progress) {
+			progress(ripped, audioTracks);
+		}
+	}
+
+	// The album is only saved as ripped once all of its files are there
+	TRACE_SPAN("wait_for_encoding");
+	std::string failed;
+	for(auto & [track, done] : encoded) {
+		if(not done.get()) {
+			failed += (failed.empty() ? "" : ", ") + std::to_string(track);
+		}
+	}
+	if(not failed.empty()) {
+		throw RipError("Unable to encode track(s) " + failed + " of the disc to " + dir.string() + ".");
+	}
+	return checksums;
+}
+
+void Ripper::finish()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_jobs.close();
+	for(auto & encoder : _encoders) {
+		encoder.join();
+	}
+	_encoders.clear();
+}
+
+void Ripper::start()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(not _encoders.empty()) {
+		return;
+	}
+	unsigned encoders = std::max(1u, std::thread::hardware_concurrency());
+	for(unsigned i=0;i<encoders;++i) {
+		_encoders.emplace_back(&Ripper::encoder);
+	}
+}
+
+void Ripper::encoder()
+{
+	// A `flac` that dies then makes the write fail, rather than killing the
+	// program with SIGPIPE
+	sigset_t pipe;
+	sigemptyset(&pipe);
+	sigaddset(&pipe, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipe, nullptr);
+
+	Job job;
+	while(_jobs.pop(job)) {
+		bool ok;
+		{
+			Metrics::Timer timer(Metrics::Encode);
+			ok = encode(job);
+			if(not ok) {
+				timer.setOutcome(Metrics::Error);
+			}
+		}
+		// Free the audio before a drive that waits for room is told of it
+		std::vector<char>().swap(job.audio);
+		release(job.bytes);
+		job.encoded.set_value(ok);
+	}
+}
+
+bool Ripper::encode(const Job & job)
+{
+	std::string temp = job.path + ".part";
+	std::string command = "flac --silent --force --force-raw-format --endian=little --sign=signed"
+						  " --channels=2 --bps=16 --sample-rate=44100";
+	for(const auto & tag : job.tags) {
+		command += " -T " + Utility::shellQuote(tag);
+	}
+	command += " -o " + Utility::shellQuote(temp) + " -";
+
+	FILE * pipe = popen(command.c_str(), "w");
+	if(pipe == nullptr) {
+		std::cerr << "Unable to run flac to encode " << job.path << std::endl;
+		return false;
+	}
+	size_t written = std::fwrite(job.audio.data(), 1, job.audio.size(), pipe);
+	int status = pclose(pipe);
+	if(written != job.audio.size() or status != 0) {
+		std::cerr << "Unable to encode " << job.path << std::endl;
+		std::remove(temp.c_str());
+		return false;
+	}
+	if(std::rename(temp.c_str(), job.path.c_str()) != 0) {
+		std::cerr << "Unable to rename " << temp << " to " << job.path << std::endl;
+		std::remove(temp.c_str());
+		return false;
+	}
+#ifdef DEBUG
+	std::cout << "Encoded " << job.path << std::endl;
+#endif
+	return true;
+}
+
+void Ripper::readTrack(int fd, const std::string & device, int track, int first, int end,
+						std::vector<char> & audio)
+{
+	Metrics::Timer timer(Metrics::ReadAudio);
+	Trace::Span span("read_audio");
+	span.arg("track", std::to_string(track));
+	audio.resize(static_cast<size_t>(end - first) * FRAME_BYTES);
+	for(int frame=first;frame<end;frame+=READ_FRAMES) {
+		cdrom_read_audio request;
+		request.addr.lba = frame;
+		request.addr_format = CDROM_LBA;
+		request.nframes = std::min(READ_FRAMES, end - frame);
+		request.buf = reinterpret_cast<__u8 *>(&audio[static_cast<size_t>(frame - first) * FRAME_BYTES]);
+		int tries = 1;
+		while(ioctl(fd, CDROMREADAUDIO, &request) != 0) {
+			if(tries++ == READ_TRIES) {
+				timer.setOutcome(Metrics::Error);
+				throw RipError("Unable to read track " + std::to_string(track) + " of "
+							   + device + ": " + std::strerror(errno));
+			}
+		}
+	}
+}
+
+void Ripper::reserve(size_t bytes)
+{
+	std::unique_lock<std::mutex> lock(_bufferMutex);
+	_bufferFreed.wait(lock, [bytes] { return _buffered == 0 or _buffered + bytes <= BUFFER_BYTES; });
+	_buffered += bytes;
+}
+
+void Ripper::release(size_t bytes)
+{
+	{
+		std::lock_guard<std::mutex> lock(_bufferMutex);
+		_buffered -= bytes;
+	}
+	_bufferFreed.notify_all();
+}
+
+std::vector<std::string> Ripper::tags(const Cd::CdAlbumData & album, int number, int tracks,
+									  const std::string & title, const std::string & extraInfo)
+{
+	std::vector<std::string> tags;
+	const std::string & albumArtist = std::get<Cd::Artist>(album);
+	std::string artist = albumArtist;
+	std::string trackTitle = title;
+	if(std::get<Cd::IsCompilation>(album)) {
+		tags.push_back("ALBUMARTIST=" + albumArtist);
+		auto slash = title.find(" / ");
+		if(slash != std::string::npos) {
+			artist = title.substr(0, slash);
+			trackTitle = title.substr(slash + 3);
+		}
+	}
+	tags.push_back("ARTIST=" + artist);
+	tags.push_back("TITLE=" + trackTitle);
+	tags.push_back("ALBUM=" + std::get<Cd::Title>(album));
+	tags.push_back("TRACKNUMBER=" + std::to_string(number));
+	tags.push_back("TRACKTOTAL=" + std::to_string(tracks));
+	if(std::get<Cd::Year>(album) > 0) {
+		tags.push_back("DATE=" + std::to_string(std::get<Cd::Year>(album)));
+	}
+	if(not std::get<Cd::Genre>(album).empty()) {
+		tags.push_back("GENRE=" + std::get<Cd::Genre>(album));
+	}
+	if(not extraInfo.empty()) {
+		tags.push_back("COMMENT=" + extraInfo);
+	}
+	// A disc ID of "NULL" stands for none in the database
+	if(std::get<Cd::DiscId>(album) != "NULL") {
+		tags.push_back("CDDB=" + std::get<Cd::DiscId>(album));
+	}
+	return tags;
+}
+
+std::string Ripper::fileName(const std::string & name)
+{
+	std::string safe(name);
+	std::replace(safe.begin(), safe.end(), '/', '-');
+	safe.erase(0, safe.find_first_not_of(". "));
+	return safe.empty() ? "Unknown" : safe;
+}
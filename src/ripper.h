@@ -0,0 +1,159 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "cd.h"
+#include "checksums.h"
+#include "toc.h"
+
+/// Rip the audio of a disc to tagged FLAC files while it is being saved, so
+/// that a disc only goes through the drive once, and the metadata that was
+/// looked up and edited for the catalogue is the metadata the files get. This
+/// replaces ripping the discs again afterwards with `abcde`, which reads each
+/// disc and looks it up a second time.
+///
+/// Ripping is off unless the `CDIMPORT_RIP_DIR` environment variable names a
+/// directory. The files are written there as `ARTIST/TITLE/NN - TRACK.flac`.
+///
+/// The rip is a pipeline of two stages, joined by a bounded queue:
+/// - The drive's CddbLookup worker reads the audio of one track after another
+///   with the `CDROMREADAUDIO` ioctl, and queues each track as soon as it has
+///   been read. The checksums of each track are computed as it is queued (see
+///   Checksums), so that they can be inserted with the tracks.
+/// - A pool of encoders, one per core, shared by all of the drives, pipes the
+///   tracks through the `flac` command, which also writes the tags. A file
+///   only appears under its own name once it has been encoded.
+///
+/// The audio that has been read but not yet encoded is held in memory, up to
+/// #BUFFER_BYTES for all of the drives, beyond which a drive waits for the
+/// encoders before it reads the next track. The rip is only done once every
+/// track has been encoded, so an album is never catalogued as ripped without
+/// its files.
+///
+/// The audio is read as it comes off the drive, without the jitter correction
+/// and error recovery of `cdparanoia`, so a scratched disc is better ripped
+/// with that.
+class Ripper
+{
+  public:
+
+	/// The bytes in a frame (sector) of audio, 1/75 of a second of 16-bit
+	/// stereo at 44.1 kHz.
+	static const int FRAME_BYTES = 2352;
+
+	/// The frames read with one ioctl, which is the most that the driver
+	/// allows.
+	static const int READ_FRAMES = 75;
+
+	/// The times a read is tried before the rip fails.
+	static const int READ_TRIES = 3;
+
+	/// The tracks that wait for an encoder.
+	static const size_t QUEUE_TRACKS = 4;
+
+	/// The most bytes of audio held by the pipeline, read but not yet
+	/// encoded, about 25 minutes of it. A longer track is still ripped, but
+	/// only once nothing else is held.
+	static const size_t BUFFER_BYTES = static_cast<size_t>(256) << 20;
+
+	/// Called as each track has been read.
+	/// @param track The number of tracks read so far.
+	/// @param tracks The number of audio tracks on the disc.
+	typedef std::function<void(int track, int tracks)> Progress;
+
+	/// Check if ripping has been turned on by `CDIMPORT_RIP_DIR`.
+	static bool enabled();
+
+	/// Read the audio tracks of the disc in a drive, queue them for the
+	/// encoders, and wait for them to be encoded. Data tracks are skipped.
+	/// @param device The device name of the drive.
+	/// @param toc The table of contents of the disc.
+	/// @param album The album, as it is saved.
+	/// @param tracks The tracks, as they are saved.
+	/// @param progress Told about each track as it has been read.
+	/// @return Returns the checksums of each track, or none for a data track.
+	/// @throws RipError If the audio can't be read, e.g. since the device is
+	///         a file that stands in for a drive, or if any of the tracks
+	///         couldn't be encoded.
+	static Checksums::List rip(const std::string & device, const Toc & toc, const Cd::CdAlbumData & album,
+					const Track::TrackList & tracks, const Progress & progress = nullptr);
+
+	/// Wait for the tracks that have been queued to be encoded, and stop the
+	/// encoders. This must be called before the program exits, if anything
+	/// was ripped.
+	static void finish();
+
+  private:
+
+	/// A track that has been read, and what to encode it to.
+	struct Job
+	{
+		std::string path;				///< The FLAC file.
+		std::vector<std::string> tags;	///< The Vorbis comments, as `NAME=value`.
+		std::vector<char> audio;		///< Raw 16-bit little-endian stereo samples.
+		size_t bytes { 0 };				///< The bytes of #BUFFER_BYTES taken by the audio.
+		std::promise<bool> encoded;		///< Set once the track has been encoded, or has failed.
+	};
+
+	/// Read the audio of a track.
+	/// @param fd The drive, opened.
+	/// @param device The device name of the drive, for errors.
+	/// @param track The number of the track, from 1, for errors.
+	/// @param first The address of the first frame of the track.
+	/// @param end The address of the frame after the track.
+	/// @param audio Set to the audio.
+	/// @throws RipError If the audio can't be read.
+	static void readTrack(int fd, const std::string & device, int track, int first, int end,
+						  std::vector<char> & audio);
+
+	/// Take room for a track in the buffer, waiting until there is some.
+	/// @param bytes The size of the audio of the track.
+	static void reserve(size_t bytes);
+
+	/// Give back the room taken by a track, once its audio has been freed.
+	/// @param bytes The size of the audio of the track.
+	static void release(size_t bytes);
+
+	/// Start the encoders, if they haven't been started.
+	static void start();
+
+	/// Encode jobs until the queue is closed and empty.
+	static void encoder();
+
+	/// Encode one track, into a temporary file that is renamed once it is
+	/// complete.
+	/// @param job The track.
+	/// @return Returns false if the track couldn't be encoded.
+	static bool encode(const Job & job);
+
+	/// The tags of a track. On a compilation, a track title of the form
+	/// `ARTIST / TITLE` is split into the track's artist and title.
+	/// @param album The album.
+	/// @param number The number of the track, from 1.
+	/// @param tracks The number of audio tracks.
+	/// @param title The title of the track.
+	/// @param extraInfo The extra information of the track.
+	/// @return Returns the Vorbis comments.
+	static std::vector<std::string> tags(const Cd::CdAlbumData & album, int number, int tracks,
+										 const std::string & title, const std::string & extraInfo);
+
+	/// Make a name safe to use as a file or directory name.
+	/// @param name The name, e.g. a track title.
+	/// @return Returns the name with slashes replaced, and without leading
+	///         dots, or "Unknown" if it is empty.
+	static std::string fileName(const std::string & name);
+
+	static BoundedQueue<Job> _jobs;				///< From the readers to the encoders.
+	static std::vector<std::thread> _encoders;	///< The encoders, once started.
+	static std::mutex _mutex;					///< Guards starting and stopping the encoders.
+	static size_t _buffered;					///< The bytes of audio held by the pipeline.
+	static std::mutex _bufferMutex;				///< Guards the bytes held.
+	static std::condition_variable _bufferFreed;	///< Signalled when bytes are given back.
+};
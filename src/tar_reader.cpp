@@ -0,0 +1,186 @@
+#include <cstdlib>
+#include <stdexcept>
+
+#include <sys/wait.h>		// POSIX only, for the exit status of the decompressor
+
+#include "tar_reader.h"
+
+/// Parse a number field of a header. The fields are octal, padded with
+/// spaces or NULs.
+/// @param field The field.
+/// @param size The size of the field.
+/// @return Returns the number.
+static size_t octal(const char * field, size_t size)
+{
+	size_t value = 0;
+	for(size_t i=0;i<size;++i) {
+		char c = field[i];
+		if(c >= '0' and c <= '7') {
+			value = value * 8 + (c - '0');
+		} else if(c != ' ' or value != 0) {
+			break;
+		}
+	}
+	return value;
+}
+
+/// Get a string field of a header, which is NUL-terminated unless it fills
+/// the whole field.
+/// @param field The field.
+/// @param size The size of the field.
+/// @return Returns the string.
+static std::string text(const char * field, size_t size)
+{
+	size_t length = 0;
+	while(length < size and field[length] != '\0') {
+		++length;
+	}
+	return std::string(field, length);
+}
+
+TarReader::TarReader(const std::string & path)
+  : _path(path)
+{
+	std::string command = decompressor(path);
+	if(command.empty()) {
+		_file = std::fopen(path.c_str(), "rb");
+	} else {
+		// Quote the path for the shell
+		std::string quoted = "'";
+		for(char c : path) {
+			quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+		}
+		quoted += "'";
+		_file = popen((command + " " + quoted).c_str(), "r");
+		_piped = true;
+	}
+	if(_file == nullptr) {
+		throw std::runtime_error("Unable to open the archive " + path + ".");
+	}
+}
+
+TarReader::~TarReader()
+{
+	if(_file == nullptr) {
+		return;
+	}
+	if(_piped) {
+		pclose(_file);
+	} else {
+		std::fclose(_file);
+	}
+}
+
+void TarReader::close()
+{
+	if(_file == nullptr) {
+		return;
+	}
+	FILE * file = _file;
+	_file = nullptr;
+	if(not _piped) {
+		std::fclose(file);
+		return;
+	}
+	// Read the padding after the end of the archive, so that the
+	// decompressor isn't killed by SIGPIPE for writing it
+	char buffer[BLOCK_SIZE * 20];
+	while(std::fread(buffer, 1, sizeof(buffer), file) > 0) {
+	}
+	int status = pclose(file);
+	if(status != 0) {
+		throw std::runtime_error("Unable to decompress the archive " + _path + " (exit status "
+								 + std::to_string(status == -1 ? -1 : WEXITSTATUS(status)) + ").");
+	}
+}
+
+bool TarReader::next(std::string & name, std::string & content)
+{
+	char header[BLOCK_SIZE];
+	std::string longName;
+	while(read(header, BLOCK_SIZE)) {
+		// The archive ends with (at least) one block of zeros
+		if(header[0] == '\0') {
+			return false;
+		}
+
+		size_t size = octal(header + 124, 12);
+		char type = header[156];
+		if(type == 'L') {
+			// A GNU long name, which is the name of the following entry
+			readContent(size, &longName);
+			longName = text(longName.data(), longName.size());
+			continue;
+		}
+		if(type != '0' and type != '\0') {
+			readContent(size, nullptr);
+			longName.clear();
+			continue;
+		}
+
+		if(not longName.empty()) {
+			name.swap(longName);
+		} else {
+			name = text(header, 100);
+			std::string prefix = text(header + 345, 155);
+			if(not prefix.empty()) {
+				name = prefix + "/" + name;
+			}
+		}
+		readContent(size, &content);
+		return true;
+	}
+	return false;
+}
+
+bool TarReader::read(char * buffer, size_t size)
+{
+	size_t got = std::fread(buffer, 1, size, _file);
+	if(got == 0) {
+		if(not _started) {
+			throw std::runtime_error("The archive " + _path + " is empty, or couldn't be read.");
+		}
+		return false;
+	}
+	_started = true;
+	if(got != size) {
+		throw std::runtime_error("The archive is truncated.");
+	}
+	return true;
+}
+
+void TarReader::readContent(size_t size, std::string * content)
+{
+	size_t padded = (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+	std::string discard;
+	std::string & buffer = content != nullptr ? *content : discard;
+	buffer.resize(padded);
+	if(padded > 0 and not read(buffer.data(), padded)) {
+		throw std::runtime_error("The archive is truncated.");
+	}
+	buffer.resize(size);
+}
+
+std::string TarReader::decompressor(const std::string & path)
+{
+	auto endsWith = [&path](const std::string & suffix) {
+		return path.size() >= suffix.size()
+			and path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+	};
+	std::string command;
+	if(endsWith(".bz2") or endsWith(".tbz2")) {
+		command = "bzip2 -dc";
+	} else if(endsWith(".gz") or endsWith(".tgz")) {
+		command = "gzip -dc";
+	} else if(endsWith(".xz") or endsWith(".txz")) {
+		command = "xz -dc";
+	} else if(endsWith(".zst")) {
+		command = "zstd -dc";
+	}
+
+	const char * override = std::getenv("DUMP_DECOMPRESSOR");
+	if(not command.empty() and override != nullptr and *override != '\0') {
+		command = override;
+	}
+	return command;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+/// A minimal, streaming reader of ustar archives, as used for the freedb and
+/// gnudb dumps. Only regular files are returned; directories, links and the
+/// like are skipped. GNU long names are supported, since some dumps use them.
+///
+/// Compressed archives are read through a decompressor that is run with
+/// `popen`, chosen by the extension of the archive (`bzip2`, `gzip`, `xz` or
+/// `zstd`). A faster, parallel decompressor such as `lbzip2 -dc` can be used
+/// instead for compressed archives by setting the `DUMP_DECOMPRESSOR` environment
+/// variable.
+class TarReader
+{
+  public:
+
+	/// The size of the blocks that an archive is made up of.
+	static const size_t BLOCK_SIZE = 512;
+
+	/// Open an archive.
+	/// @param path The path of the archive.
+	/// @throws std::runtime_error If the archive can't be opened.
+	explicit TarReader(const std::string & path);
+
+	/// Close the archive, if close() hasn't been called, and wait for the
+	/// decompressor to exit, without checking how it exited.
+	~TarReader();
+
+	TarReader(const TarReader &) = delete;
+	TarReader & operator=(const TarReader &) = delete;
+
+	/// Read the next regular file in the archive.
+	/// @param name Set to the path of the file in the archive.
+	/// @param content Set to the content of the file.
+	/// @return Returns false at the end of the archive.
+	/// @throws std::runtime_error If the archive is truncated or damaged, or
+	///         empty, e.g. since the decompressor couldn't read it.
+	bool next(std::string & name, std::string & content);
+
+	/// Close the archive once it has been read, and check that it was all
+	/// there, i.e., that the decompressor exited successfully. A decompressor
+	/// that isn't installed, or that can't read the archive, writes nothing,
+	/// which would otherwise look like the end of the archive.
+	/// @throws std::runtime_error If the decompressor failed.
+	void close();
+
+  private:
+
+	/// Read exactly the given number of bytes.
+	/// @param buffer Where to put the bytes.
+	/// @param size The number of bytes.
+	/// @return Returns false at the end of the archive, if nothing was read.
+	/// @throws std::runtime_error If only part of the bytes could be read.
+	bool read(char * buffer, size_t size);
+
+	/// Read the content of an entry, including the padding to a whole block.
+	/// @param size The size of the entry.
+	/// @param content Set to the content, or null to discard it.
+	void readContent(size_t size, std::string * content);
+
+	/// Get the decompressor to use for an archive.
+	/// @param path The path of the archive.
+	/// @return Returns the command, or an empty string if the archive isn't
+	///         compressed.
+	static std::string decompressor(const std::string & path);
+
+	FILE * _file { nullptr };	///< The archive, or the output of the decompressor.
+	bool _piped { false };		///< True if the file is the output of a decompressor.
+	bool _started { false };	///< True once any of the archive has been read.
+	std::string _path;			///< The path of the archive, for errors.
+};
@@ -0,0 +1,170 @@
+#include <cerrno>
+#include <climits>		// CDSL_CURRENT is INT_MAX
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>			// Linux only, the CDROM ioctls
+#include <linux/cdrom.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "toc.h"
+
+#include "exceptions.h"
+
+/// The frame offset of the start of the disc. The addresses in the TOC that
+/// are read from a drive don't include it.
+static const int LEAD_IN = 150;
+
+/// The number of frames in a second.
+static const int FRAMES_PER_SECOND = 75;
+
+/// Close a file descriptor when it goes out of scope.
+struct FileDescriptor
+{
+	int fd;		///< The descriptor, or negative if it isn't open.
+	~FileDescriptor() { if(fd >= 0) { ::close(fd); } }
+};
+
+/// Sum the decimal digits of a number, which is how the start time of each
+/// track contributes to the checksum byte of a CDDB disc ID.
+/// @param n A non-negative number.
+/// @return Returns the sum of the digits.
+static int digitSum(int n)
+{
+	int sum = 0;
+	while(n > 0) {
+		sum += n % 10;
+		n /= 10;
+	}
+	return sum;
+}
+
+Toc Toc::parse(const std::string & discId)
+{
+	std::istringstream iss(discId);
+	std::string id;
+	int numTracks = 0;
+	if(not (iss >> id >> numTracks) or numTracks < 1 or numTracks > 99) {
+		throw CddbError("Malformed disc ID: " + discId);
+	}
+
+	Toc toc;
+	toc.offsets.resize(numTracks);
+	for(int i=0;i<numTracks;++i) {
+		if(not (iss >> toc.offsets[i])) {
+			throw CddbError("Malformed disc ID: " + discId);
+		}
+	}
+	int seconds;
+	if(not (iss >> seconds)) {
+		throw CddbError("Malformed disc ID: " + discId);
+	}
+	toc.leadOut = seconds * FRAMES_PER_SECOND;
+	return toc;
+}
+
+uint32_t Toc::discId() const
+{
+	if(offsets.empty()) {
+		return 0;
+	}
+	int checksum = 0;
+	for(int offset : offsets) {
+		checksum += digitSum(offset / FRAMES_PER_SECOND);
+	}
+	uint32_t seconds = length() - offsets[0] / FRAMES_PER_SECOND;
+	return (static_cast<uint32_t>(checksum % 0xff) << 24)
+		 | (seconds << 8)
+		 | static_cast<uint32_t>(offsets.size());
+}
+
+std::string Toc::discIdString() const
+{
+	char buf[9];
+	std::snprintf(buf, sizeof(buf), "%08x", discId());
+	return buf;
+}
+
+std::string Toc::toString() const
+{
+	std::ostringstream oss;
+	oss << discIdString() << " " << offsets.size();
+	for(int offset : offsets) {
+		oss << " " << offset;
+	}
+	oss << " " << length();
+	return oss.str();
+}
+
+std::unique_ptr<TocSource> TocSource::open(const std::string & device)
+{
+	struct stat st;
+	if(::stat(device.c_str(), &st) == 0 and S_ISREG(st.st_mode)) {
+		return std::make_unique<FileTocSource>(device);
+	}
+	return std::make_unique<CdromTocSource>(device);
+}
+
+CdromTocSource::CdromTocSource(const std::string & device)
+  : _device(device)
+{
+}
+
+Toc CdromTocSource::read()
+{
+	// Non-blocking, so that opening doesn't wait for the drive to spin up
+	FileDescriptor device { ::open(_device.c_str(), O_RDONLY | O_NONBLOCK) };
+	int fd = device.fd;
+	if(fd < 0) {
+		if(errno == ENOMEDIUM) {
+			throw NoCdFound();
+		}
+		throw CddbError("Unable to open " + _device + ": " + std::strerror(errno));
+	}
+
+	if(ioctl(fd, CDROM_DRIVE_STATUS, CDSL_CURRENT) != CDS_DISC_OK) {
+		throw NoCdFound();
+	}
+
+	cdrom_tochdr header;
+	if(ioctl(fd, CDROMREADTOCHDR, &header) != 0) {
+		throw NoCdFound();
+	}
+
+	Toc toc;
+	cdrom_tocentry entry;
+	std::memset(&entry, 0, sizeof(entry));
+	entry.cdte_format = CDROM_LBA;
+	for(int track = header.cdth_trk0; track <= header.cdth_trk1; ++track) {
+		entry.cdte_track = track;
+		if(ioctl(fd, CDROMREADTOCENTRY, &entry) != 0) {
+			throw CddbError("Unable to read the table of contents of " + _device + ".");
+		}
+		toc.offsets.push_back(entry.cdte_addr.lba + LEAD_IN);
+	}
+	entry.cdte_track = CDROM_LEADOUT;
+	if(ioctl(fd, CDROMREADTOCENTRY, &entry) != 0) {
+		throw CddbError("Unable to read the lead-out of " + _device + ".");
+	}
+	toc.leadOut = entry.cdte_addr.lba + LEAD_IN;
+	return toc;
+}
+
+FileTocSource::FileTocSource(const std::string & path)
+  : _path(path)
+{
+}
+
+Toc FileTocSource::read()
+{
+	std::ifstream in(_path);
+	std::string line;
+	if(not std::getline(in, line) or line.empty()) {
+		throw NoCdFound();
+	}
+	return Toc::parse(line);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// The table of contents (TOC) of a CD, which is all that is needed to compute
+/// the CDDB disc ID of the disc. All positions are in frames, of which there
+/// are 75 per second, and include the two second lead-in, so that the first
+/// track usually starts at frame 150.
+struct Toc
+{
+	std::vector<int> offsets;	///< The frame offset of the start of each track.
+	int leadOut { 0 };			///< The frame offset of the end of the last track.
+
+	/// Parse a TOC from the format printed by the `cd-discid` tool, which is
+	/// the disc ID, the number of tracks, the frame offset of each track and
+	/// the total length of the disc in seconds, separated by spaces. E.g.,
+	///
+	/// `a70d520d 13 150 17810 40193 58124 74930 92012 115019 135982 150866 169655 183316 196229 230599 3412`
+	///
+	/// The disc ID in the text is ignored, it is computed from the offsets.
+	/// Since only the length in seconds is known, the lead-out is rounded
+	/// down to the start of a second.
+	/// @param discId The text to parse.
+	/// @return Returns the parsed TOC.
+	/// @throws CddbError If the text is not in the expected format.
+	static Toc parse(const std::string & discId);
+
+	/// The total length of the disc, in seconds, as used by the CDDB.
+	/// @return Returns the lead-out in whole seconds.
+	inline int length() const { return leadOut / 75; }
+
+	/// Compute the CDDB disc ID of the disc. The ID is made up of a checksum
+	/// of the start times of the tracks in the top byte, the playing time in
+	/// seconds in the next two bytes, and the number of tracks in the last
+	/// byte.
+	/// @return Returns the 32-bit disc ID.
+	uint32_t discId() const;
+
+	/// Format the disc ID as eight hexadecimal digits, like `a70d520d`.
+	/// @return Returns the formatted disc ID.
+	std::string discIdString() const;
+
+	/// Format the TOC the same way as the `cd-discid` tool, which is also the
+	/// format used by the CDDB `query` command.
+	/// @return Returns the formatted TOC, without a trailing new line.
+	std::string toString() const;
+};
+
+/// Where a table of contents is read from. The real source is a CD drive, but
+/// a file can stand in for the drive, e.g. for testing without a disc.
+class TocSource
+{
+  public:
+
+	virtual ~TocSource() = default;
+
+	/// Read the table of contents.
+	/// @return Returns the TOC of the disc.
+	/// @throws NoCdFound If there is no disc.
+	/// @throws CddbError If the TOC can't be read.
+	virtual Toc read() = 0;
+
+	/// Open the source for a device name. If the name is that of a regular
+	/// file, then a FileTocSource is used, otherwise a CdromTocSource.
+	/// @param device The device name, e.g. Cddb::CD_DEVICE.
+	/// @return Returns the source.
+	static std::unique_ptr<TocSource> open(const std::string & device);
+};
+
+/// Read the TOC of the disc in a CD drive with the Linux CDROM ioctls.
+class CdromTocSource : public TocSource
+{
+  public:
+
+	/// Construct the source. The device isn't opened until read() is called.
+	/// @param device The device name of the drive.
+	explicit CdromTocSource(const std::string & device);
+
+	Toc read() override;
+
+  private:
+	std::string _device;	///< The device name of the drive.
+};
+
+/// Read a TOC from a file that contains the output of the `cd-discid` tool. A
+/// missing or empty file is treated as a drive without a disc.
+class FileTocSource : public TocSource
+{
+  public:
+
+	/// Construct the source. The file isn't read until read() is called.
+	/// @param path The path of the file.
+	explicit FileTocSource(const std::string & path);
+
+	Toc read() override;
+
+  private:
+	std::string _path;		///< The path of the file.
+};
@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
+
+#include <fcntl.h>			// POSIX only, for mmap()
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) or defined(__i386__)
+#include <immintrin.h>
+#define TOC_MATCHER_AVX2
+#endif
+
+#include "toc_matcher.h"
+
+/// Offsets are clamped to this, about 15 hours, so that the sum of the
+/// differences of a row can't overflow.
+static const int32_t MAX_FRAME = 1 << 22;
+
+/// The number of rows whose distances are computed at a time.
+static const size_t BLOCK_ROWS = 4096;
+
+/// A kernel that computes the distance of each row of a bucket from a query.
+/// @param rows The rows.
+/// @param count The number of rows.
+/// @param stride The number of values in a row, a multiple of TocMatcher::LANES.
+/// @param query The row of the query.
+/// @param out Set to the sum of the absolute differences of each row.
+typedef void (*Kernel)(const int32_t * rows, size_t count, size_t stride,
+					   const int32_t * query, int32_t * out);
+
+/// The scalar kernel, which is used if the processor has no AVX2, and which
+/// the vectorized kernel must agree with.
+static void scalarDistances(const int32_t * rows, size_t count, size_t stride,
+							const int32_t * query, int32_t * out)
+{
+	for(size_t r=0;r<count;++r) {
+		const int32_t * row = rows + r * stride;
+		int32_t sum = 0;
+		for(size_t i=0;i<stride;++i) {
+			int32_t diff = row[i] - query[i];
+			sum += diff < 0 ? -diff : diff;
+		}
+		out[r] = sum;
+	}
+}
+
+#ifdef TOC_MATCHER_AVX2
+/// The AVX2 kernel, which works on eight offsets at a time.
+__attribute__((target("avx2")))
+static void avx2Distances(const int32_t * rows, size_t count, size_t stride,
+						  const int32_t * query, int32_t * out)
+{
+	for(size_t r=0;r<count;++r) {
+		const int32_t * row = rows + r * stride;
+		__m256i sum = _mm256_setzero_si256();
+		for(size_t i=0;i<stride;i+=TocMatcher::LANES) {
+			__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i));
+			__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(query + i));
+			sum = _mm256_add_epi32(sum, _mm256_abs_epi32(_mm256_sub_epi32(a, b)));
+		}
+		// Add up the eight lanes
+		__m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+		out[r] = _mm_cvtsi128_si32(half);
+	}
+}
+#endif
+
+/// Choose the kernel for this processor, once.
+/// @return Returns the fastest kernel.
+static Kernel kernel()
+{
+	static const Kernel chosen = [] {
+#ifdef TOC_MATCHER_AVX2
+		if(__builtin_cpu_supports("avx2")) {
+			return &avx2Distances;
+		}
+#endif
+		return &scalarDistances;
+	}();
+	return chosen;
+}
+
+/// Round a number of values up to a whole number of lanes.
+static inline size_t padded(size_t values)
+{
+	return (values + TocMatcher::LANES - 1) / TocMatcher::LANES * TocMatcher::LANES;
+}
+
+TocMatcher::TocMatcher()
+{
+}
+
+TocMatcher::TocMatcher(const std::string & path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		throw std::runtime_error("Unable to open " + path + ": " + std::strerror(errno));
+	}
+	struct stat st;
+	if(::fstat(fd, &st) != 0 or st.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+		::close(fd);
+		throw std::runtime_error("The TOC file " + path + " is damaged.");
+	}
+	_mappedSize = st.st_size;
+	void * mapped = ::mmap(nullptr, _mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);	// The mapping keeps the file open
+	if(mapped == MAP_FAILED) {
+		throw std::runtime_error("Unable to map " + path + ": " + std::strerror(errno));
+	}
+	_mapped = static_cast<const char *>(mapped);
+
+	FileHeader header;
+	std::memcpy(&header, _mapped, sizeof(header));
+	bool valid = header.magic == FILE_MAGIC and header.version == FILE_VERSION
+				 and sizeof(header) + header.buckets * sizeof(BucketHeader) <= _mappedSize;
+	for(uint32_t b=0;valid and b<header.buckets;++b) {
+		BucketHeader bucket;
+		std::memcpy(&bucket, _mapped + sizeof(header) + b * sizeof(BucketHeader), sizeof(bucket));
+		// Bound each field before it is multiplied or added, so that nothing
+		// can wrap around and pass the checks of the ends of the arrays
+		valid = bucket.tracks > 0 and bucket.tracks <= MAX_TRACKS
+				and bucket.stride == padded(bucket.tracks + 1)
+				and bucket.count <= _mappedSize and bucket.tagsOffset <= _mappedSize
+				and bucket.rowsOffset <= _mappedSize
+				and bucket.tagsOffset + bucket.count * sizeof(uint32_t) <= _mappedSize
+				and bucket.rowsOffset + bucket.count * bucket.stride * sizeof(int32_t) <= _mappedSize
+				and bucket.rowsOffset % 32 == 0 and bucket.tagsOffset % 32 == 0;
+		if(valid) {
+			if(bucket.tracks >= _buckets.size()) {
+				_buckets.resize(bucket.tracks + 1);
+			}
+			Bucket & target = _buckets[bucket.tracks];
+			target.stride = bucket.stride;
+			target.count = bucket.count;
+			target.tags = reinterpret_cast<const uint32_t *>(_mapped + bucket.tagsOffset);
+			target.rows = reinterpret_cast<const int32_t *>(_mapped + bucket.rowsOffset);
+		}
+	}
+	if(not valid) {
+		munmap(const_cast<char *>(_mapped), _mappedSize);
+		throw std::runtime_error("The TOC file " + path + " is damaged.");
+	}
+}
+
+TocMatcher::~TocMatcher()
+{
+	if(_mapped != nullptr) {
+		munmap(const_cast<char *>(_mapped), _mappedSize);
+	}
+}
+
+bool TocMatcher::isVectorized()
+{
+	return kernel() != &scalarDistances;
+}
+
+void TocMatcher::add(const Toc & toc, uint32_t tag)
+{
+	size_t tracks = toc.offsets.size();
+	if(tracks == 0 or tracks > MAX_TRACKS) {
+		return;
+	}
+	if(tracks >= _buckets.size()) {
+		_buckets.resize(tracks + 1);
+	}
+	Bucket & bucket = _buckets[tracks];
+	bucket.stride = padded(tracks + 1);
+	auto values = row(toc, bucket.stride);
+	bucket.ownRows.insert(bucket.ownRows.end(), values.begin(), values.end());
+	bucket.ownTags.push_back(tag);
+	bucket.rows = bucket.ownRows.data();
+	bucket.tags = bucket.ownTags.data();
+	bucket.count = bucket.ownTags.size();
+}
+
+void TocMatcher::retag(const std::vector<uint32_t> & tags)
+{
+	for(auto & bucket : _buckets) {
+		for(auto & tag : bucket.ownTags) {
+			tag = tags.at(tag);
+		}
+	}
+}
+
+size_t TocMatcher::size() const
+{
+	size_t total = 0;
+	for(const auto & bucket : _buckets) {
+		total += bucket.count;
+	}
+	return total;
+}
+
+std::vector<TocMatcher::Match> TocMatcher::rank(const Toc & toc, size_t limit, int maxDistance) const
+{
+	return rank(toc, limit, maxDistance, false);
+}
+
+std::vector<TocMatcher::Match> TocMatcher::scalarRank(const Toc & toc, size_t limit, int maxDistance) const
+{
+	return rank(toc, limit, maxDistance, true);
+}
+
+std::vector<TocMatcher::Match> TocMatcher::rank(const Toc & toc, size_t limit, int maxDistance,
+												bool scalar) const
+{
+	size_t tracks = toc.offsets.size();
+	if(tracks == 0 or tracks >= _buckets.size() or _buckets[tracks].count == 0 or limit == 0) {
+		return {};
+	}
+	const Bucket & bucket = _buckets[tracks];
+	const auto query = row(toc, bucket.stride);
+
+	// The best matches so far, with the worst of them on top, so that it can
+	// be replaced by a closer one
+	typedef std::pair<int32_t, uint32_t> Scored;	// the sum of the differences, and the row
+	std::priority_queue<Scored> best;
+	int64_t bound = static_cast<int64_t>(std::max(maxDistance, 0)) * (tracks + 1);
+	int32_t threshold = static_cast<int32_t>(std::min<int64_t>(bound, INT32_MAX));
+
+	Kernel distances = scalar ? &scalarDistances : kernel();
+	std::vector<int32_t> sums(std::min(BLOCK_ROWS, bucket.count));
+	for(size_t first=0;first<bucket.count;first+=BLOCK_ROWS) {
+		size_t count = std::min(BLOCK_ROWS, bucket.count - first);
+		distances(bucket.rows + first * bucket.stride, count, bucket.stride, query.data(), sums.data());
+		for(size_t r=0;r<count;++r) {
+			if(sums[r] > threshold) {
+				continue;
+			}
+			best.emplace(sums[r], static_cast<uint32_t>(first + r));
+			if(best.size() > limit) {
+				best.pop();
+			}
+			if(best.size() == limit) {
+				threshold = std::min(threshold, best.top().first);
+			}
+		}
+	}
+
+	std::vector<Match> matches(best.size());
+	for(size_t i=matches.size();i>0;--i) {
+		const Scored & scored = best.top();
+		matches[i-1] = { bucket.tags[scored.second], static_cast<double>(scored.first) / (tracks + 1) };
+		best.pop();
+	}
+	return matches;
+}
+
+void TocMatcher::save(const std::string & path) const
+{
+	std::vector<BucketHeader> headers;
+	for(size_t tracks=0;tracks<_buckets.size();++tracks) {
+		if(_buckets[tracks].count > 0) {
+			headers.push_back({ static_cast<uint32_t>(tracks),
+								static_cast<uint32_t>(_buckets[tracks].stride),
+								_buckets[tracks].count, 0, 0 });
+		}
+	}
+
+	// Lay out the tags and rows of each bucket after the headers, aligned so
+	// that the rows can be loaded a vector at a time
+	auto align = [](uint64_t offset) { return (offset + 31) / 32 * 32; };
+	uint64_t offset = sizeof(FileHeader) + headers.size() * sizeof(BucketHeader);
+	for(auto & header : headers) {
+		header.tagsOffset = align(offset);
+		header.rowsOffset = align(header.tagsOffset + header.count * sizeof(uint32_t));
+		offset = header.rowsOffset + header.count * header.stride * sizeof(int32_t);
+	}
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	FileHeader fileHeader { FILE_MAGIC, FILE_VERSION, static_cast<uint32_t>(headers.size()), 0 };
+	out.write(reinterpret_cast<const char *>(&fileHeader), sizeof(fileHeader));
+	out.write(reinterpret_cast<const char *>(headers.data()), headers.size() * sizeof(BucketHeader));
+	for(const auto & header : headers) {
+		const Bucket & bucket = _buckets[header.tracks];
+		auto pad = [&out](uint64_t to) {
+			while(static_cast<uint64_t>(out.tellp()) < to) {
+				out.put('\0');
+			}
+		};
+		pad(header.tagsOffset);
+		out.write(reinterpret_cast<const char *>(bucket.tags), bucket.count * sizeof(uint32_t));
+		pad(header.rowsOffset);
+		out.write(reinterpret_cast<const char *>(bucket.rows),
+				  bucket.count * bucket.stride * sizeof(int32_t));
+	}
+	out.close();
+	if(not out) {
+		throw std::runtime_error("Unable to write " + path + ".");
+	}
+}
+
+std::vector<int32_t> TocMatcher::row(const Toc & toc, size_t stride)
+{
+	std::vector<int32_t> values(stride, 0);
+	for(size_t i=0;i<toc.offsets.size();++i) {
+		values[i] = std::clamp(toc.offsets[i], 0, MAX_FRAME);
+	}
+	values[toc.offsets.size()] = std::clamp(toc.leadOut, 0, MAX_FRAME);
+	return values;
+}
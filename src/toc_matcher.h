@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "toc.h"
+
+/// Rank stored tables of contents by how close they are to the TOC of a disc,
+/// for inexact matches (code 211). Different pressings of the same album, and
+/// different drives, give TOCs that are a few frames apart, and so different
+/// disc IDs, but the tracks are the same.
+///
+/// The distance between two TOCs with the same number of tracks is the mean
+/// absolute difference, in frames, of the track offsets and the lead-out. TOCs
+/// with a different number of tracks are never matched.
+///
+/// The TOCs are bucketed by the number of tracks, and each bucket is a single
+/// array of rows, padded to a multiple of #LANES values with zeros. The
+/// distances of a whole bucket are computed by a vectorized kernel (AVX2 when
+/// the processor has it, otherwise a scalar loop), so millions of TOCs can be
+/// scored per query.
+///
+/// The TOCs are either added in memory, or loaded from a file written by
+/// save(), which is memory mapped. A matcher that has been loaded is read-only,
+/// and may be shared between threads.
+class TocMatcher
+{
+  public:
+
+	/// The number of 32-bit values that the kernel works on at once. Rows are
+	/// padded to a multiple of this.
+	static const size_t LANES = 8;
+
+	/// The number of matches returned by default.
+	static const size_t DEFAULT_LIMIT = 10;
+
+	/// The largest distance of a match by default, in frames. This is five
+	/// seconds per track.
+	static const int DEFAULT_MAX_DISTANCE = 5 * 75;
+
+	/// A stored TOC that is close to the disc.
+	struct Match
+	{
+		uint32_t tag;		///< The tag that the TOC was added with.
+		double distance;	///< The mean difference of the offsets, in frames.
+	};
+
+	/// Construct an empty matcher, that TOCs are added to.
+	TocMatcher();
+
+	/// Load a matcher that was written by save().
+	/// @param path The path of the file.
+	/// @throws std::runtime_error If the file can't be loaded, or is damaged.
+	explicit TocMatcher(const std::string & path);
+
+	/// Unmap the file, if the matcher was loaded.
+	~TocMatcher();
+
+	TocMatcher(const TocMatcher &) = delete;
+	TocMatcher & operator=(const TocMatcher &) = delete;
+
+	/// Check if the vectorized kernel is used on this processor.
+	/// @return Returns true for AVX2, false for the scalar loop.
+	static bool isVectorized();
+
+	/// Add a TOC. A TOC with no tracks, or more than a disc can hold, is
+	/// ignored.
+	/// @param toc The TOC.
+	/// @param tag What the TOC is for, e.g. the position of its entry in an
+	///        index, which is returned with its matches.
+	void add(const Toc & toc, uint32_t tag);
+
+	/// Replace the tags of all of the TOCs.
+	/// @param tags The new tag of each old tag, i.e., tag `t` becomes `tags[t]`.
+	void retag(const std::vector<uint32_t> & tags);
+
+	/// The number of TOCs.
+	/// @return Returns the total over all of the buckets.
+	size_t size() const;
+
+	/// Find the closest TOCs to a disc.
+	/// @param toc The TOC of the disc.
+	/// @param limit The most matches to return.
+	/// @param maxDistance The largest distance of a match, in frames.
+	/// @return Returns the matches, closest first.
+	std::vector<Match> rank(const Toc & toc, size_t limit = DEFAULT_LIMIT,
+							int maxDistance = DEFAULT_MAX_DISTANCE) const;
+
+	/// The scalar reference of rank(), with the scalar kernel on any processor.
+	std::vector<Match> scalarRank(const Toc & toc, size_t limit = DEFAULT_LIMIT,
+								  int maxDistance = DEFAULT_MAX_DISTANCE) const;
+
+	/// Write the matcher to a file, so that it can be loaded.
+	/// @param path The path of the file.
+	/// @throws std::runtime_error If the file can't be written.
+	void save(const std::string & path) const;
+
+  private:
+
+	/// The TOCs with the same number of tracks.
+	struct Bucket
+	{
+		size_t stride { 0 };			///< The number of values in a row.
+		size_t count { 0 };				///< The number of rows.
+		const uint32_t * tags { nullptr };	///< The tag of each row.
+		const int32_t * rows { nullptr };	///< The rows, one after the other.
+		std::vector<uint32_t> ownTags;	///< The tags, if they were added in memory.
+		std::vector<int32_t> ownRows;	///< The rows, if they were added in memory.
+	};
+
+	/// The header at the start of a file.
+	struct FileHeader
+	{
+		uint32_t magic;			///< Always FILE_MAGIC.
+		uint32_t version;		///< Always FILE_VERSION.
+		uint32_t buckets;		///< The number of BucketHeader records that follow.
+		uint32_t reserved;		///< Zero.
+	};
+
+	/// Where a bucket is in a file.
+	struct BucketHeader
+	{
+		uint32_t tracks;		///< The number of tracks of the TOCs.
+		uint32_t stride;		///< The number of values in a row.
+		uint64_t count;			///< The number of rows.
+		uint64_t tagsOffset;	///< The offset of the tags.
+		uint64_t rowsOffset;	///< The offset of the rows, aligned to 32 bytes.
+	};
+
+	static const uint32_t FILE_MAGIC = 0x746d6463;		///< "cdmt"
+	static const uint32_t FILE_VERSION = 1;				///< The layout of the file.
+	static const uint32_t MAX_TRACKS = 99;				///< The most tracks of a disc.
+
+	/// Make the row of a TOC, i.e., the track offsets and the lead-out, padded
+	/// with zeros.
+	/// @param toc The TOC.
+	/// @param stride The length of the row.
+	/// @return Returns the row.
+	static std::vector<int32_t> row(const Toc & toc, size_t stride);
+
+	/// Find the closest TOCs to a disc, with the kernel for this processor or
+	/// the scalar one.
+	/// @param toc The TOC of the disc.
+	/// @param limit The most matches to return.
+	/// @param maxDistance The largest distance of a match, in frames.
+	/// @param scalar True to use the scalar kernel.
+	/// @return Returns the matches, closest first.
+	std::vector<Match> rank(const Toc & toc, size_t limit, int maxDistance, bool scalar) const;
+
+	std::vector<Bucket> _buckets;	///< Indexed by the number of tracks.
+	const char * _mapped { nullptr };	///< The loaded file, if any.
+	size_t _mappedSize { 0 };		///< The size of the loaded file.
+};
@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+
+#include "trace.h"
+
+/// The trace attached to this thread.
+static thread_local Trace::Ptr attached;
+
+/// The name of this thread in the traces, or empty for a number.
+static thread_local std::string threadName;
+
+/// Quote a string for JSON.
+/// @param s The string.
+/// @return Returns the string in double quotes, with special characters escaped.
+static std::string quote(const std::string & s)
+{
+	std::string quoted = "\"";
+	for(unsigned char c : s) {
+		if(c == '"' or c == '\\') {
+			quoted += '\\';
+			quoted += c;
+		} else if(c < 0x20) {
+			char escaped[8];
+			std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			quoted += escaped;
+		} else {
+			quoted += c;
+		}
+	}
+	return quoted + "\"";
+}
+
+/// Make a string safe to use in a file name.
+/// @param s The string.
+/// @return Returns the string with anything but letters, digits, '-' and '_'
+///         replaced by '_'.
+static std::string fileSafe(const std::string & s)
+{
+	std::string safe(s);
+	std::replace_if(safe.begin(), safe.end(), [](unsigned char c) {
+		return not (std::isalnum(c) or c == '-' or c == '_');
+	}, '_');
+	return safe;
+}
+
+Trace::Span::Span(const Ptr & trace, const char * name)
+  : _trace(trace), _name(name)
+{
+	if(_trace) {
+		_start = std::chrono::steady_clock::now();
+	}
+}
+
+Trace::Span::~Span()
+{
+	if(_trace) {
+		auto end = std::chrono::steady_clock::now();
+		auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - _start);
+		_trace->add(_name, _start, duration.count(), std::move(_args));
+	}
+}
+
+void Trace::Span::arg(const char * key, const std::string & value)
+{
+	if(_trace) {
+		_args.emplace_back(key, value);
+	}
+}
+
+Trace::Attach::Attach(const Ptr & trace)
+  : _previous(attached)
+{
+	attached = trace;
+}
+
+Trace::Attach::~Attach()
+{
+	attached = _previous;
+}
+
+bool Trace::enabled()
+{
+	const char * dir = std::getenv("CDIMPORT_TRACE_DIR");
+	return dir != nullptr and *dir != '\0';
+}
+
+Trace::Ptr Trace::start(const std::string & device)
+{
+	if(not enabled()) {
+		return nullptr;
+	}
+	return Ptr(new Trace(std::getenv("CDIMPORT_TRACE_DIR"), device));
+}
+
+Trace::Ptr Trace::current()
+{
+	return attached;
+}
+
+void Trace::nameThread(const std::string & name)
+{
+	threadName = name;
+}
+
+Trace::Trace(const std::string & dir, const std::string & device)
+  : _dir(dir), _device(device), _start(std::chrono::steady_clock::now()),
+	_wallStart(std::chrono::system_clock::now())
+{
+}
+
+Trace::~Trace()
+{
+	finish();
+}
+
+void Trace::setLabel(const std::string & label)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_label = label;
+}
+
+void Trace::instant(const char * name)
+{
+	add(name, std::chrono::steady_clock::now(), -1, {});
+}
+
+void Trace::add(const char * name, std::chrono::steady_clock::time_point start, int64_t durationUs,
+				std::vector<std::pair<std::string, std::string>> && args)
+{
+	int tid = threadId();
+	auto startUs = std::chrono::duration_cast<std::chrono::microseconds>(start - _start);
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(_finished) {
+		return;
+	}
+	_events.push_back({ name, startUs.count(), durationUs, tid, std::move(args) });
+	auto seen = std::find_if(_threads.begin(), _threads.end(), [tid](const auto & thread) {
+		return thread.first == tid;
+	});
+	if(seen == _threads.end()) {
+		_threads.emplace_back(tid, threadName.empty() ? "thread " + std::to_string(tid)
+													  : threadName);
+	}
+}
+
+int Trace::threadId()
+{
+	static std::atomic<int> next { 1 };
+	static thread_local int id = next++;
+	return id;
+}
+
+bool Trace::finish()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(_finished) {
+		return true;
+	}
+	_finished = true;
+
+	std::time_t wall = std::chrono::system_clock::to_time_t(_wallStart);
+	char stamp[32];
+	std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&wall));
+	std::string path = _dir + "/" + stamp + "-" + fileSafe(_label) + ".json";
+
+	std::ofstream out(path);
+	out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"device\":" << quote(_device)
+		<< ",\"disc\":" << quote(_label) << ",\"started\":" << quote(stamp) << "},\n"
+		<< "\"traceEvents\":[\n"
+		<< "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":"
+		<< quote("cdimport " + _device) << "}}";
+	for(const auto & [tid, name] : _threads) {
+		out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+			<< ",\"args\":{\"name\":" << quote(name) << "}}";
+	}
+	for(const auto & event : _events) {
+		out << ",\n{\"name\":" << quote(event.name) << ",\"cat\":\"cdimport\",\"pid\":1,\"tid\":"
+			<< event.tid << ",\"ts\":" << event.startUs;
+		if(event.durationUs >= 0) {
+			out << ",\"ph\":\"X\",\"dur\":" << event.durationUs;
+		} else {
+			out << ",\"ph\":\"i\",\"s\":\"t\"";
+		}
+		if(not event.args.empty()) {
+			out << ",\"args\":{";
+			for(size_t i=0;i<event.args.size();++i) {
+				out << (i == 0 ? "" : ",") << quote(event.args[i].first) << ":"
+					<< quote(event.args[i].second);
+			}
+			out << "}";
+		}
+		out << "}";
+	}
+	out << "\n]}\n";
+
+	if(not out) {
+		std::cerr << "Unable to write the trace " << path << std::endl;
+		return false;
+	}
+#ifdef DEBUG
+	std::cout << "Wrote the trace " << path << std::endl;
+#endif
+	return true;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// A timeline of everything that happened to one disc, from the tray closing
+/// to the eject, written as a Chrome trace (JSON) that can be opened in
+/// Perfetto or `chrome://tracing` to see why that disc was slow. Where
+/// Metrics says how long each stage takes on the whole, a trace shows the
+/// stages of one disc nested in each other, on the threads that ran them,
+/// including the time the operator spent in dialogs.
+///
+/// Tracing is off unless the `CDIMPORT_TRACE_DIR` environment variable names
+/// a directory, in which case start() begins a trace for each disc, and the
+/// trace is written there when it is finished. While it is off, a Span costs
+/// a check of a thread-local pointer.
+///
+/// Spans are recorded into the trace that is attached to the current thread
+/// (see Attach), so the code being traced doesn't need to know which disc it
+/// is working on. The code that owns a disc, e.g. CdImport and CddbLookup,
+/// attaches its trace, or passes it to Span explicitly.
+///
+/// A trace is safe to record into from several threads.
+class Trace
+{
+  public:
+
+	typedef std::shared_ptr<Trace> Ptr;
+
+	/// Record a span of time, from construction to destruction, into a trace.
+	class Span
+	{
+	  public:
+		/// Start a span in the trace attached to this thread, if there is one.
+		/// @param name What is happening, e.g. "cddb_query".
+		explicit Span(const char * name) : Span(current(), name) {}
+
+		/// Start a span in a trace.
+		/// @param trace The trace, or nullptr to record nothing.
+		/// @param name What is happening.
+		Span(const Ptr & trace, const char * name);
+
+		/// End the span, and record it.
+		~Span();
+
+		Span(const Span &) = delete;
+		Span & operator=(const Span &) = delete;
+
+		/// Add a detail to the span, shown when it is selected.
+		/// @param key The name of the detail.
+		/// @param value The detail.
+		void arg(const char * key, const std::string & value);
+
+	  private:
+		Ptr _trace;											///< The trace, or nullptr.
+		const char * _name;									///< What is happening.
+		std::chrono::steady_clock::time_point _start;		///< When it started.
+		std::vector<std::pair<std::string, std::string>> _args;	///< The details.
+	};
+
+	/// Attach a trace to the current thread for the lifetime of this object,
+	/// so that Spans are recorded into it. The trace that was attached before
+	/// is attached again afterwards.
+	class Attach
+	{
+	  public:
+		/// Attach a trace.
+		/// @param trace The trace, or nullptr to record nothing.
+		explicit Attach(const Ptr & trace);
+
+		/// Attach the previous trace again.
+		~Attach();
+
+		Attach(const Attach &) = delete;
+		Attach & operator=(const Attach &) = delete;
+
+	  private:
+		Ptr _previous;	///< The trace that was attached before.
+	};
+
+	/// Check if tracing has been turned on by `CDIMPORT_TRACE_DIR`.
+	static bool enabled();
+
+	/// Begin a trace of a disc, if tracing is on.
+	/// @param device The drive that the disc is in.
+	/// @return Returns the trace, or nullptr if tracing is off.
+	static Ptr start(const std::string & device);
+
+	/// The trace attached to the current thread.
+	/// @return Returns the trace, or nullptr.
+	static Ptr current();
+
+	/// Name the current thread in the traces, e.g. "lookup /dev/sr0".
+	/// @param name The name of the thread.
+	static void nameThread(const std::string & name);
+
+	/// Write the trace, if it hasn't been finished.
+	~Trace();
+
+	Trace(const Trace &) = delete;
+	Trace & operator=(const Trace &) = delete;
+
+	/// Name the trace after its disc, once the disc ID is known. The name is
+	/// used for the file.
+	/// @param label The disc ID.
+	void setLabel(const std::string & label);
+
+	/// Record a moment, e.g. when the operator clicked a button.
+	/// @param name What happened.
+	void instant(const char * name);
+
+	/// Write the trace to `CDIMPORT_TRACE_DIR`, as
+	/// `<date>-<time>-<label>.json`. Anything recorded afterwards is dropped.
+	/// Failure is reported, but isn't fatal.
+	/// @return Returns false if the file couldn't be written.
+	bool finish();
+
+  private:
+
+	/// A span, or a moment if it has no duration.
+	struct Event
+	{
+		std::string name;									///< What happened.
+		int64_t startUs;									///< When, since the trace began.
+		int64_t durationUs;									///< How long, or -1 for a moment.
+		int tid;											///< The thread it happened on.
+		std::vector<std::pair<std::string, std::string>> args;	///< The details.
+	};
+
+	/// Begin a trace.
+	/// @param dir The directory to write the trace to.
+	/// @param device The drive that the disc is in.
+	Trace(const std::string & dir, const std::string & device);
+
+	/// Record an event.
+	/// @param name What happened.
+	/// @param start When it started.
+	/// @param durationUs How long it took, or -1 for a moment.
+	/// @param args The details.
+	void add(const char * name, std::chrono::steady_clock::time_point start, int64_t durationUs,
+			 std::vector<std::pair<std::string, std::string>> && args);
+
+	/// The number of the current thread in the traces, given out in the
+	/// order that threads first record something.
+	/// @return Returns the thread number.
+	static int threadId();
+
+	const std::string _dir;								///< Where the trace is written.
+	const std::string _device;							///< The drive.
+	const std::chrono::steady_clock::time_point _start;	///< When the trace began.
+	const std::chrono::system_clock::time_point _wallStart;	///< The same, by the wall clock.
+	std::string _label { "disc" };						///< What the file is named after.
+	std::vector<Event> _events;							///< What happened.
+	std::vector<std::pair<int, std::string>> _threads;	///< The names of the threads seen.
+	bool _finished { false };							///< Has the trace been written?
+	std::mutex _mutex;									///< Guards the members above.
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+/// Trace the rest of the enclosing scope, in the trace attached to the thread.
+#define TRACE_SPAN(name) Trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
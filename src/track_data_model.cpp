@@ -1,7 +1,6 @@
 
 #include <cassert>
 #include <iostream>
-#include <sstream>
 
 #include "track_data_model.h"
 
@@ -10,15 +9,17 @@
 #include "utility.h"
 
 TrackDataModel::TrackDataModel(const Track::TrackList & tracks)
-  : QAbstractTableModel(nullptr), _tracks(tracks.size())
+  : QAbstractTableModel(nullptr), _tracks(tracks), _display(tracks.size())
 {
 #ifdef DEBUG
 	std::cout << "Building data model." << std::endl;
 #endif
 	assert(tracks.size() > 0);
 
-	// Copy the data
-	_tracks = tracks;
+	// Render the text of every track up front
+	for(size_t i=0;i<_tracks.size();++i) {
+		render(i);
+	}
 }
 
 // Implementation of required pure-virtual method.
@@ -28,37 +29,48 @@ int TrackDataModel::rowCount(const QModelIndex & parent) const {
 
 // Implementation of required pure-virtual method.
 int TrackDataModel::columnCount(const QModelIndex & parent) const {
-	return 3;
+	return NUM_COLUMNS;
 }
 
 QVariant TrackDataModel::data(const QModelIndex & index, int role) const
 {
-	if(index.isValid() and role == Qt::DisplayRole) {
-		Track::TrackRecord row = _tracks[index.row()];
-		switch(index.column()) {
-			case 0:
-				return QVariant(QStr(std::get<Track::Title>(row)));
-				break;
-			case 1:
-				if (_hasLen) {
-					int seconds = std::get<Track::Length_S>(row);
-					auto pretty = Utility::readableLength(seconds);
-					return QVariant(QStr(pretty));
-#ifdef ONLY_FOR_ADD_ALBUM
-				} else {
-					return QVariant(QStr(row["side"]));
-#endif
-				}
-				break;
-			case 2:
-				auto extra = std::get<Track::ExtraInfo>(row);
-				return QVariant(QStr(extra));
-				break;
-		}
+	if(index.isValid() and (role == Qt::DisplayRole or role == Qt::EditRole)) {
+		return QVariant(_display[index.row()][index.column()]);
 	}
 	return QVariant();
 }
 
+bool TrackDataModel::setData(const QModelIndex & index, const QVariant & value, int role)
+{
+	if(not index.isValid() or role != Qt::EditRole) {
+		return false;
+	}
+	Track::TrackRecord & track = _tracks[index.row()];
+	switch(index.column()) {
+		case Name:
+			std::get<Track::Title>(track) = value.toString().toStdString();
+			break;
+		case Extra:
+			std::get<Track::ExtraInfo>(track) = value.toString().toStdString();
+			break;
+		default:
+			return false;
+	}
+	QString before = _display[index.row()][index.column()];
+	render(index.row());
+	changed(index.row(), static_cast<Column>(index.column()), before);
+	return true;
+}
+
+Qt::ItemFlags TrackDataModel::flags(const QModelIndex & index) const
+{
+	Qt::ItemFlags flags = QAbstractTableModel::flags(index);
+	if(index.isValid() and (index.column() == Name or index.column() == Extra)) {
+		flags |= Qt::ItemIsEditable;
+	}
+	return flags;
+}
+
 QVariant TrackDataModel::headerData(int section,
 									Qt::Orientation orientation,
 									int role) const
@@ -66,24 +78,22 @@ QVariant TrackDataModel::headerData(int section,
 	if(role == Qt::DisplayRole) {
 		if(orientation == Qt::Horizontal) {
 			switch(section) {
-				case 0:
+				case Name:
 					return QVariant("Track Name");
 					break;
-				case 1:
+				case Length:
 					if(_hasLen) {
 						return QVariant("Length");
 					} else {
 						return QVariant("Side");
 					}
 					break;
-				case 2:
+				case Extra:
 					return QVariant("Extra Information");
 					break;
 			}
 		} else {
-			std::stringstream ss;
-			ss << "Track " << (section + 1);
-			return QVariant(QStr(ss.str()));
+			return QVariant(QString("Track %1").arg(section + 1));
 		}
 	}
 	return QVariant();
@@ -93,6 +103,7 @@ void TrackDataModel::updateTrack(int which, const std::string & name,
 								 const std::string & ext, const std::string * side)
 {
 	which -= 1;
+	Rendered before = _display[which];
 	std::get<Track::Title>(_tracks[which]) = name;
 	std::get<Track::ExtraInfo>(_tracks[which]) = ext;
 #ifdef ONLY_FOR_ADD_ALBUM
@@ -111,5 +122,31 @@ void TrackDataModel::updateTrack(int which, const std::string & name,
 #endif
 	std::cout << std::endl;
 #endif
+	render(which);
+	changed(which, Name, before[Name]);
+	changed(which, Length, before[Length]);
+	changed(which, Extra, before[Extra]);
 }
 
+void TrackDataModel::render(size_t i)
+{
+	const Track::TrackRecord & track = _tracks[i];
+	Rendered & rendered = _display[i];
+	rendered[Name] = QStr(std::get<Track::Title>(track));
+	if(_hasLen) {
+		rendered[Length] = QStr(Utility::readableLength(std::get<Track::Length_S>(track)));
+#ifdef ONLY_FOR_ADD_ALBUM
+	} else {
+		rendered[Length] = QStr(track["side"]);
+#endif
+	}
+	rendered[Extra] = QStr(std::get<Track::ExtraInfo>(track));
+}
+
+void TrackDataModel::changed(int row, Column column, const QString & before)
+{
+	if(_display[row][column] != before) {
+		QModelIndex cell = index(row, column);
+		emit dataChanged(cell, cell, { Qt::DisplayRole, Qt::EditRole });
+	}
+}
@@ -1,14 +1,21 @@
 
 #pragma once
 
+#include <array>
 #include <vector>
 
 #include <QAbstractTableModel>
+#include <QString>
 
 #include "cd.h"
 
 /// This class specifies the underlying model for the table view that displays
 /// the track information of the CD.
+///
+/// The text shown for each track is rendered once, when the track is set, and
+/// kept alongside it, so painting the view doesn't convert or format anything.
+/// The name and extra information can be edited in place, and each change is
+/// signalled for the cells that changed, rather than by resetting the view.
 /// \TODO Kill _hasLen after making the addalbum application
 class TrackDataModel : public QAbstractTableModel
 {
@@ -16,6 +23,15 @@ class TrackDataModel : public QAbstractTableModel
 
   public:
 
+	/// The columns of the model.
+	enum Column
+	{
+		Name = 0,		///< The name of the track. Editable.
+		Length,			///< The length of the track, or the side for addalbum.
+		Extra,			///< The extra information of the track. Editable.
+		NUM_COLUMNS
+	};
+
 	/// Construct the data model by providing the track data.
 	/// @param tracks The data to be displayed in the table view associated with
 	/// this model.
@@ -26,17 +42,31 @@ class TrackDataModel : public QAbstractTableModel
 	/// @return The returned value is non-negative.
 	virtual int rowCount(const QModelIndex & parent) const override;
 
-	/// Returns 3. Required.
+	/// Returns #NUM_COLUMNS. Required.
 	/// @param parent The parent object.
-	/// @return Returns 3.
+	/// @return Returns #NUM_COLUMNS.
 	virtual int columnCount(const QModelIndex & parent) const override;
 
 	/// Provide the view access to the data to. Required.
 	/// @index The index into the model, zero-based.
 	/// @role What role does the datum play in the view?
-	/// @return For this simple data model, only strings are returned.
+	/// @return For this simple data model, only the pre-rendered strings are
+	///         returned, for both the display and edit roles.
 	virtual QVariant data(const QModelIndex & index, int role = Qt::DisplayRole) const override;
 
+	/// Edit the name or extra information of a track in place.
+	/// @param index The cell that was edited.
+	/// @param value The new text.
+	/// @param role Only the edit role is handled.
+	/// @return Returns true if the track was changed.
+	virtual bool setData(const QModelIndex & index, const QVariant & value,
+						 int role = Qt::EditRole) override;
+
+	/// Mark the name and extra information as editable.
+	/// @param index The cell.
+	/// @return Returns the flags of the cell.
+	virtual Qt::ItemFlags flags(const QModelIndex & index) const override;
+
 	/// Returns the horizontal header information. Not-required.
 	/// @param section The column number.
 	/// @param orientation Either column header (horizontal) or row header (vertical).
@@ -50,12 +80,13 @@ class TrackDataModel : public QAbstractTableModel
 	/// @return Returns a constant reference to the underlying data.
 	inline const Track::TrackList & tracks() const { return _tracks; }
 
-	/// Provide editable access to the underlying data in the model.
+	/// Provide read-only access to a track. Tracks are changed through
+	/// updateTrack() or setData(), so that the view is told.
 	/// @param i The zero-based index into the underlying data.
 	/// @return Returns a reference to the underlying TrackRecord data structure.
-	Track::TrackRecord & operator[](size_t i) { return _tracks[i]; }
+	const Track::TrackRecord & operator[](size_t i) const { return _tracks[i]; }
 
-	/// Update a track in the data model.
+	/// Update a track in the data model. The view is told which cells changed.
 	/// @param which A one-based index into the data model.
 	/// @param name The new name of the track.
 	/// @param ext The new extended information for the track.
@@ -67,7 +98,21 @@ class TrackDataModel : public QAbstractTableModel
 	
   private:
 
-	Track::TrackList _tracks;	///< The actual data in the data model.
-	bool _hasLen;				///< Is the "length" field specified in the data model?
+	/// The text shown for each column of a track.
+	typedef std::array<QString, NUM_COLUMNS> Rendered;
+
+	/// Render the text shown for a track.
+	/// @param i The zero-based index of the track.
+	void render(size_t i);
+
+	/// Tell the view that a cell has changed, if its text has.
+	/// @param row The zero-based index of the track.
+	/// @param column The column.
+	/// @param before The text of the cell before the change.
+	void changed(int row, Column column, const QString & before);
+
+	Track::TrackList _tracks;		///< The actual data in the data model.
+	std::vector<Rendered> _display;	///< The text shown for each track.
+	bool _hasLen { true };			///< Is the "length" field specified in the data model?
 };
 
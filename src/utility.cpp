@@ -23,3 +23,16 @@ std::string Utility::readableLength(int l)
 	return ss.str();
 }
 
+
+std::string Utility::shellQuote(const std::string & s)
+{
+	std::string quoted = "'";
+	for(char c : s) {
+		if(c == '\'') {
+			quoted += "'\\''";
+		} else {
+			quoted += c;
+		}
+	}
+	return quoted + "'";
+}
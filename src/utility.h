@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include <string>
+
 /// Abstract class that contains utility methods.
 class Utility
 {
@@ -16,5 +18,11 @@ class Utility
 	///         number of minutes less than 100, then hours isn't output,
 	///         instead a two-digit number of minutes are output.
 	static std::string readableLength(int l);
+
+	/// Quote a string for the shell, for passing to `system()`.
+	/// @param s Any string, e.g. a file name.
+	/// @return Returns the string in single quotes, with any single quotes in
+	///         it escaped.
+	static std::string shellQuote(const std::string & s);
 };
 
@@ -0,0 +1,197 @@
+#include <charconv>
+
+#include "xmcd.h"
+
+/// Parse the leading, non-negative number of a field.
+/// @param text The text, which may start with spaces.
+/// @param value Set to the number, if there is one.
+/// @return Returns the text after the number, or an empty view if there is
+///         no number.
+static std::string_view parseNumber(std::string_view text, int & value)
+{
+	size_t start = text.find_first_not_of(" \t");
+	if(start == std::string_view::npos) {
+		return {};
+	}
+	const char * first = text.data() + start;
+	const char * last = text.data() + text.size();
+	auto [ptr, ec] = std::from_chars(first, last, value);
+	if(ec != std::errc() or ptr == first) {
+		return {};
+	}
+	// Keep a non-null data pointer, so that an empty remainder still counts as a number
+	return std::string_view(ptr, last - ptr);
+}
+
+/// Append a value to a field, decoding the `\n`, `\t` and `\\` escapes.
+/// @param field The field, which holds the values of any earlier lines.
+/// @param value The value on this line.
+static void appendValue(std::string & field, std::string_view value)
+{
+	size_t slash = value.find('\\');
+	if(slash == std::string_view::npos) {
+		field.append(value);
+		return;
+	}
+	field.reserve(field.size() + value.size());
+	for(size_t i=0;i<value.size();++i) {
+		char c = value[i];
+		if(c == '\\' and i + 1 < value.size()) {
+			switch(value[i+1]) {
+				case 'n':	c = '\n';	++i;	break;
+				case 't':	c = '\t';	++i;	break;
+				case '\\':				++i;	break;
+				default:						break;
+			}
+		}
+		field.push_back(c);
+	}
+}
+
+/// Append a value to the field of a track, growing the list as needed. A
+/// field whose number isn't that of a track, e.g. TTITLE-1 or TTITLE4294967295,
+/// is skipped.
+/// @param fields The track titles or extra info.
+/// @param number The track number in the keyword, e.g. 3 for TTITLE3.
+/// @param value The value on this line.
+static void appendTrackValue(std::vector<std::string> & fields, std::string_view number,
+							 std::string_view value)
+{
+	unsigned n = 0;
+	auto [ptr, ec] = std::from_chars(number.data(), number.data() + number.size(), n);
+	if(ec != std::errc() or ptr != number.data() + number.size() or number.empty()) {
+		return;
+	}
+	if(n >= XmcdParser::MAX_TRACKS) {
+		return;
+	}
+	if(n >= fields.size()) {
+		fields.resize(n + 1);
+	}
+	appendValue(fields[n], value);
+}
+
+/// Check if a view starts with a prefix.
+static inline bool startsWith(std::string_view text, std::string_view prefix)
+{
+	return text.substr(0, prefix.size()) == prefix;
+}
+
+bool XmcdParser::parse(std::string_view raw, XmcdEntry & entry)
+{
+	std::string dtitle;
+	std::string dyear;
+	bool haveTitle = false;
+	bool inOffsets = false;
+	bool firstLine = true;
+
+	size_t pos = 0;
+	while(pos < raw.size()) {
+		size_t end = raw.find('\n', pos);
+		if(end == std::string_view::npos) {
+			end = raw.size();
+		}
+		std::string_view line = raw.substr(pos, end - pos);
+		pos = end + 1;
+		if(not line.empty() and line.back() == '\r') {
+			line.remove_suffix(1);
+		}
+		bool isFirst = firstLine;
+		firstLine = false;
+
+		if(line == ".") {
+			break;
+		}
+		if(line.empty()) {
+			continue;
+		}
+
+		if(line[0] == '#') {
+			// The table of contents is only given in the comments
+			std::string_view comment = line.substr(1);
+			if(comment.find("Track frame offsets") != std::string_view::npos) {
+				inOffsets = true;
+			} else if(size_t at = comment.find("Disc length:"); at != std::string_view::npos) {
+				inOffsets = false;
+				parseNumber(comment.substr(at + 12), entry.discLength);
+			} else if(inOffsets) {
+				int frame = 0;
+				if(parseNumber(comment, frame).data() != nullptr) {
+					entry.offsets.push_back(frame);
+				} else {
+					inOffsets = false;
+				}
+			}
+			continue;
+		}
+
+		size_t equals = line.find('=');
+		if(equals == std::string_view::npos) {
+			// The status line of a read response, e.g. "210 rock a70d520d CD database entry follows"
+			if(isFirst and line[0] >= '0' and line[0] <= '9') {
+				size_t first = line.find(' ');
+				if(first != std::string_view::npos) {
+					size_t second = line.find(' ', first + 1);
+					entry.category = line.substr(first + 1, second == std::string_view::npos
+																? std::string_view::npos
+																: second - first - 1);
+				}
+			}
+			continue;
+		}
+		if(equals == 0) {
+			// A value without a key, which isn't a field
+			continue;
+		}
+
+		std::string_view key = line.substr(0, equals);
+		std::string_view value = line.substr(equals + 1);
+		switch(key[0]) {
+			case 'T':
+				if(startsWith(key, "TTITLE")) {
+					appendTrackValue(entry.trackTitles, key.substr(6), value);
+				}
+				break;
+			case 'E':
+				if(startsWith(key, "EXTT")) {
+					appendTrackValue(entry.trackExtras, key.substr(4), value);
+				} else if(key == "EXTD") {
+					appendValue(entry.extraInfo, value);
+				}
+				break;
+			case 'D':
+				if(key == "DTITLE") {
+					appendValue(dtitle, value);
+					haveTitle = true;
+				} else if(key == "DYEAR") {
+					dyear.append(value);
+				} else if(key == "DGENRE") {
+					appendValue(entry.genre, value);
+				} else if(key == "DISCID") {
+					// A revised entry may list several disc IDs
+					while(not value.empty()) {
+						size_t comma = value.find(',');
+						if(comma != 0) {
+							entry.discIds.emplace_back(value.substr(0, comma));
+						}
+						value.remove_prefix(comma == std::string_view::npos ? value.size() : comma + 1);
+					}
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	parseNumber(dyear, entry.year);
+
+	// A self-titled album may not have a title part
+	size_t slash = dtitle.find(" / ");
+	if(slash == std::string::npos) {
+		entry.artist = entry.title = dtitle;
+	} else {
+		entry.artist = dtitle.substr(0, slash);
+		entry.title = dtitle.substr(slash + 3);
+	}
+	return haveTitle;
+}
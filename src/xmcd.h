@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// An entry of the CDDB, as parsed from an xmcd file or the response to a
+/// `cddb read` command. See Cddb for an example of the format.
+struct XmcdEntry
+{
+	std::string category;					///< From the status line of a read response, if any.
+	std::vector<std::string> discIds;		///< The disc IDs of the DISCID field.
+	std::string artist;						///< The part of DTITLE before the " / ".
+	std::string title;						///< The part of DTITLE after the " / ".
+	int year { 0 };							///< DYEAR, or 0 if not known.
+	std::string genre;						///< DGENRE.
+	std::string extraInfo;					///< EXTD.
+	std::vector<std::string> trackTitles;	///< TTITLEn, indexed by n.
+	std::vector<std::string> trackExtras;	///< EXTTn, indexed by n.
+	std::vector<int> offsets;				///< The track frame offsets, from the comments.
+	int discLength { 0 };					///< The disc length in seconds, from the comments.
+};
+
+/// A hand-written, single-pass parser for xmcd text. It works directly on the
+/// raw buffer, without splitting it into lines or using regular expressions,
+/// since it is used by the bulk import paths that parse millions of entries.
+///
+/// As the xmcd format specifies, a field that is too long for one line is
+/// continued on the following lines with the same keyword, and the values are
+/// concatenated. The `\n`, `\t` and `\\` escapes in values are decoded.
+class XmcdParser
+{
+  private:
+	/// Private default contructor.
+	XmcdParser();
+
+  public:
+
+	/// The most tracks a disc can have. TTITLEn and EXTTn fields with a
+	/// number of this or more are skipped.
+	static const unsigned MAX_TRACKS = 99;
+
+	/// Parse xmcd text. Parsing stops at the terminating line that contains
+	/// only a dot, or at the end of the text.
+	/// @param raw The xmcd text.
+	/// @param entry Filled in with the parsed values. It should be empty.
+	/// @return Returns false if the text contains no DTITLE.
+	static bool parse(std::string_view raw, XmcdEntry & entry);
+};